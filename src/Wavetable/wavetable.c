@@ -110,14 +110,14 @@ void initWavetable(Wavetable* table, const char* title, int frames, int sampleRa
     table->total_samples = frames * WAVETABLE_FRAME_LEN * channels;
     table->randf = randf;
     table->randi = randi;
-    // Initiate buffers
+    // Buffers are allocated zeroed on first touch
     // Main
-    table->main_time = (double*)calloc(frames * WAVETABLE_FRAME_LEN * channels, sizeof(double));
-    table->main_freq = (double _Complex*)calloc(frames * WAVETABLE_FRAME_LEN * channels, sizeof(double _Complex));
+    table->main_time = NULL;
+    table->main_freq = NULL;
     table->main_time_mode = true;
     // Aux1
-    table->aux1_time = (double*)calloc(frames * WAVETABLE_FRAME_LEN * channels, sizeof(double));
-    table->aux1_freq = (double _Complex*)calloc(frames * WAVETABLE_FRAME_LEN * channels, sizeof(double _Complex));
+    table->aux1_time = NULL;
+    table->aux1_freq = NULL;
     table->aux1_time_mode = true;
 }
 
@@ -148,11 +148,11 @@ bool importWav(Wavetable* table, BufferType buffer, const char* path) {
     switch(buffer) {
         case BUFFER_MAIN: {
             table->main_time_mode = true;
-            return readWav(path, table->num_channels, table->num_frames * WAVETABLE_FRAME_LEN, table->main_time);
+            return readWav(path, table->num_channels, table->num_frames * WAVETABLE_FRAME_LEN, getTimeBuffer(table, BUFFER_MAIN));
         }
         case BUFFER_AUX1: {
             table->aux1_time_mode = true;
-            return readWav(path, table->num_channels, table->num_frames * WAVETABLE_FRAME_LEN, table->aux1_time);
+            return readWav(path, table->num_channels, table->num_frames * WAVETABLE_FRAME_LEN, getTimeBuffer(table, BUFFER_AUX1));
         }
     }
 }
@@ -164,12 +164,13 @@ Exports to a file at 'path'
 bool exportWav(Wavetable* table, BufferType buffer, const char* path, int sample_size, int num_frames) {
     switch(buffer) {
         case BUFFER_MAIN: {
-            check_time_mode(&table->main_time_mode, table->num_frames, table->main_freq, table->main_time);
+            // Only read in freq mode, when it is already allocated
+            check_time_mode(&table->main_time_mode, table->num_frames, table->main_freq, getTimeBuffer(table, BUFFER_MAIN));
             normalize_to_one(table->total_samples, table->main_time);
             return writeWav(path, table->num_channels, table->sample_rate, sample_size, num_frames * WAVETABLE_FRAME_LEN, table->main_time);
         }
         case BUFFER_AUX1: {
-            check_time_mode(&table->aux1_time_mode, table->num_frames, table->aux1_freq, table->aux1_time);
+            check_time_mode(&table->aux1_time_mode, table->num_frames, table->aux1_freq, getTimeBuffer(table, BUFFER_AUX1));
             normalize_to_one(table->total_samples, table->aux1_time);
             return writeWav(path, table->num_channels, table->sample_rate, sample_size, num_frames * WAVETABLE_FRAME_LEN, table->aux1_time);
         }
@@ -197,25 +198,11 @@ void normalizeByFrame(Wavetable* table, BufferType buffer, int minFrame, int max
 
 /* Outside mode toggling */
 void setTimeMode(Wavetable* table, BufferType buffer, bool time_mode) {
-    // Get buffers
-    double* time_buffer;
-    _Complex double* freq_buffer;
-    bool* time_mode_pointer;
-
-    switch (buffer) {
-        case BUFFER_MAIN: {
-            time_buffer = table->main_time;
-            freq_buffer = table->main_freq;
-            time_mode_pointer = &table->main_time_mode;
-            break;
-        }
-        case BUFFER_AUX1: {
-            time_buffer = table->aux1_time;
-            freq_buffer = table->aux1_freq;
-            time_mode_pointer = &table->aux1_time_mode;
-            break;
-        }
-    }
+    // Get buffers, a buffer already in the wanted mode is left unallocated
+    bool* time_mode_pointer = buffer == BUFFER_MAIN ? &table->main_time_mode : &table->aux1_time_mode;
+    if (*time_mode_pointer == time_mode) return;
+    double* time_buffer = getTimeBuffer(table, buffer);
+    _Complex double* freq_buffer = getFreqBuffer(table, buffer);
 
     // Check if setting to time mode or freq mode
     if (time_mode) {
@@ -238,12 +225,24 @@ void setTimeMode(Wavetable* table, BufferType buffer, bool time_mode) {
     }
 }
 
+/*
+Allocates a zeroed buffer of a whole table the first time it is touched
+Scripts that never edit a buffer never pay for it
+*/
+static void* allocate_buffer(Wavetable* table, size_t sample_size) {
+    void* buffer = calloc(table->num_frames * WAVETABLE_FRAME_LEN * table->num_channels, sample_size);
+    if (buffer == NULL) exit(1);
+    return buffer;
+}
+
 /* Wavetable Buffer editing */
 double* getTimeBuffer(Wavetable* table, BufferType buffer) {
     switch (buffer) {
         case BUFFER_MAIN:
+            if (table->main_time == NULL) table->main_time = (double*)allocate_buffer(table, sizeof(double));
             return table->main_time;
         case BUFFER_AUX1:
+            if (table->aux1_time == NULL) table->aux1_time = (double*)allocate_buffer(table, sizeof(double));
             return table->aux1_time;
     }
 }
@@ -252,8 +251,25 @@ double* getTimeBuffer(Wavetable* table, BufferType buffer) {
 _Complex double* getFreqBuffer(Wavetable* table, BufferType buffer) {
     switch (buffer) {
         case BUFFER_MAIN:
+            if (table->main_freq == NULL) table->main_freq = (double _Complex*)allocate_buffer(table, sizeof(double _Complex));
             return table->main_freq;
         case BUFFER_AUX1:
+            if (table->aux1_freq == NULL) table->aux1_freq = (double _Complex*)allocate_buffer(table, sizeof(double _Complex));
             return table->aux1_freq;
     }
+}
+
+/* Wavetable Buffer reading */
+// Frame is wrapped to the table, index is wrapped to the frame and linearly interpolated
+double readTimeBuffer(const double* time_buffer, double frame, double index) {
+    // Get the frame and bind it to the range [0,WAVETABLE_MAX_FRAMES)
+    const int frame_start = (((int)frame) & (WAVETABLE_MAX_FRAMES - 1)) * WAVETABLE_FRAME_LEN;
+    // Get the index and bind it to the range [0,WAVETABLE_FRAME_LEN)
+    const int index_lower = ((int)index) & (WAVETABLE_FRAME_LEN - 1);
+    const int index_higher = (index_lower + 1) & (WAVETABLE_FRAME_LEN - 1);
+
+    // Linearly interpolate result
+    const double index_ratio = index - (int)index;
+    return time_buffer[frame_start + index_lower] * (1 - index_ratio)
+         + time_buffer[frame_start + index_higher] * (index_ratio);
 }
\ No newline at end of file
@@ -15,8 +15,9 @@ typedef struct {
     int sample_size; // In bits //
     int num_channels;
     long total_samples;
-    int* randf; // Array of length WAVETABLE_MAX_FRAMES filled with random integer values
-    int* randi; // Array of length WAVETABLE_FRAME_LEN filled with random integer values
+    int* randf; // Array of length WAVETABLE_MAX_FRAMES filled with random integer values, NULL until first used
+    int* randi; // Array of length WAVETABLE_FRAME_LEN filled with random integer values, NULL until first used
+    // Buffers are NULL until getTimeBuffer or getFreqBuffer first touches them
     // Main buffer
     double* main_time;
     double _Complex* main_freq;
@@ -43,6 +44,7 @@ void normalizeByFrame(Wavetable* table, BufferType buffer, int minFrame, int max
 double* getTimeBuffer(Wavetable* table, BufferType buffer);
 double _Complex* getFreqBuffer(Wavetable* table, BufferType buffer);
 void setTimeMode(Wavetable* table, BufferType buffer, bool time_mode);
+double readTimeBuffer(const double* time_buffer, double frame, double index);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+// Every allocation is aligned for any value type
+#define ARENA_ALIGN 16
+#define ALIGN_UP(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+// Block header padded so data starts aligned
+#define BLOCK_HEADER ALIGN_UP(sizeof(ArenaBlock))
+
+static uint8_t* blockData(ArenaBlock* block) {
+    return (uint8_t*)block + BLOCK_HEADER;
+}
+
+void initArena(Arena* arena) {
+    arena->blocks = NULL;
+}
+
+void* arenaAllocate(Arena* arena, size_t size) {
+    size = ALIGN_UP(size);
+    ArenaBlock* block = arena->blocks;
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (ArenaBlock*)malloc(BLOCK_HEADER + capacity);
+        if (block == NULL) exit(1);
+        block->capacity = capacity;
+        block->used = 0;
+        block->last = 0;
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    block->last = block->used;
+    block->used += size;
+    return blockData(block) + block->last;
+}
+
+void* arenaReallocate(Arena* arena, void* pointer, size_t oldSize, size_t newSize) {
+    if (pointer == NULL) {
+        return arenaAllocate(arena, newSize);
+    }
+
+    ArenaBlock* block = arena->blocks;
+    if ((uint8_t*)pointer == blockData(block) + block->last && block->capacity - block->last >= ALIGN_UP(newSize)) {
+        block->used = block->last + ALIGN_UP(newSize);
+        return pointer;
+    }
+
+    void* result = arenaAllocate(arena, newSize);
+    memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+    return result;
+}
+
+void freeArena(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
+
+#undef ARENA_ALIGN
+#undef ALIGN_UP
+#undef BLOCK_HEADER
\ No newline at end of file
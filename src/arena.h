@@ -0,0 +1,28 @@
+#ifndef cave_arena_h
+#define cave_arena_h
+
+#include "common.h"
+
+// Bytes of a block, larger allocations get a block of their own
+#define ARENA_BLOCK_SIZE 4096
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t capacity;
+    size_t used;
+    // Start of the last allocation, the only one that can grow in place
+    size_t last;
+} ArenaBlock;
+
+// Bump allocator, everything in it is freed at once
+typedef struct {
+    ArenaBlock* blocks;
+} Arena;
+
+void initArena(Arena* arena);
+void* arenaAllocate(Arena* arena, size_t size);
+// Grows in place if pointer is the last allocation and still fits, else copies
+void* arenaReallocate(Arena* arena, void* pointer, size_t oldSize, size_t newSize);
+void freeArena(Arena* arena);
+
+#endif
\ No newline at end of file
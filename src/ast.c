@@ -0,0 +1,241 @@
+#include <math.h>
+#include <string.h>
+
+#include "ast.h"
+#include "chunk.h"
+#include "object.h"
+#include "table.h"
+#include "vm.h"
+
+Expr* newExpr(Arena* arena, ExprType type, int line) {
+    Expr* expr = (Expr*)arenaAllocate(arena, sizeof(Expr));
+    memset(expr, 0, sizeof(Expr));
+    expr->type = type;
+    expr->line = line;
+    return expr;
+}
+
+Expr* newNumberExpr(Arena* arena, double value, int literal, int line) {
+    Expr* expr = newExpr(arena, EXPR_NUMBER, line);
+    expr->isNumber = true;
+    expr->as.number.value = value;
+    expr->as.number.literal = literal;
+    return expr;
+}
+
+Expr* newLiteralExpr(Arena* arena, uint8_t literal, int line) {
+    Expr* expr = newExpr(arena, EXPR_LITERAL, line);
+    expr->as.literal = literal;
+    return expr;
+}
+
+Expr* newBinaryExpr(Arena* arena, ExprType type, uint8_t op, Expr* left, Expr* right, int line) {
+    Expr* expr = newExpr(arena, type, line);
+    expr->as.binary.op = op;
+    expr->as.binary.left = left;
+    expr->as.binary.right = right;
+    return expr;
+}
+
+/*
+    ---------------
+    CONSTANT FOLDING
+    ---------------
+*/
+
+// Value of a global if it names a native, natives are read only so it is the same when the code runs
+static bool nativeValue(VM* vm, Token* name, Value* value) {
+    ObjString* string = copyString(vm, name->start, name->length);
+    return string->isNative && tableGet(&vm->globals, string, value);
+}
+
+// The pure native a callee reads, NULL if it reads anything else
+static ObjNative* pureNative(VM* vm, Expr* callee) {
+    Value native;
+    if (callee->type != EXPR_GLOBAL || !nativeValue(vm, &callee->as.name, &native) || !IS_NATIVE(native)) return NULL;
+    return AS_NATIVE(native)->isPure ? AS_NATIVE(native) : NULL;
+}
+
+// Sets truth to how a constant tests in a condition
+// Returns false if expr is not a constant
+static bool constantTruth(Expr* expr, bool* truth) {
+    switch (expr->type) {
+        case EXPR_NUMBER: *truth = expr->as.number.value != 0; return true;
+        case EXPR_LITERAL: *truth = expr->as.literal == OP_TRUE; return true;
+        case EXPR_STRING: *truth = expr->as.name.length - 2 != 0; return true;
+        default: return false;
+    }
+}
+
+// True if dividing by value is exactly multiplying by its reciprocal
+// Holds for powers of two whose reciprocal is a normal number
+static bool exactReciprocal(double value) {
+    int exponent;
+    return fabs(frexp(value, &exponent)) == 0.5 && isnormal(1 / value);
+}
+
+static Expr* foldBinary(Arena* arena, Expr* expr) {
+    uint8_t op = expr->as.binary.op;
+    Expr* left = expr->as.binary.left;
+    Expr* right = expr->as.binary.right;
+
+    if (left->type == EXPR_NUMBER && right->type == EXPR_NUMBER) {
+        double a = left->as.number.value;
+        double b = right->as.number.value;
+        switch (op) {
+            case OP_ADD:            return newNumberExpr(arena, a + b, -1, expr->line);
+            case OP_SUBTRACT:       return newNumberExpr(arena, a - b, -1, expr->line);
+            case OP_MULTIPLY:       return newNumberExpr(arena, a * b, -1, expr->line);
+            case OP_DIVIDE:         return newNumberExpr(arena, a / b, -1, expr->line);
+            case OP_MOD:            return newNumberExpr(arena, fmod(a, b), -1, expr->line);
+            case OP_EQUAL:          return newLiteralExpr(arena, a == b ? OP_TRUE : OP_FALSE, expr->line);
+            case OP_NOT_EQUAL:      return newLiteralExpr(arena, a != b ? OP_TRUE : OP_FALSE, expr->line);
+            case OP_GREATER:        return newLiteralExpr(arena, a > b ? OP_TRUE : OP_FALSE, expr->line);
+            case OP_GREATER_EQUAL:  return newLiteralExpr(arena, a >= b ? OP_TRUE : OP_FALSE, expr->line);
+            case OP_LESS:           return newLiteralExpr(arena, a < b ? OP_TRUE : OP_FALSE, expr->line);
+            case OP_LESS_EQUAL:     return newLiteralExpr(arena, a <= b ? OP_TRUE : OP_FALSE, expr->line);
+        }
+    }
+
+    // Identities only hold for a number on the left, bools and strings would change type
+    if (left->isNumber && right->type == EXPR_NUMBER) {
+        double b = right->as.number.value;
+        // x - 0, x + -0, x * 1 and x / 1 are x, x + 0 is not when x is -0
+        bool isIdentity = (op == OP_SUBTRACT && b == 0 && !signbit(b))
+            || (op == OP_ADD && b == 0 && signbit(b))
+            || ((op == OP_MULTIPLY || op == OP_DIVIDE) && b == 1);
+        if (isIdentity) return left;
+        if (op == OP_DIVIDE && exactReciprocal(b)) {
+            expr->as.binary.op = op = OP_MULTIPLY;
+            expr->as.binary.right = newNumberExpr(arena, 1 / b, -1, right->line);
+        }
+    }
+
+    // A number with a number or bool is a number, or an error
+    // Multiplying a string by a number is a string
+    switch (op) {
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_DIVIDE:
+        case OP_MOD:
+            expr->isNumber = left->isNumber || right->isNumber;
+            break;
+        case OP_MULTIPLY:
+            expr->isNumber = left->isNumber && right->isNumber;
+            break;
+    }
+    return expr;
+}
+
+static Expr* foldCall(VM* vm, Arena* arena, Expr* expr) {
+    expr->as.call.callee = foldExpr(vm, arena, expr->as.call.callee);
+    Value args[UINT8_COUNT];
+    bool isConstant = true;
+    int count = 0;
+    for (Expr** argument = &expr->as.call.arguments; *argument != NULL; argument = &(*argument)->next) {
+        Expr* next = (*argument)->next;
+        *argument = foldExpr(vm, arena, *argument);
+        (*argument)->next = next;
+        if ((*argument)->type == EXPR_NUMBER && count < UINT8_COUNT) {
+            args[count] = NUMBER_VAL((*argument)->as.number.value);
+        } else {
+            isConstant = false;
+        }
+        count++;
+    }
+
+    ObjNative* native = pureNative(vm, expr->as.call.callee);
+    if (native == NULL) return expr;
+    // Pure natives only return numbers
+    expr->isNumber = true;
+    if (!isConstant || native->arity != expr->as.call.count) return expr;
+
+    // Pure natives only fail on arguments that are not numbers, so no error is raised here
+    NativeFnReturn result = native->function(vm, expr->as.call.count, args);
+    if (result.failed || !IS_NUMBER(result.value)) return expr;
+    return newNumberExpr(arena, AS_NUMBER(result.value), -1, expr->line);
+}
+
+Expr* foldExpr(VM* vm, Arena* arena, Expr* expr) {
+    switch (expr->type) {
+        case EXPR_GLOBAL: {
+            Value value;
+            if (nativeValue(vm, &expr->as.name, &value) && IS_NUMBER(value)) {
+                return newNumberExpr(arena, AS_NUMBER(value), -1, expr->line);
+            }
+            return expr;
+        }
+        case EXPR_INTERPOLATION:
+            for (Expr** piece = &expr->as.call.arguments; *piece != NULL; piece = &(*piece)->next) {
+                Expr* next = (*piece)->next;
+                *piece = foldExpr(vm, arena, *piece);
+                (*piece)->next = next;
+            }
+            return expr;
+        case EXPR_POINTER:
+            expr->as.unary.operand = foldExpr(vm, arena, expr->as.unary.operand);
+            return expr;
+        case EXPR_UNARY: {
+            Expr* operand = expr->as.unary.operand = foldExpr(vm, arena, expr->as.unary.operand);
+            bool truth;
+            if (expr->as.unary.op == OP_NEGATE) {
+                if (operand->type == EXPR_NUMBER) return newNumberExpr(arena, -operand->as.number.value, -1, expr->line);
+                // Negate raises an error on anything but a number
+                expr->isNumber = true;
+            } else if (expr->as.unary.op == OP_NOT && constantTruth(operand, &truth)) {
+                return newLiteralExpr(arena, truth ? OP_FALSE : OP_TRUE, expr->line);
+            }
+            return expr;
+        }
+        case EXPR_BINARY:
+            expr->as.binary.left = foldExpr(vm, arena, expr->as.binary.left);
+            expr->as.binary.right = foldExpr(vm, arena, expr->as.binary.right);
+            return foldBinary(arena, expr);
+        case EXPR_AND:
+        case EXPR_OR: {
+            Expr* left = expr->as.binary.left = foldExpr(vm, arena, expr->as.binary.left);
+            Expr* right = expr->as.binary.right = foldExpr(vm, arena, expr->as.binary.right);
+            // A constant left side decides which side is left
+            bool truth;
+            if (constantTruth(left, &truth)) return truth == (expr->type == EXPR_AND) ? right : left;
+            return expr;
+        }
+        case EXPR_CONDITIONAL: {
+            Expr* condition = expr->as.conditional.condition = foldExpr(vm, arena, expr->as.conditional.condition);
+            Expr* then = expr->as.conditional.then = foldExpr(vm, arena, expr->as.conditional.then);
+            Expr* other = expr->as.conditional.other = foldExpr(vm, arena, expr->as.conditional.other);
+            bool truth;
+            if (constantTruth(condition, &truth)) return truth ? then : other;
+            expr->isNumber = then->isNumber && other->isNumber;
+            return expr;
+        }
+        case EXPR_CALL:
+            return foldCall(vm, arena, expr);
+        case EXPR_INDEX:
+            expr->as.binary.left = foldExpr(vm, arena, expr->as.binary.left);
+            expr->as.binary.right = foldExpr(vm, arena, expr->as.binary.right);
+            return expr;
+        case EXPR_RANGE:
+            expr->as.range.object = foldExpr(vm, arena, expr->as.range.object);
+            expr->as.range.start = foldExpr(vm, arena, expr->as.range.start);
+            expr->as.range.end = foldExpr(vm, arena, expr->as.range.end);
+            if (expr->as.range.interval != NULL) {
+                expr->as.range.interval = foldExpr(vm, arena, expr->as.range.interval);
+            }
+            return expr;
+        case EXPR_ASSIGN: {
+            // The target is stored to, only the parts it is found with are folded
+            Expr* target = expr->as.assign.target;
+            if (target->type == EXPR_POINTER) {
+                target->as.unary.operand = foldExpr(vm, arena, target->as.unary.operand);
+            } else if (target->type == EXPR_INDEX) {
+                target->as.binary.left = foldExpr(vm, arena, target->as.binary.left);
+                target->as.binary.right = foldExpr(vm, arena, target->as.binary.right);
+            }
+            expr->as.assign.value = foldExpr(vm, arena, expr->as.assign.value);
+            return expr;
+        }
+        default:
+            return expr;
+    }
+}
\ No newline at end of file
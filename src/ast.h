@@ -0,0 +1,101 @@
+#ifndef cave_ast_h
+#define cave_ast_h
+
+#include "arena.h"
+#include "common.h"
+#include "scanner.h"
+#include "value.h"
+
+// Expression trees the parser builds, the compiler folds them and emits their bytecode
+// Nodes hold no heap objects, names and strings are emitted from their tokens, so collections can run while a tree is alive
+typedef enum {
+    EXPR_NUMBER, // Number constant
+    EXPR_LITERAL, // true, false or nil
+    EXPR_STRING, // String constant
+    EXPR_INTERPOLATION, // String joined from a list of pieces
+    EXPR_LOCAL, // Local variable
+    EXPR_GLOBAL, // Global variable
+    EXPR_POINTER, // Global named by the string operand, *operand
+    EXPR_UNARY, // op operand
+    EXPR_BINARY, // left op right
+    EXPR_AND, // left and right
+    EXPR_OR, // left or right
+    EXPR_CONDITIONAL, // condition ? then : other
+    EXPR_CALL, // callee(arguments)
+    EXPR_INDEX, // object[index]
+    EXPR_RANGE, // object[start:end:interval], interval may be missing
+    EXPR_ASSIGN, // target = value, or target op= value
+} ExprType;
+
+typedef struct Expr Expr;
+
+struct Expr {
+    ExprType type;
+    // Line the node's code is reported at
+    int line;
+    // Known to leave a number, whatever else it gets raises an error first
+    bool isNumber;
+    // Next argument of a call or piece of an interpolated string
+    Expr* next;
+
+    union {
+        struct {
+            double value;
+            // Index of the source literal it was parsed from, -1 if made by folding
+            int literal;
+        } number;
+        // OP_TRUE, OP_FALSE or OP_NIL
+        uint8_t literal;
+        // Token of a string, quotes included, or name of a global
+        Token name;
+        uint32_t slot;
+        struct {
+            uint8_t op;
+            Expr* operand;
+        } unary;
+        // Also the two sides of and, or and index
+        struct {
+            uint8_t op;
+            Expr* left;
+            Expr* right;
+        } binary;
+        struct {
+            Expr* condition;
+            Expr* then;
+            Expr* other;
+        } conditional;
+        // Also the pieces of an interpolation, without a callee
+        struct {
+            Expr* callee;
+            Expr* arguments;
+            int count;
+        } call;
+        struct {
+            Expr* object;
+            Expr* start;
+            Expr* end;
+            Expr* interval;
+        } range;
+        struct {
+            // Arithmetic op applied before storing, OP_RETURN for a plain assignment
+            uint8_t op;
+            // EXPR_LOCAL, EXPR_GLOBAL, EXPR_POINTER or EXPR_INDEX
+            Expr* target;
+            Expr* value;
+        } assign;
+    } as;
+};
+
+// Every field not given is zero
+Expr* newExpr(Arena* arena, ExprType type, int line);
+Expr* newNumberExpr(Arena* arena, double value, int literal, int line);
+Expr* newLiteralExpr(Arena* arena, uint8_t literal, int line);
+// For EXPR_BINARY, EXPR_AND, EXPR_OR and EXPR_INDEX
+Expr* newBinaryExpr(Arena* arena, ExprType type, uint8_t op, Expr* left, Expr* right, int line);
+
+// Evaluate constant subtrees, read native variables and calls of pure natives on constants, and drop identity operations
+// Also works out which nodes are known to leave numbers
+// Returns the folded tree, nodes that were folded away are left in the arena
+Expr* foldExpr(VM* vm, Arena* arena, Expr* expr);
+
+#endif
\ No newline at end of file
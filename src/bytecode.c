@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "bytecode.h"
+#include "memory.h"
+#include "table.h"
+#include "vm.h"
+
+/*
+    File layout, every number little endian
+
+    header:     "CAVB", u32 version, u64 source hash, u32 source length
+    strings:    u32 count, then u32 length and the characters of each
+    function:   u32 arity, u32 name (string index + 1, 0 if unnamed)
+                u32 code count and the code
+                u32 line count and the run length line pairs
+                u32 constant count and each constant, a tag byte then its value
+*/
+
+#define BYTECODE_MAGIC "CAVB"
+// Functions nest no deeper in any script, deeper files are damaged
+#define FUNCTION_DEPTH_MAX UINT8_COUNT
+
+typedef enum {
+    CONSTANT_NIL,
+    CONSTANT_BOOL,
+    CONSTANT_NUMBER, // u64 bits of the double
+    CONSTANT_STRING, // u32 string index
+    CONSTANT_FUNCTION, // Nested function
+} ConstantTag;
+
+// 64 bit FNV-1a, collisions with an edited script have to be unlikely
+static uint64_t hashSource(const char* source, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)source[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+char* bytecodePath(const char* scriptPath) {
+    size_t length = strlen(scriptPath);
+    char* path = ALLOCATE(char, length + 2);
+    memcpy(path, scriptPath, length);
+    path[length] = 'c';
+    path[length + 1] = '\0';
+    return path;
+}
+
+/*
+    ---------------
+    WRITING
+    ---------------
+*/
+
+typedef struct {
+    uint8_t* bytes;
+    int count;
+    int capacity;
+    // Index of every string written, strings are interned so they are keyed by pointer
+    Table stringIndexes;
+    ObjString** strings;
+    int stringCount;
+    int stringCapacity;
+    // A constant has no file form
+    bool failed;
+} Writer;
+
+static void writeByte(Writer* writer, uint8_t byte) {
+    if (writer->capacity < writer->count + 1) {
+        int oldCapacity = writer->capacity;
+        writer->capacity = GROW_CAPACITY(oldCapacity);
+        writer->bytes = GROW_ARRAY(uint8_t, writer->bytes, oldCapacity, writer->capacity);
+    }
+    writer->bytes[writer->count++] = byte;
+}
+
+static void writeU32(Writer* writer, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        writeByte(writer, (value >> shift) & 0xff);
+    }
+}
+
+static void writeU64(Writer* writer, uint64_t value) {
+    writeU32(writer, (uint32_t)value);
+    writeU32(writer, (uint32_t)(value >> 32));
+}
+
+// Give a string the next index if it has none
+static void addString(Writer* writer, ObjString* string) {
+    Value index;
+    if (tableGet(&writer->stringIndexes, string, &index)) return;
+
+    if (writer->stringCapacity < writer->stringCount + 1) {
+        int oldCapacity = writer->stringCapacity;
+        writer->stringCapacity = GROW_CAPACITY(oldCapacity);
+        writer->strings = GROW_ARRAY(ObjString*, writer->strings, oldCapacity, writer->stringCapacity);
+    }
+    tableSet(&writer->stringIndexes, string, NUMBER_VAL(writer->stringCount));
+    writer->strings[writer->stringCount++] = string;
+}
+
+// Index every string a function and the functions nested in it use, in the order they are found
+static void collectStrings(Writer* writer, ObjFunction* function) {
+    if (function->name != NULL) addString(writer, function->name);
+
+    ValueArray* constants = &function->chunk.constants;
+    for (int constant = 0; constant < constants->count; constant++) {
+        Value value = constants->values[constant];
+        if (IS_STRING(value)) {
+            addString(writer, AS_STRING(value));
+        } else if (IS_FUNCTION(value)) {
+            collectStrings(writer, AS_FUNCTION(value));
+        }
+    }
+}
+
+static uint32_t stringIndex(Writer* writer, ObjString* string) {
+    Value index;
+    tableGet(&writer->stringIndexes, string, &index);
+    return (uint32_t)AS_NUMBER(index);
+}
+
+static void writeFunction(Writer* writer, ObjFunction* function) {
+    Chunk* chunk = &function->chunk;
+    writeU32(writer, function->arity);
+    writeU32(writer, function->name == NULL ? 0 : stringIndex(writer, function->name) + 1);
+
+    writeU32(writer, chunk->count);
+    for (int offset = 0; offset < chunk->count; offset++) {
+        writeByte(writer, chunk->code[offset]);
+    }
+    writeU32(writer, chunk->lines.count);
+    for (int line = 0; line < chunk->lines.count; line++) {
+        writeU32(writer, (uint32_t)chunk->lines.lines[line]);
+    }
+
+    writeU32(writer, chunk->constants.count);
+    for (int constant = 0; constant < chunk->constants.count; constant++) {
+        Value value = chunk->constants.values[constant];
+        if (IS_NIL(value)) {
+            writeByte(writer, CONSTANT_NIL);
+        } else if (IS_BOOL(value)) {
+            writeByte(writer, CONSTANT_BOOL);
+            writeByte(writer, AS_BOOL(value) ? 1 : 0);
+        } else if (IS_NUMBER(value)) {
+            uint64_t bits;
+            double number = AS_NUMBER(value);
+            memcpy(&bits, &number, sizeof(bits));
+            writeByte(writer, CONSTANT_NUMBER);
+            writeU64(writer, bits);
+        } else if (IS_STRING(value)) {
+            writeByte(writer, CONSTANT_STRING);
+            writeU32(writer, stringIndex(writer, AS_STRING(value)));
+        } else if (IS_FUNCTION(value)) {
+            writeByte(writer, CONSTANT_FUNCTION);
+            writeFunction(writer, AS_FUNCTION(value));
+        } else {
+            writer->failed = true;
+        }
+    }
+}
+
+bool saveBytecode(ObjFunction* function, const char* path, const char* source) {
+    Writer writer;
+    writer.bytes = NULL;
+    writer.count = 0;
+    writer.capacity = 0;
+    initTable(&writer.stringIndexes);
+    writer.strings = NULL;
+    writer.stringCount = 0;
+    writer.stringCapacity = 0;
+    writer.failed = false;
+
+    size_t sourceLength = strlen(source);
+    for (int i = 0; i < 4; i++) {
+        writeByte(&writer, BYTECODE_MAGIC[i]);
+    }
+    writeU32(&writer, BYTECODE_VERSION);
+    writeU64(&writer, hashSource(source, sourceLength));
+    writeU32(&writer, (uint32_t)sourceLength);
+
+    collectStrings(&writer, function);
+    writeU32(&writer, writer.stringCount);
+    for (int string = 0; string < writer.stringCount; string++) {
+        ObjString* chars = writer.strings[string];
+        writeU32(&writer, chars->length);
+        for (int i = 0; i < chars->length; i++) {
+            writeByte(&writer, chars->chars[i]);
+        }
+    }
+    writeFunction(&writer, function);
+
+    // Written to a file of its own then renamed over the old one, so runs started together never read half a file
+    bool isWritten = false;
+    if (!writer.failed) {
+        size_t length = strlen(path);
+        char* tempPath = ALLOCATE(char, length + 32);
+        snprintf(tempPath, length + 32, "%s.%ld.tmp", path, (long)getpid());
+
+        FILE* file = fopen(tempPath, "wb");
+        if (file != NULL) {
+            isWritten = fwrite(writer.bytes, 1, writer.count, file) == (size_t)writer.count;
+            isWritten = fclose(file) == 0 && isWritten;
+            // Renaming onto an existing file fails on Windows
+            if (isWritten && rename(tempPath, path) != 0) {
+                remove(path);
+                isWritten = rename(tempPath, path) == 0;
+            }
+            if (!isWritten) remove(tempPath);
+        }
+        FREE_ARRAY(char, tempPath, length + 32);
+    }
+
+    FREE_ARRAY(uint8_t, writer.bytes, writer.capacity);
+    FREE_ARRAY(ObjString*, writer.strings, writer.stringCapacity);
+    freeTable(&writer.stringIndexes);
+    return isWritten;
+}
+
+/*
+    ---------------
+    READING
+    ---------------
+*/
+
+// A string of the file, interned the first time a function uses it
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+    ObjString* string;
+} StringRef;
+
+typedef struct {
+    const uint8_t* bytes;
+    size_t count;
+    size_t offset;
+    StringRef* strings;
+    uint32_t stringCount;
+    // Read past the end or found something that cannot be
+    bool failed;
+} Reader;
+
+// True if count more bytes are left, fails the reader if not
+static bool hasBytes(Reader* reader, size_t count) {
+    if (reader->failed || reader->count - reader->offset < count) {
+        reader->failed = true;
+        return false;
+    }
+    return true;
+}
+
+static uint8_t readByte(Reader* reader) {
+    if (!hasBytes(reader, 1)) return 0;
+    return reader->bytes[reader->offset++];
+}
+
+static uint32_t readU32(Reader* reader) {
+    if (!hasBytes(reader, 4)) return 0;
+    const uint8_t* bytes = reader->bytes + reader->offset;
+    reader->offset += 4;
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static uint64_t readU64(Reader* reader) {
+    uint64_t low = readU32(reader);
+    return low | (uint64_t)readU32(reader) << 32;
+}
+
+// Returns NULL if the index is out of range
+// Every string read is stored in a function on the VM stack before anything else allocates, so it is never collected
+static ObjString* readString(VM* vm, Reader* reader, uint32_t index) {
+    if (index >= reader->stringCount) {
+        reader->failed = true;
+        return NULL;
+    }
+    StringRef* ref = &reader->strings[index];
+    if (ref->string == NULL) {
+        ref->string = copyString(vm, (const char*)reader->bytes + ref->offset, ref->length);
+    }
+    return ref->string;
+}
+
+// The function stays on the VM stack while its strings and nested functions are read
+static ObjFunction* readFunction(VM* vm, Reader* reader, int depth) {
+    if (depth > FUNCTION_DEPTH_MAX) {
+        reader->failed = true;
+        return NULL;
+    }
+    ObjFunction* function = newFunction(vm);
+    push(vm, OBJ_VAL(function));
+    Chunk* chunk = &function->chunk;
+
+    function->arity = readU32(reader);
+    uint32_t name = readU32(reader);
+    if (name != 0) function->name = readString(vm, reader, name - 1);
+
+    uint32_t count = readU32(reader);
+    if (hasBytes(reader, count)) {
+        chunk->code = ALLOCATE(uint8_t, count);
+        memcpy(chunk->code, reader->bytes + reader->offset, count);
+        chunk->count = chunk->capacity = count;
+        reader->offset += count;
+    }
+    count = readU32(reader);
+    if (count % 2 == 0 && hasBytes(reader, (size_t)count * 4)) {
+        chunk->lines.lines = ALLOCATE(int, count);
+        for (uint32_t line = 0; line < count; line++) {
+            chunk->lines.lines[line] = (int)readU32(reader);
+        }
+        chunk->lines.count = chunk->lines.capacity = count;
+    } else {
+        reader->failed = true;
+    }
+
+    count = readU32(reader);
+    for (uint32_t constant = 0; constant < count && !reader->failed; constant++) {
+        Value value = NIL_VAL;
+        switch (readByte(reader)) {
+            case CONSTANT_NIL: break;
+            case CONSTANT_BOOL: value = BOOL_VAL(readByte(reader) != 0); break;
+            case CONSTANT_NUMBER: {
+                uint64_t bits = readU64(reader);
+                double number;
+                memcpy(&number, &bits, sizeof(number));
+                value = NUMBER_VAL(number);
+                break;
+            }
+            case CONSTANT_STRING: {
+                ObjString* string = readString(vm, reader, readU32(reader));
+                if (string != NULL) value = OBJ_VAL(string);
+                break;
+            }
+            case CONSTANT_FUNCTION: {
+                ObjFunction* nested = readFunction(vm, reader, depth + 1);
+                if (nested != NULL) value = OBJ_VAL(nested);
+                break;
+            }
+            default: reader->failed = true; break;
+        }
+        writeValueArray(&chunk->constants, value);
+    }
+
+    pop(vm);
+    return reader->failed ? NULL : function;
+}
+
+// Read the whole file, NULL if it cannot be read
+static uint8_t* readBytes(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long fileSize = ftell(file);
+    rewind(file);
+    uint8_t* bytes = fileSize > 0 ? (uint8_t*)malloc(fileSize) : NULL;
+    if (bytes != NULL && fread(bytes, 1, fileSize, file) != (size_t)fileSize) {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(file);
+    *size = bytes != NULL ? (size_t)fileSize : 0;
+    return bytes;
+}
+
+ObjFunction* loadBytecode(VM* vm, const char* path, const char* source) {
+    size_t size;
+    uint8_t* bytes = readBytes(path, &size);
+    if (bytes == NULL) return NULL;
+
+    Reader reader;
+    reader.bytes = bytes;
+    reader.count = size;
+    reader.offset = 0;
+    reader.strings = NULL;
+    reader.stringCount = 0;
+    reader.failed = false;
+
+    // Checked before anything else, most stale files differ in their source
+    size_t sourceLength = strlen(source);
+    bool isCurrent = hasBytes(&reader, 4) && memcmp(bytes, BYTECODE_MAGIC, 4) == 0;
+    reader.offset = 4;
+    isCurrent = isCurrent && readU32(&reader) == BYTECODE_VERSION;
+    isCurrent = isCurrent && readU64(&reader) == hashSource(source, sourceLength);
+    isCurrent = isCurrent && readU32(&reader) == (uint32_t)sourceLength;
+
+    ObjFunction* function = NULL;
+    if (isCurrent && !reader.failed) {
+        // Each string takes at least its length, a larger count is a damaged file
+        uint32_t stringCount = readU32(&reader);
+        if (hasBytes(&reader, (size_t)stringCount * 4)) {
+            reader.strings = ALLOCATE(StringRef, stringCount);
+            reader.stringCount = stringCount;
+            for (uint32_t string = 0; string < stringCount; string++) {
+                uint32_t length = readU32(&reader);
+                if (!hasBytes(&reader, length)) break;
+                reader.strings[string] = (StringRef){(uint32_t)reader.offset, length, NULL};
+                reader.offset += length;
+            }
+            function = readFunction(vm, &reader, 0);
+            // Trailing bytes mean the file is not what was written
+            if (reader.offset != reader.count) function = NULL;
+        }
+        FREE_ARRAY(StringRef, reader.strings, reader.stringCount);
+    }
+
+    free(bytes);
+    return function;
+}
+
+#undef BYTECODE_MAGIC
+#undef FUNCTION_DEPTH_MAX
\ No newline at end of file
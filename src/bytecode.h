@@ -0,0 +1,20 @@
+#ifndef cave_bytecode_h
+#define cave_bytecode_h
+
+#include "common.h"
+#include "object.h"
+
+// Changes whenever the opcodes, the code the compiler emits for them, the natives folded while compiling or the file layout change
+// Files of any other version are recompiled
+#define BYTECODE_VERSION 4
+
+// Path of the bytecode file kept next to a script, the caller frees it
+char* bytecodePath(const char* scriptPath);
+// Write a compiled script with the hash of its source, replacing the file in one step
+// Returns false if the file could not be written, the script still runs
+bool saveBytecode(ObjFunction* function, const char* path, const char* source);
+// Read a compiled script back, strings are interned
+// Returns NULL if the file is missing, of another version, for another source or damaged
+ObjFunction* loadBytecode(VM* vm, const char* path, const char* source);
+
+#endif
\ No newline at end of file
@@ -8,13 +8,21 @@ void initChunk(Chunk* chunk) {
     chunk->count = 0;
     chunk->capacity = 0;
     chunk->code = NULL;
+    chunk->arena = NULL;
     initLinesArray(&chunk->lines);
     initValueArray(&chunk->constants);
 }
 
+void initArenaChunk(Chunk* chunk, Arena* arena) {
+    initChunk(chunk);
+    chunk->arena = arena;
+    chunk->lines.arena = arena;
+    chunk->constants.arena = arena;
+}
+
 /* Frees up a chunk */
 void freeChunk(Chunk* chunk) {
-    FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+    FREE_ARRAY_IN(chunk->arena, uint8_t, chunk->code, chunk->capacity);
     freeLinesArray(&chunk->lines);
     freeValueArray(&chunk->constants);
     // Zero out the fields, leaving chunk in empty state
@@ -27,7 +35,7 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line) {
     if (chunk->capacity < chunk->count + 1) {
         int oldCapacity = chunk->capacity;
         chunk->capacity = GROW_CAPACITY(oldCapacity);
-        chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
+        chunk->code = GROW_ARRAY_IN(chunk->arena, uint8_t, chunk->code, oldCapacity, chunk->capacity);
     }
 
     chunk->code[chunk->count] = byte;
@@ -38,4 +46,59 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line) {
 /* Writes constant to chunk */
 uint32_t addConstant(Chunk* chunk, Value value) {
     return writeValueArray(&chunk->constants, value);
+}
+
+/* Returns the size in bytes of an instruction and its operands */
+int instructionSize(uint8_t instruction) {
+    switch (instruction) {
+        case OP_BUILD_STRING:
+        case OP_CALL:
+        case OP_CONSTANT:
+        case OP_DEFINE_GLOBAL:
+        case OP_IMPORT:
+        case OP_GET_GLOBAL:
+        case OP_GET_LOCAL:
+        case OP_SET_GLOBAL:
+        case OP_SET_LOCAL:
+        case OP_ADD_CONSTANT:
+        case OP_SUBTRACT_CONSTANT:
+        case OP_MULTIPLY_CONSTANT:
+        case OP_DIVIDE_CONSTANT:
+        case OP_ADD_LOCAL:
+        case OP_SUBTRACT_LOCAL:
+        case OP_MULTIPLY_LOCAL:
+        case OP_DIVIDE_LOCAL:
+        case OP_ADD_GLOBAL:
+        case OP_SUBTRACT_GLOBAL:
+        case OP_MULTIPLY_GLOBAL:
+        case OP_DIVIDE_GLOBAL:
+            return 2;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_LOOP:
+        case OP_LOOP_IF_TRUE:
+        case OP_GREATER_JUMP:
+        case OP_GREATER_EQUAL_JUMP:
+        case OP_LESS_JUMP:
+        case OP_LESS_EQUAL_JUMP:
+        case OP_INCREMENT_LOCAL:
+        case OP_DECREMENT_LOCAL:
+            return 3;
+        case OP_CONSTANT_LONG:
+        case OP_DEFINE_GLOBAL_LONG:
+        case OP_GET_GLOBAL_LONG:
+        case OP_GET_LOCAL_LONG:
+        case OP_IMPORT_LONG:
+        case OP_POPN:
+        case OP_SET_GLOBAL_LONG:
+        case OP_SET_LOCAL_LONG:
+            return 4;
+        case OP_JUMP_NPOP:
+            return 6;
+        case OP_FOR_LOCAL:
+            return 8;
+        default:
+            return 1;
+    }
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 Intentional Design choices:
     ~ The long version of a opcode is always 1 after the normal version
         - OP_CONSTANT + 1 == OP_CONSTANT_LONG
+    ~ Bytecode files store these values, changing them needs a new BYTECODE_VERSION
 
 */
 typedef enum {
@@ -35,7 +36,7 @@ typedef enum {
     OP_GET_LOCAL_LONG, // Get a local 4bytes *** NOT IMPLEMENTED ***
     OP_GREATER, // Compare and return true if left is greater than right
     OP_GREATER_EQUAL, // Compare and return true if left is greater than or equal to 
-    OP_INTERPOLATE_STR, // Interpolate a string and a value
+    OP_BUILD_STRING, // Join n values on the stack into one string, 2 bytes
     OP_LESS, // Compare and return true if left is less than right
     OP_LESS_EQUAL, // // Compare and return true if left is less than or equal to right
     OP_MOD, // Mod two values
@@ -63,6 +64,35 @@ typedef enum {
     OP_INDEX, // Access an index
     OP_INDEX_RANGE, // Access an index range
     OP_INDEX_RANGE_INTERVAL, // Access an index range with a custom interval
+    OP_INDEX_POPLESS, // Access an array index, keeping the array and index on the stack
+    OP_SET_INDEX, // Set an array index
+    OP_IMPORT, // Run a module once into the globals, 2 bytes: opcode, path constant
+    OP_IMPORT_LONG, // 4 bytes: opcode, path constant part1, part2, part3
+
+    // Superinstructions, only emitted by the peephole pass
+    OP_ADD_CONSTANT, // Add a constant to the top value, 2 bytes
+    OP_SUBTRACT_CONSTANT, // Subtract a constant from the top value, 2 bytes
+    OP_MULTIPLY_CONSTANT, // Multiply the top value by a constant, 2 bytes
+    OP_DIVIDE_CONSTANT, // Divide the top value by a constant, 2 bytes
+    OP_ADD_LOCAL, // Add a local to the top value, 2 bytes
+    OP_SUBTRACT_LOCAL, // Subtract a local from the top value, 2 bytes
+    OP_MULTIPLY_LOCAL, // Multiply the top value by a local, 2 bytes
+    OP_DIVIDE_LOCAL, // Divide the top value by a local, 2 bytes
+    OP_ADD_GLOBAL, // Add a global to the top value, 2 bytes
+    OP_SUBTRACT_GLOBAL, // Subtract a global from the top value, 2 bytes
+    OP_MULTIPLY_GLOBAL, // Multiply the top value by a global, 2 bytes
+    OP_DIVIDE_GLOBAL, // Divide the top value by a global, 2 bytes
+    OP_GREATER_JUMP, // Compare, then jump leaving false on the stack or pop and fall through, 3 bytes
+    OP_GREATER_EQUAL_JUMP, // Same as OP_GREATER_JUMP with >=, 3 bytes
+    OP_LESS_JUMP, // Same as OP_GREATER_JUMP with <, 3 bytes
+    OP_LESS_EQUAL_JUMP, // Same as OP_GREATER_JUMP with <=, 3 bytes
+    OP_INCREMENT_LOCAL, // Add a number constant to a local in place: slot, constant, 3 bytes
+    OP_DECREMENT_LOCAL, // Subtract a number constant from a local in place: slot, constant, 3 bytes
+
+    // Counted for loops, emitted by the compiler when the loop shape is recognized
+    // Step a local by a constant, then jump backwards while it compares true to a constant
+    // 8 bytes: opcode, slot, step constant, limit constant, OP_ADD or OP_SUBTRACT, comparison opcode, distance part1, part2
+    OP_FOR_LOCAL,
 } OpCode;
 
 // Dynamic array
@@ -72,15 +102,21 @@ typedef struct {
     uint8_t* code;
     LinesArray lines; // Stores the source line number of every operation
     ValueArray constants;
+    // Code, lines and constants all grow in this arena instead of the heap if set
+    Arena* arena;
 } Chunk;
 
 // Init dynamic array
 void initChunk(Chunk* chunk);
+// Init a chunk that grows in arena, freed only with the arena
+void initArenaChunk(Chunk* chunk, Arena* arena);
 // Deletes a chunk
 void freeChunk(Chunk* chunk);
 // Write to chunk
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
 // Write constant to chunk
 uint32_t addConstant(Chunk* chunk, Value value);
+// Size in bytes of an instruction, including its operands
+int instructionSize(uint8_t instruction);
 
 #endif
\ No newline at end of file
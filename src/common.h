@@ -7,6 +7,23 @@
 
 //#define DEBUG_PRINT_CODE
 //#define DEBUG_TRACE_EXECUTION
+//#define DEBUG_PROFILE_OPCODES
+// Print how long initVM took against STARTUP_BUDGET_US
+//#define DEBUG_PROFILE_STARTUP
+// Collect garbage on every allocation / log every collection
+//#define DEBUG_STRESS_GC
+//#define DEBUG_LOG_GC
+// Keep wave functions in the register VM instead of compiling them to machine code
+//#define DISABLE_JIT
+// Run wave edits on one thread
+//#define DISABLE_THREADS
+
+// Object heap bytes before the first collection
+#define GC_HEAP_INITIAL (1024 * 1024)
+// Next collection runs once the heap is this many times what the last one kept
+#define GC_HEAP_GROW_FACTOR 2
+// Microseconds initVM may take, tiny scripts are dominated by it
+#define STARTUP_BUDGET_US 100
 
 #define UINT8_COUNT (UINT8_MAX + 1)
 #define UINT24_COUNT (1 << 24)
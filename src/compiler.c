@@ -1,9 +1,12 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "ast.h"
 #include "common.h"
 #include "compiler.h"
+#include "memory.h"
 #include "scanner.h"
 #include "vm.h"
 
@@ -11,14 +14,23 @@
 #include "debug.h"
 #endif
 
-#define BREAK_MAX 256
-#define CONTINUE_MAX 256
-
 typedef struct {
+    // VM that owns everything compiled
+    VM* vm;
     Token current;
     Token previous;
     bool hadError;
     bool panicMode;
+    // Line emitted code is reported at
+    int line;
+    // Expression trees and the arrays of every compiler, freed once compiling is done
+    Arena arena;
+    // Constant slot of each number literal in source order, only recorded for formula templates
+    uint32_t* literals;
+    // Literals numbered while parsing and literals emitted, folded literals are never emitted
+    int literalsParsed;
+    int literalCount;
+    int literalMax;
 } Parser;
 
 // Script or Function
@@ -31,6 +43,8 @@ typedef enum {
 typedef struct {
     Token name;
     int depth;
+    // Parameter of a formula not assigned so far, always a number
+    bool isNumber;
 } Local;
 
 // FlowControl struct
@@ -40,22 +54,39 @@ typedef struct {
     int depth;
 } FlowControl;
 
+// Jumps waiting for the end of their loop, innermost last
+typedef struct {
+    FlowControl* jumps;
+    int count;
+    int capacity;
+} FlowList;
+
+// Operands of an OP_FOR_LOCAL, a local stepped by a constant and compared to a constant
+typedef struct {
+    uint8_t slot;
+    uint8_t step;
+    uint8_t limit;
+    uint8_t arithmetic;
+    uint8_t comparison;
+} CountedLoop;
+
 // Keeps track of local variables
 // Ideally would pass it through the functions - would allow for multithreading
-typedef struct {
+typedef struct Compiler {
+    // Compiler of the function this one is nested in
+    struct Compiler* enclosing;
     // Function
     ObjFunction* function;
     FunctionType type;
 
-    // Local variable control
-    Local locals[STACK_MAX];
+    // Local variable control, grows in the parser's arena
+    Local* locals;
     int localCount;
+    int localCapacity;
     int scopeDepth;
     // Break/Continue flow control
-    FlowControl breaks[BREAK_MAX];
-    int breakCount;
-    FlowControl continues[CONTINUE_MAX];
-    int continueCount;
+    FlowList breaks;
+    FlowList continues;
 } Compiler;
 
 typedef enum {
@@ -74,7 +105,8 @@ typedef enum {
 } Precedence;
 
 // Lookup table parce precedence type
-typedef void (*ParseFn)(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign);
+// Infix rules get the tree parsed so far as left, prefix rules get NULL
+typedef Expr* (*ParseFn)(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign);
 
 // Holds functions for a token
 typedef struct {
@@ -90,29 +122,66 @@ typedef struct {
 */
 
 // Init parser
-static void initParser(Parser* parser) {
+static void initParser(Parser* parser, VM* vm) {
+    parser->vm = vm;
     parser->hadError = false;
     parser->panicMode = false;
+    parser->line = 0;
+    initArena(&parser->arena);
+    parser->literals = NULL;
+    parser->literalsParsed = 0;
+    parser->literalCount = 0;
+    parser->literalMax = 0;
+}
+
+static void initFlowList(FlowList* list) {
+    list->jumps = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+static void writeFlowList(Parser* parser, FlowList* list, FlowControl jump) {
+    if (list->capacity < list->count + 1) {
+        int oldCapacity = list->capacity;
+        list->capacity = GROW_CAPACITY(oldCapacity);
+        list->jumps = GROW_ARRAY_IN(&parser->arena, FlowControl, list->jumps, oldCapacity, list->capacity);
+    }
+    list->jumps[list->count++] = jump;
+}
+
+// Claim the next local slot
+static Local* pushLocal(Compiler* compiler, Parser* parser) {
+    if (compiler->localCapacity < compiler->localCount + 1) {
+        int oldCapacity = compiler->localCapacity;
+        compiler->localCapacity = GROW_CAPACITY(oldCapacity);
+        compiler->locals = GROW_ARRAY_IN(&parser->arena, Local, compiler->locals, oldCapacity, compiler->localCapacity);
+    }
+    return &compiler->locals[compiler->localCount++];
 }
 
 // Init a compiler
 static void initCompiler(Compiler* compiler, Parser* parser, FunctionType type) {
     // Clear fields
     compiler->function = NULL;
+    compiler->enclosing = parser->vm->compiler;
+    parser->vm->compiler = compiler;
+    compiler->locals = NULL;
     compiler->localCount = 0;
+    compiler->localCapacity = 0;
     compiler->scopeDepth = 0;
-    compiler->breakCount = 0;
-    compiler->continueCount = 0;
+    initFlowList(&compiler->breaks);
+    initFlowList(&compiler->continues);
     // Initialize function
     compiler->type = type;
-    compiler->function = newFunction();
+    compiler->function = newFunction(parser->vm);
     // Check type
     if (type != TYPE_SCRIPT) {
-        compiler->function->name = copyString(parser->previous.start, parser->previous.length);
+        compiler->function->name = copyString(parser->vm, parser->previous.start, parser->previous.length);
     }
 
-    Local* local = &compiler->locals[compiler->localCount++];
+    Local* local = pushLocal(compiler, parser);
     local->depth = 0;
+    local->isNumber = false;
     local->name.start = "";
     local->name.length = 0;
 }
@@ -149,6 +218,7 @@ static void errorAtCurrent(Parser* parser, const char* message) {
 // Parse current token, checking for error tokens
 static void advance(Parser* parser, Scanner* scanner) {
     parser->previous = parser->current;
+    parser->line = parser->previous.line;
 
     for (;;) {
         parser->current = scanToken(scanner);
@@ -205,7 +275,7 @@ static int numLocals(Compiler* compiler, int depth) {
 
 // Emit a single byte code
 static void emitByte(Parser* parser, Chunk* chunk, uint8_t byte) {
-    writeChunk(chunk, byte, parser->previous.line);
+    writeChunk(chunk, byte, parser->line);
 }
 
 static void emitBytes(Parser* parser, Chunk* chunk, uint8_t byte1, uint8_t byte2) {
@@ -267,25 +337,15 @@ static int emitControlFlow(Compiler* compiler, Parser* parser, int depth) {
 }
 // Emit a break command
 static void emitBreak(Compiler* compiler, Parser* parser, int depth) {
-    if (compiler->breakCount == BREAK_MAX) {
-        error(parser, "Too many breaks in current loop");
-        return;
-    }
     // Get location of break for patch in later
     int location = emitControlFlow(compiler, parser, depth);
-    compiler->breaks[compiler->breakCount] = (FlowControl){location, compiler->scopeDepth};
-    compiler->breakCount++;
+    writeFlowList(parser, &compiler->breaks, (FlowControl){location, compiler->scopeDepth});
 }
 // Emit a continue command
 static void emitContinue(Compiler* compiler, Parser* parser, int depth) {
-    if (compiler->continueCount == CONTINUE_MAX) {
-        error(parser, "Too many continues in current loop");
-        return;
-    }
     // Get location of continue for patch in later
     int location = emitControlFlow(compiler, parser, depth);
-    compiler->continues[compiler->continueCount] = (FlowControl){location, compiler->scopeDepth};
-    compiler->continueCount++;
+    writeFlowList(parser, &compiler->continues, (FlowControl){location, compiler->scopeDepth});
 }
 
 // Adds return byte code
@@ -306,13 +366,15 @@ static uint32_t makeConstant(Parser* parser, Chunk* chunk, Value value) {
 }
 
 // Emit a constant value
-static void emitConstant(Parser* parser, Chunk* chunk, Value value) {
+// Returns the slot it is loaded from
+static uint32_t emitConstant(Parser* parser, Chunk* chunk, Value value) {
     uint32_t pos = makeConstant(parser, chunk, value);
     if (pos > UINT8_MAX) {
         emitLong(parser, chunk, OP_CONSTANT_LONG, pos);
     } else {
         emitBytes(parser, chunk, OP_CONSTANT, pos);
     }
+    return pos;
 }
 
 // Fills in the temporary jump distance in a jump command
@@ -336,9 +398,10 @@ static void patchJump(Parser* parser, Chunk* chunk, int location) {
 static void patchBreaks(Compiler* compiler, Parser* parser) {
     // Patch all breaks at or above current depth
     int depth = compiler->scopeDepth;
-    while (compiler->breakCount > 0 && compiler->breaks[compiler->breakCount - 1].depth > depth) {
-        compiler->breakCount--;
-        patchJump(parser, &compiler->function->chunk, compiler->breaks[compiler->breakCount].location);
+    FlowList* breaks = &compiler->breaks;
+    while (breaks->count > 0 && breaks->jumps[breaks->count - 1].depth > depth) {
+        breaks->count--;
+        patchJump(parser, &compiler->function->chunk, breaks->jumps[breaks->count].location);
     }
 }
 // Fills in all temporary continue command jumps
@@ -346,17 +409,271 @@ static void patchBreaks(Compiler* compiler, Parser* parser) {
 static void patchContinues(Compiler* compiler, Parser* parser) {
     // Patch all continues
     int depth = compiler->scopeDepth;
-    while (compiler->continueCount > 0 && compiler->continues[compiler->continueCount - 1].depth > depth) {
-        compiler->continueCount--;
-        patchJump(parser, &compiler->function->chunk, compiler->continues[compiler->continueCount].location);
+    FlowList* continues = &compiler->continues;
+    while (continues->count > 0 && continues->jumps[continues->count - 1].depth > depth) {
+        continues->count--;
+        patchJump(parser, &compiler->function->chunk, continues->jumps[continues->count].location);
     }
 }
 
+/*
+    ---------------
+    PEEPHOLE PASS
+    ---------------
+*/
+
+// Returns the fused version of an operand load followed by an arithmetic op
+// Returns OP_RETURN if the pair cannot be fused
+static uint8_t fusedArithmetic(uint8_t load, uint8_t op) {
+    int column;
+    switch (op) {
+        case OP_ADD:        column = 0; break;
+        case OP_SUBTRACT:   column = 1; break;
+        case OP_MULTIPLY:   column = 2; break;
+        case OP_DIVIDE:     column = 3; break;
+        default: return OP_RETURN;
+    }
+    switch (load) {
+        case OP_CONSTANT:   return OP_ADD_CONSTANT + column;
+        case OP_GET_LOCAL:  return OP_ADD_LOCAL + column;
+        case OP_GET_GLOBAL: return OP_ADD_GLOBAL + column;
+        default: return OP_RETURN;
+    }
+}
+
+// Returns the fused compare-and-jump version of a comparison
+// Returns OP_RETURN if the comparison has none
+static uint8_t fusedCompareJump(uint8_t op) {
+    switch (op) {
+        case OP_GREATER:        return OP_GREATER_JUMP;
+        case OP_GREATER_EQUAL:  return OP_GREATER_EQUAL_JUMP;
+        case OP_LESS:           return OP_LESS_JUMP;
+        case OP_LESS_EQUAL:     return OP_LESS_EQUAL_JUMP;
+        default: return OP_RETURN;
+    }
+}
+
+// Returns the absolute target of a jump instruction, or -1 if it is not a jump
+static int jumpTarget(Chunk* chunk, int offset) {
+    uint8_t* code = &chunk->code[offset];
+    switch (code[0]) {
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_JUMP_NPOP:
+        case OP_GREATER_JUMP:
+        case OP_GREATER_EQUAL_JUMP:
+        case OP_LESS_JUMP:
+        case OP_LESS_EQUAL_JUMP:
+            return offset + instructionSize(code[0]) + (code[1] << 8 | code[2]);
+        case OP_LOOP:
+        case OP_LOOP_IF_TRUE:
+            return offset + instructionSize(code[0]) - (code[1] << 8 | code[2]);
+        case OP_FOR_LOCAL:
+            return offset + instructionSize(code[0]) - (code[6] << 8 | code[7]);
+        default:
+            return -1;
+    }
+}
+
+// True if the code at offset is 'local += constant;' or 'local -= constant;' on a number constant
+// That is get local, constant, add or subtract, set the same local and pop, with nothing jumping inside it
+static bool isIncrement(Chunk* chunk, int offset, bool* isTarget) {
+    uint8_t* code = &chunk->code[offset];
+    for (int inner = 2; inner < 8; inner++) {
+        if (isTarget[offset + inner]) return false;
+    }
+    return code[2] == OP_CONSTANT && IS_NUMBER(chunk->constants.values[code[3]])
+        && (code[4] == OP_ADD || code[4] == OP_SUBTRACT)
+        && code[5] == OP_SET_LOCAL && code[6] == code[1] && code[7] == OP_POP;
+}
+
+// Longest chain of jumps followed when threading, stops cycles of jumps
+#define THREAD_HOPS_MAX 16
+
+// True if control never falls through to the next instruction
+static bool isUnconditional(uint8_t op) {
+    return op == OP_JUMP || op == OP_LOOP || op == OP_JUMP_NPOP || op == OP_RETURN;
+}
+
+// Returns where the jump at offset ends up once it skips over the plain jumps it lands on
+// Only OP_JUMP and OP_LOOP may change direction, they are swapped for each other when re-aimed
+static int threadedTarget(Chunk* chunk, int offset) {
+    int target = jumpTarget(chunk, offset);
+    uint8_t op = chunk->code[offset];
+    int end = offset + instructionSize(op);
+    bool isFree = op == OP_JUMP || op == OP_LOOP;
+    for (int hops = 0; target >= 0 && target < chunk->count && hops < THREAD_HOPS_MAX; hops++) {
+        uint8_t next = chunk->code[target];
+        if (next != OP_JUMP && next != OP_LOOP) break;
+        int final = jumpTarget(chunk, target);
+        int dist = final - end;
+        if (final == target || dist > UINT16_MAX || dist < -UINT16_MAX) break;
+        if (!isFree && (op == OP_LOOP_IF_TRUE || op == OP_FOR_LOCAL ? dist > 0 : dist < 0)) break;
+        target = final;
+    }
+    return target;
+}
+
+/*
+    Rewrites common instruction sequences into superinstructions
+    Jumps to jumps are threaded, code nothing reaches is dropped and runs of pops are merged
+    Sequences are never fused across a jump target, and every jump is re-aimed afterwards
+*/
+static void optimizeChunk(Chunk* chunk) {
+    int count = chunk->count;
+    uint8_t* code = chunk->code;
+
+    // Thread every jump to where it finally lands
+    int* targets = ALLOCATE_IN(chunk->arena, int, count + 1);
+    for (int offset = 0; offset < count; offset += instructionSize(code[offset])) {
+        targets[offset] = threadedTarget(chunk, offset);
+    }
+
+    // Walk every path from the start, each jump is queued at most once
+    bool* isReachable = ALLOCATE_IN(chunk->arena, bool, count + 1);
+    bool* isTarget = ALLOCATE_IN(chunk->arena, bool, count + 1);
+    int* pending = ALLOCATE_IN(chunk->arena, int, count + 1);
+    memset(isReachable, 0, count + 1);
+    memset(isTarget, 0, count + 1);
+    int pendingCount = 0;
+    pending[pendingCount++] = 0;
+    while (pendingCount > 0) {
+        for (int offset = pending[--pendingCount]; offset < count && !isReachable[offset];) {
+            isReachable[offset] = true;
+            int target = targets[offset];
+            if (target >= 0 && target <= count) {
+                isTarget[target] = true;
+                if (target < count && !isReachable[target]) pending[pendingCount++] = target;
+            }
+            if (isUnconditional(code[offset])) break;
+            offset += instructionSize(code[offset]);
+        }
+    }
+
+    // Rewritten code is never longer than the original
+    uint8_t* newCode = ALLOCATE_IN(chunk->arena, uint8_t, count > 0 ? count : 1);
+    int* newOffsets = ALLOCATE_IN(chunk->arena, int, count + 1);
+    int* oldOffsets = ALLOCATE_IN(chunk->arena, int, count + 1);
+    int newCount = 0;
+
+    for (int offset = 0; offset < count;) {
+        uint8_t op = code[offset];
+        int size = instructionSize(op);
+        int next = offset + size;
+        newOffsets[offset] = newCount;
+        oldOffsets[newCount] = offset;
+
+        // Nothing jumps or falls through to it
+        if (!isReachable[offset]) {
+            offset = next;
+            continue;
+        }
+        // Local stepped by a number constant as a statement
+        if (op == OP_GET_LOCAL && offset + 7 < count && isIncrement(chunk, offset, isTarget)) {
+            newCode[newCount++] = code[offset + 4] == OP_ADD ? OP_INCREMENT_LOCAL : OP_DECREMENT_LOCAL;
+            newCode[newCount++] = code[offset + 1];
+            newCode[newCount++] = code[offset + 3];
+            for (int inner = offset + 2; inner < offset + 8; inner += instructionSize(code[inner])) {
+                newOffsets[inner] = newCount - 3;
+            }
+            offset += 8;
+            continue;
+        }
+        // Operand load followed by arithmetic
+        if (next < count && !isTarget[next] && size == 2 && fusedArithmetic(op, code[next]) != OP_RETURN) {
+            newCode[newCount++] = fusedArithmetic(op, code[next]);
+            newCode[newCount++] = code[offset + 1];
+            newOffsets[next] = newCount - 2;
+            offset = next + 1;
+            continue;
+        }
+        // Comparison followed by a conditional jump that pops on fall through
+        if (next + 3 < count && !isTarget[next] && !isTarget[next + 3] && fusedCompareJump(op) != OP_RETURN
+            && code[next] == OP_JUMP_IF_FALSE && code[next + 3] == OP_POP) {
+            // Keep the old jump instruction so its target can be resolved below
+            oldOffsets[newCount] = next;
+            newCode[newCount++] = fusedCompareJump(op);
+            newCode[newCount++] = code[next + 1];
+            newCode[newCount++] = code[next + 2];
+            newOffsets[next] = newOffsets[next + 3] = newCount - 3;
+            offset = next + 4;
+            continue;
+        }
+        // Run of pops, merged when one OP_POPN is no longer
+        if (op == OP_POP || op == OP_POPN) {
+            uint32_t popped = 0;
+            int end = offset;
+            int pops = 0;
+            while (end < count && (end == offset || !isTarget[end]) && (code[end] == OP_POP || code[end] == OP_POPN)) {
+                popped += code[end] == OP_POP ? 1 : (code[end + 1] << 16 | code[end + 2] << 8 | code[end + 3]);
+                end += instructionSize(code[end]);
+                pops++;
+            }
+            if (pops > 1 && end - offset >= instructionSize(OP_POPN) && popped < UINT24_COUNT) {
+                for (int pop = offset; pop < end; pop += instructionSize(code[pop])) newOffsets[pop] = newCount;
+                newCode[newCount++] = OP_POPN;
+                newCode[newCount++] = (popped >> 16) & 0xff;
+                newCode[newCount++] = (popped >> 8) & 0xff;
+                newCode[newCount++] = popped & 0xff;
+                offset = end;
+                continue;
+            }
+        }
+
+        memcpy(newCode + newCount, code + offset, size);
+        newCount += size;
+        offset = next;
+    }
+    newOffsets[count] = newCount;
+
+    // Re-aim jumps and rebuild line info
+    LinesArray lines;
+    initLinesArray(&lines);
+    lines.arena = chunk->arena;
+    for (int offset = 0; offset < newCount;) {
+        uint8_t op = newCode[offset];
+        int size = instructionSize(op);
+        int oldOffset = oldOffsets[offset];
+        int target = targets[oldOffset];
+        if (target >= 0) {
+            int dist = newOffsets[target] - (offset + size);
+            // A threaded plain jump may now point the other way
+            if (op == OP_JUMP || op == OP_LOOP) newCode[offset] = dist < 0 ? OP_LOOP : OP_JUMP;
+            if (dist < 0) dist = -dist;
+            // The distance is the last two bytes of a counted loop
+            int at = op == OP_FOR_LOCAL ? offset + size - 2 : offset + 1;
+            newCode[at] = (dist >> 8) & 0xff;
+            newCode[at + 1] = dist & 0xff;
+        }
+        int line = getLine(&chunk->lines, oldOffset);
+        for (int i = 0; i < size; i++) writeLinesArray(&lines, line);
+        offset += size;
+    }
+
+    // Swap in the new code
+    FREE_ARRAY_IN(chunk->arena, uint8_t, chunk->code, chunk->capacity);
+    freeLinesArray(&chunk->lines);
+    chunk->code = newCode;
+    chunk->capacity = count > 0 ? count : 1;
+    chunk->count = newCount;
+    chunk->lines = lines;
+
+    FREE_ARRAY_IN(chunk->arena, int, targets, count + 1);
+    FREE_ARRAY_IN(chunk->arena, bool, isReachable, count + 1);
+    FREE_ARRAY_IN(chunk->arena, bool, isTarget, count + 1);
+    FREE_ARRAY_IN(chunk->arena, int, pending, count + 1);
+    FREE_ARRAY_IN(chunk->arena, int, newOffsets, count + 1);
+    FREE_ARRAY_IN(chunk->arena, int, oldOffsets, count + 1);
+}
+
 // Ends compiling stage
 static ObjFunction* endCompiler(Compiler* compiler, Parser* parser) {
     emitReturn(parser, &compiler->function->chunk);
     // Get function
     ObjFunction* function = compiler->function;
+    parser->vm->compiler = compiler->enclosing;
+    if (!parser->hadError) optimizeChunk(&function->chunk);
 
     // Debug flag check
     #ifdef DEBUG_PRINT_CODE
@@ -388,217 +705,247 @@ static void endScope(Compiler* compiler, Parser* parser) {
 
 // Forwards declares
 static void expression(Compiler* compiler, Parser* parser, Scanner* scanner);
-static void stackVariable(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign);
 static void statement(Compiler* compiler, Parser* parser, Scanner* scanner, int loopDepth);
 static void declaration(Compiler* compiler, Parser* parser, Scanner* scanner, int loopDepth);
 static ParseRule* getRule(TokenType type);
-static void parsePrecedence(Compiler* compiler, Parser* parser, Scanner* scanner, Precedence precedence);
+static Expr* parsePrecedence(Compiler* compiler, Parser* parser, Scanner* scanner, Precedence precedence);
 
-/* 
+/*
     ---------------
-    OPERATION TYPES 
+    OPERATION TYPES
     ---------------
 */
 
-// Parse a ternary operator
-static void ternary(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
-    TokenType operator_left = parser->previous.type;
-    ParseRule* rule = getRule(operator_left);
-
-    // Chech type
-    switch(operator_left) {
-        case TOKEN_QUESTION_MARK: {
-            // Set up jump
-            int thenJump = emitJump(parser, &compiler->function->chunk, OP_JUMP_IF_FALSE);
-            emitByte(parser, &compiler->function->chunk, OP_POP);
-            // Parse middle branch
-            parsePrecedence(compiler, parser, scanner, (Precedence)(rule->precedence));
-
-            // Jump at end of then branch
-            int elseJump = emitJump(parser, &compiler->function->chunk, OP_JUMP);
-
-            // Patch first jump
-            patchJump(parser, &compiler->function->chunk, thenJump);
-            emitByte(parser, &compiler->function->chunk, OP_POP);
-
-            // Consume ':'
-            consume(parser, scanner, TOKEN_COLON, "Expect ':' after '?'");
-            // Parse right branch
-            parsePrecedence(compiler, parser, scanner, (Precedence)(rule->precedence));
-
-            // Patch jump over else branch
-            patchJump(parser, &compiler->function->chunk, elseJump);
-        }
+// Parses a full expression, assignments included
+static Expr* parseExpression(Compiler* compiler, Parser* parser, Scanner* scanner) {
+    return parsePrecedence(compiler, parser, scanner, PREC_ASSIGNMENT);
+}
+
+// Check if current token is an assignment operator
+static bool checkAssignment(Parser* parser) {
+    return parser->current.type >= TOKEN_EQUAL && parser->current.type <= TOKEN_PERCENT_EQUAL;
+}
+
+// Op an assignment token applies before storing, OP_RETURN for a plain '='
+static uint8_t assignmentOp(TokenType type) {
+    switch (type) {
+        case TOKEN_PLUS_EQUAL:      return OP_ADD;
+        case TOKEN_MINUS_EQUAL:     return OP_SUBTRACT;
+        case TOKEN_STAR_EQUAL:      return OP_MULTIPLY;
+        case TOKEN_SLASH_EQUAL:     return OP_DIVIDE;
+        case TOKEN_PERCENT_EQUAL:   return OP_MOD;
+        default: return OP_RETURN;
     }
 }
 
-static void or_(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
-    // Check if short circuit
-    int shortJump = emitJump(parser, &compiler->function->chunk, OP_JUMP_IF_TRUE);
-    
-    // Check right operand
-    emitByte(parser, &compiler->function->chunk, OP_POP);
-    parsePrecedence(compiler, parser, scanner, PREC_OR);
-    patchJump(parser, &compiler->function->chunk, shortJump);
+// Parses an assignment to target if one follows
+// Returns target itself if there is none
+static Expr* assignment(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* target, bool canAssign) {
+    if (!canAssign || !matchRange(parser, scanner, TOKEN_EQUAL, TOKEN_PERCENT_EQUAL)) return target;
+
+    Expr* expr = newExpr(&parser->arena, EXPR_ASSIGN, 0);
+    expr->as.assign.op = assignmentOp(parser->previous.type);
+    expr->as.assign.target = target;
+    expr->as.assign.value = parseExpression(compiler, parser, scanner);
+    expr->line = parser->previous.line;
+    return expr;
 }
 
-static void and_(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
-    int endJump = emitJump(parser, &compiler->function->chunk, OP_JUMP_IF_FALSE);
+// Parse a ternary operator
+static Expr* ternary(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
+    ParseRule* rule = getRule(parser->previous.type);
+    Expr* expr = newExpr(&parser->arena, EXPR_CONDITIONAL, 0);
+    expr->as.conditional.condition = left;
 
-    emitByte(parser, &compiler->function->chunk, OP_POP);
-    parsePrecedence(compiler, parser, scanner, PREC_AND);
+    // Parse middle branch
+    expr->as.conditional.then = parsePrecedence(compiler, parser, scanner, rule->precedence);
+    // Consume ':'
+    consume(parser, scanner, TOKEN_COLON, "Expect ':' after '?'");
+    // Parse right branch
+    expr->as.conditional.other = parsePrecedence(compiler, parser, scanner, rule->precedence);
+    expr->line = parser->previous.line;
+    return expr;
+}
+
+static Expr* or_(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
+    Expr* right = parsePrecedence(compiler, parser, scanner, PREC_OR);
+    return newBinaryExpr(&parser->arena, EXPR_OR, OP_JUMP_IF_TRUE, left, right, parser->previous.line);
+}
 
-    patchJump(parser, &compiler->function->chunk, endJump);
+static Expr* and_(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
+    Expr* right = parsePrecedence(compiler, parser, scanner, PREC_AND);
+    return newBinaryExpr(&parser->arena, EXPR_AND, OP_JUMP_IF_FALSE, left, right, parser->previous.line);
 }
 
 // Parse a binary operator
-static void binary(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
+static Expr* binary(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
     TokenType operatorType = parser->previous.type;
     ParseRule* rule = getRule(operatorType);
-    parsePrecedence(compiler, parser, scanner, (Precedence)(rule->precedence + 1));
+    Expr* right = parsePrecedence(compiler, parser, scanner, (Precedence)(rule->precedence + 1));
 
+    OpCode op;
     switch (operatorType) {
-        case TOKEN_BANG_EQUAL:      emitByte(parser, &compiler->function->chunk, OP_NOT_EQUAL); break;
-        case TOKEN_EQUAL_EQUAL:     emitByte(parser, &compiler->function->chunk, OP_EQUAL); break;
-        case TOKEN_GREATER:         emitByte(parser, &compiler->function->chunk, OP_GREATER); break;
-        case TOKEN_GREATER_EQUAL:   emitByte(parser, &compiler->function->chunk, OP_GREATER_EQUAL); break;
-        case TOKEN_LESS:            emitByte(parser, &compiler->function->chunk, OP_LESS); break;
-        case TOKEN_LESS_EQUAL:      emitByte(parser, &compiler->function->chunk, OP_LESS_EQUAL); break;
-        case TOKEN_PLUS:            emitByte(parser, &compiler->function->chunk, OP_ADD); break;
-        case TOKEN_MINUS:           emitByte(parser, &compiler->function->chunk, OP_SUBTRACT); break;
-        case TOKEN_STAR:            emitByte(parser, &compiler->function->chunk, OP_MULTIPLY); break;
-        case TOKEN_SLASH:           emitByte(parser, &compiler->function->chunk, OP_DIVIDE); break;
-        case TOKEN_PERCENT:         emitByte(parser, &compiler->function->chunk, OP_MOD); break;
-        default: return; // Unreachable
+        case TOKEN_BANG_EQUAL:      op = OP_NOT_EQUAL; break;
+        case TOKEN_EQUAL_EQUAL:     op = OP_EQUAL; break;
+        case TOKEN_GREATER:         op = OP_GREATER; break;
+        case TOKEN_GREATER_EQUAL:   op = OP_GREATER_EQUAL; break;
+        case TOKEN_LESS:            op = OP_LESS; break;
+        case TOKEN_LESS_EQUAL:      op = OP_LESS_EQUAL; break;
+        case TOKEN_PLUS:            op = OP_ADD; break;
+        case TOKEN_MINUS:           op = OP_SUBTRACT; break;
+        case TOKEN_STAR:            op = OP_MULTIPLY; break;
+        case TOKEN_SLASH:           op = OP_DIVIDE; break;
+        case TOKEN_PERCENT:         op = OP_MOD; break;
+        default: return left; // Unreachable
     }
+    return newBinaryExpr(&parser->arena, EXPR_BINARY, op, left, right, parser->previous.line);
 }
 
 // Parses a unary expression
-static void unary(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
+static Expr* unary(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
     TokenType operatorType = parser->previous.type;
 
-    // Compile the operand
-    parsePrecedence(compiler, parser, scanner, PREC_UNARY);
+    // Parse the operand
+    Expr* operand = parsePrecedence(compiler, parser, scanner, PREC_UNARY);
 
+    Expr* expr;
     switch(operatorType) {
-        case TOKEN_MINUS: emitByte(parser, &compiler->function->chunk, OP_NEGATE); break;
-        case TOKEN_BANG: emitByte(parser, &compiler->function->chunk, OP_NOT); break;
-        case TOKEN_STAR: stackVariable(compiler, parser, scanner, canAssign); break;
-        default: return; // Unreachable
+        case TOKEN_MINUS: expr = newExpr(&parser->arena, EXPR_UNARY, parser->previous.line); expr->as.unary.op = OP_NEGATE; break;
+        case TOKEN_BANG: expr = newExpr(&parser->arena, EXPR_UNARY, parser->previous.line); expr->as.unary.op = OP_NOT; break;
+        case TOKEN_STAR: {
+            // Access or assign a global named by the operand
+            expr = newExpr(&parser->arena, EXPR_POINTER, parser->previous.line);
+            expr->as.unary.operand = operand;
+            return assignment(compiler, parser, scanner, expr, canAssign);
+        }
+        default: return operand; // Unreachable
     }
+    expr->as.unary.operand = operand;
+    return expr;
 }
 
-// Parse the args of a call
-static uint8_t argumentList(Compiler* compiler, Parser* parser, Scanner* scanner) {
-    uint8_t argCount = 0;
+// Parse the args of a call into a list
+static Expr* argumentList(Compiler* compiler, Parser* parser, Scanner* scanner, int* argCount) {
+    Expr* arguments = NULL;
+    Expr** tail = &arguments;
+    *argCount = 0;
     if (!check(parser, TOKEN_RIGHT_PAREN)) {
         do {
-            expression(compiler, parser, scanner);
-            if (argCount == 255) {
+            *tail = parseExpression(compiler, parser, scanner);
+            tail = &(*tail)->next;
+            if (*argCount == 255) {
                 error(parser, "Cannot have more than 255 arguments");
             }
-            argCount++;
+            (*argCount)++;
         } while (match(parser, scanner, TOKEN_COMMA));
     }
     consume(parser, scanner, TOKEN_RIGHT_PAREN, "Expect ')' after arguments");
-    return argCount;
+    return arguments;
 }
 
 // Parses a call expression
-static void call(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
-    uint8_t argCount = argumentList(compiler, parser, scanner);
-    emitBytes(parser, &compiler->function->chunk, OP_CALL, argCount);
+static Expr* call(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
+    Expr* expr = newExpr(&parser->arena, EXPR_CALL, 0);
+    expr->as.call.callee = left;
+    expr->as.call.arguments = argumentList(compiler, parser, scanner, &expr->as.call.count);
+    expr->line = parser->previous.line;
+    return expr;
 }
 
 // Parses a indexing expression
-static void subindex(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
-    // Check if first expression was used
-    if (check(parser, TOKEN_COLON)) {
-        // Emit nil if left empty
-        emitByte(parser, &compiler->function->chunk, OP_NIL);
-    } else {
-        // Parse Expression
-        expression(compiler, parser, scanner);
+static Expr* subindex(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
+    // Empty parts of a range are nil
+    Expr* start = check(parser, TOKEN_COLON)
+        ? newLiteralExpr(&parser->arena, OP_NIL, parser->previous.line)
+        : parseExpression(compiler, parser, scanner);
+
+    // Only one argument, access or assign a single index
+    if (!match(parser, scanner, TOKEN_COLON)) {
+        consume(parser, scanner, TOKEN_RIGHT_SQUARE, "Expect ']' after arguments");
+        Expr* expr = newBinaryExpr(&parser->arena, EXPR_INDEX, OP_INDEX, left, start, parser->previous.line);
+        return assignment(compiler, parser, scanner, expr, canAssign);
     }
 
-    // Check if there is a second arg
-    if (match(parser, scanner, TOKEN_COLON)) {
-        // Check if second expression was used
-        if (check(parser, TOKEN_COLON) || check(parser, TOKEN_RIGHT_SQUARE)) {
-            // Emit nil if left empty
-            emitByte(parser, &compiler->function->chunk, OP_NIL);
-        } else {
-            // Parse Expression
-            expression(compiler, parser, scanner);
-        }
-
-        // Check if there is a third argument
-        if (match(parser, scanner, TOKEN_COLON)) {
-            // Check if third expression was used
-            if (check(parser, TOKEN_RIGHT_SQUARE)) {
-                // Emit index range op without custom interval
-                emitByte(parser, &compiler->function->chunk, OP_INDEX_RANGE);
-            } else {
-                // Parse Expression
-                expression(compiler, parser, scanner);
-                // Emit index range op with custom interval
-                emitByte(parser, &compiler->function->chunk, OP_INDEX_RANGE_INTERVAL);
-            }
-        } else {
-            // Only two arguments
-            // Emit index range op
-            emitByte(parser, &compiler->function->chunk, OP_INDEX_RANGE);
-        }
-    } else { // Only one arguments
-        // Emit get index op
-        emitByte(parser, &compiler->function->chunk, OP_INDEX);
+    Expr* expr = newExpr(&parser->arena, EXPR_RANGE, 0);
+    expr->as.range.object = left;
+    expr->as.range.start = start;
+    expr->as.range.end = check(parser, TOKEN_COLON) || check(parser, TOKEN_RIGHT_SQUARE)
+        ? newLiteralExpr(&parser->arena, OP_NIL, parser->previous.line)
+        : parseExpression(compiler, parser, scanner);
+    // Check if there is a custom interval
+    if (match(parser, scanner, TOKEN_COLON) && !check(parser, TOKEN_RIGHT_SQUARE)) {
+        expr->as.range.interval = parseExpression(compiler, parser, scanner);
     }
+    expr->line = parser->previous.line;
 
     // Consume closing ']'
     consume(parser, scanner, TOKEN_RIGHT_SQUARE, "Expect ']' after arguments");
+    return expr;
 }
 
 // Parse a grouping expression (expression)
-static void grouping(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
-    expression(compiler, parser, scanner);
+static Expr* grouping(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
+    Expr* expr = parseExpression(compiler, parser, scanner);
     consume(parser, scanner, TOKEN_RIGHT_PAREN, "Expect ')' after expression");
+    return expr;
 }
 
 // Parses a number literal
-static void number(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
+static Expr* number(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
     double value = strtod(parser->previous.start, NULL);
-    emitConstant(parser, &compiler->function->chunk, NUMBER_VAL(value));
+    // Formula templates number their literals in source order
+    int literal = -1;
+    if (parser->literals != NULL && parser->literalsParsed < parser->literalMax) {
+        literal = parser->literalsParsed++;
+    }
+    return newNumberExpr(&parser->arena, value, literal, parser->previous.line);
+}
+
+// Append one piece of an interpolated string, empty pieces are left out
+// Returns where the next piece goes
+static Expr** stringSegment(Parser* parser, Expr* expr, Expr** tail) {
+    if (parser->previous.length - 2 == 0) return tail;
+    *tail = newExpr(&parser->arena, EXPR_STRING, parser->previous.line);
+    (*tail)->as.name = parser->previous;
+    expr->as.call.count++;
+    return &(*tail)->next;
 }
 
 // Parses a string
-static void string(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
-    emitConstant(parser, &compiler->function->chunk, OBJ_VAL(copyString(parser->previous.start + 1, parser->previous.length - 2)));
-    
-    // Check for string interpolation
-    if (match(parser, scanner, TOKEN_DOLLAR_BRACE)) {
-        parsePrecedence(compiler, parser, scanner, PREC_CONDITIONAL);
+// Every piece of an interpolated string is pushed, then joined by OP_BUILD_STRING
+static Expr* string(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
+    if (!check(parser, TOKEN_DOLLAR_BRACE)) {
+        Expr* expr = newExpr(&parser->arena, EXPR_STRING, parser->previous.line);
+        expr->as.name = parser->previous;
+        return expr;
+    }
+
+    Expr* expr = newExpr(&parser->arena, EXPR_INTERPOLATION, 0);
+    Expr** tail = stringSegment(parser, expr, &expr->as.call.arguments);
+    while (match(parser, scanner, TOKEN_DOLLAR_BRACE)) {
+        *tail = parsePrecedence(compiler, parser, scanner, PREC_CONDITIONAL);
+        tail = &(*tail)->next;
+        expr->as.call.count++;
         consume(parser, scanner, TOKEN_RIGHT_BRACE, "Expect '}' after '${' string interpolation");
-        emitByte(parser, &compiler->function->chunk, OP_INTERPOLATE_STR);
-        if (match(parser, scanner, TOKEN_STRING)) {
-            string(compiler, parser, scanner, canAssign);
-            emitByte(parser, &compiler->function->chunk, OP_INTERPOLATE_STR);
-        }
+        if (!match(parser, scanner, TOKEN_STRING)) break;
+        tail = stringSegment(parser, expr, tail);
     }
+    expr->line = parser->previous.line;
+    return expr;
 }
 
 // Parses a literal value
-static void literal(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
+static Expr* literal(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
     switch(parser->previous.type) {
-        case TOKEN_FALSE: emitByte(parser, &compiler->function->chunk, OP_FALSE); break;
-        case TOKEN_NIL: emitByte(parser, &compiler->function->chunk, OP_NIL); break;
-        case TOKEN_TRUE: emitByte(parser, &compiler->function->chunk, OP_TRUE); break;
-        default: return; // Unreachable
+        case TOKEN_FALSE: return newLiteralExpr(&parser->arena, OP_FALSE, parser->previous.line);
+        case TOKEN_TRUE: return newLiteralExpr(&parser->arena, OP_TRUE, parser->previous.line);
+        default: return newLiteralExpr(&parser->arena, OP_NIL, parser->previous.line);
     }
 }
 
 // Make a new constant that stores the identifiers name
 static uint32_t identifierConstant(Parser* parser, Chunk* chunk, Token* name) {
-    return makeConstant(parser, chunk, OBJ_VAL(copyString(name->start, name->length)));
+    return makeConstant(parser, chunk, OBJ_VAL(copyString(parser->vm, name->start, name->length)));
 }
 
 // Check if two variable identifiers are the same
@@ -629,9 +976,10 @@ static void addLocal(Compiler* compiler, Parser* parser, Token name) {
         return;
     }
 
-    Local* local = &compiler->locals[compiler->localCount++];
+    Local* local = pushLocal(compiler, parser);
     local->name = name;
     local->depth = -1;
+    local->isNumber = false;
 }
 
 // Make a local variable
@@ -654,99 +1002,36 @@ static void declareVariable(Compiler* compiler, Parser* parser) {
     addLocal(compiler, parser, *name);
 }
 
-// Assignment helper
-static void assignVarWithOpLong(Compiler* compiler, Parser* parser, Scanner* scanner, OpCode getOp, OpCode setOp, OpCode op, uint32_t arg) {
-    emitLong(parser, &compiler->function->chunk, getOp + 1, arg);
-    expression(compiler, parser, scanner);
-    emitByte(parser, &compiler->function->chunk, op);
-    emitLong(parser, &compiler->function->chunk, setOp + 1, arg);
-}
-// Assignment helper
-static void assignVarWithOp(Compiler* compiler, Parser* parser, Scanner* scanner, OpCode getOp, OpCode setOp, OpCode op, uint32_t arg) {
-    emitBytes(parser, &compiler->function->chunk, getOp, (uint8_t)arg);
-    expression(compiler, parser, scanner);
-    emitByte(parser, &compiler->function->chunk, op);
-    emitBytes(parser, &compiler->function->chunk, setOp, (uint8_t)arg);
-}
-
 // Access or assign a variable
-static void namedVariable(Compiler* compiler, Parser* parser, Scanner* scanner, Token name, bool canAssign) {
-    // Select correct get and set operators for global vs local
-    uint8_t getOp, setOp;
+static Expr* variable(Compiler* compiler, Parser* parser, Scanner* scanner, Expr* left, bool canAssign) {
+    Token name = parser->previous;
+    Expr* expr;
     uint32_t arg = resolveLocal(compiler, parser, &name);
     if (arg != -1) {
-        getOp = OP_GET_LOCAL;
-        setOp = OP_SET_LOCAL;
-    } else {
-        arg = identifierConstant(parser, &compiler->function->chunk, &name);
-        getOp = OP_GET_GLOBAL;
-        setOp = OP_SET_GLOBAL;
-    }
-
-    // Check argument size and use appropriate byteop
-    if (arg < UINT8_MAX) { // ********************* COULD LOOK INTO USING MATCHRANGE FOR POTENTIAL OPTIMIZATION *************************
-        if (canAssign) { // Byte Case
-            if (match(parser, scanner, TOKEN_EQUAL)) {
-                expression(compiler, parser, scanner);
-                emitBytes(parser, &compiler->function->chunk, setOp, (uint8_t)arg);
-            } else if (match(parser, scanner, TOKEN_PLUS_EQUAL)) assignVarWithOp(compiler, parser, scanner, getOp, setOp, OP_ADD, arg);
-            else if (match(parser, scanner, TOKEN_MINUS_EQUAL)) assignVarWithOp(compiler, parser, scanner, getOp, setOp, OP_SUBTRACT, arg);
-            else if (match(parser, scanner, TOKEN_STAR_EQUAL)) assignVarWithOp(compiler, parser, scanner, getOp, setOp, OP_MULTIPLY, arg);
-            else if (match(parser, scanner, TOKEN_SLASH_EQUAL)) assignVarWithOp(compiler, parser, scanner, getOp, setOp, OP_DIVIDE, arg);
-            else if (match(parser, scanner, TOKEN_PERCENT_EQUAL)) assignVarWithOp(compiler, parser, scanner, getOp, setOp, OP_MOD, arg);
-            else emitBytes(parser, &compiler->function->chunk, getOp, (uint8_t)arg);
-        } else {
-            emitBytes(parser, &compiler->function->chunk, getOp, (uint8_t)arg);
-        }
-    } else { // Long Case
-        if (canAssign) {
-            if (match(parser, scanner, TOKEN_EQUAL)) { 
-                expression(compiler, parser, scanner);
-                emitLong(parser, &compiler->function->chunk, setOp + 1, arg);
-            } else if (match(parser, scanner, TOKEN_PLUS_EQUAL)) assignVarWithOpLong(compiler, parser, scanner, getOp, setOp, OP_ADD, arg);
-            else if (match(parser, scanner, TOKEN_MINUS_EQUAL)) assignVarWithOpLong(compiler, parser, scanner, getOp, setOp, OP_SUBTRACT, arg);
-            else if (match(parser, scanner, TOKEN_STAR_EQUAL)) assignVarWithOpLong(compiler, parser, scanner, getOp, setOp, OP_MULTIPLY, arg);
-            else if (match(parser, scanner, TOKEN_SLASH_EQUAL)) assignVarWithOpLong(compiler, parser, scanner, getOp, setOp, OP_DIVIDE, arg);
-            else if (match(parser, scanner, TOKEN_PERCENT_EQUAL)) assignVarWithOpLong(compiler, parser, scanner, getOp, setOp, OP_MOD, arg);
-            else emitLong(parser, &compiler->function->chunk, getOp + 1, arg);
-        } else {
-            emitLong(parser, &compiler->function->chunk, getOp + 1, arg);
+        expr = newExpr(&parser->arena, EXPR_LOCAL, name.line);
+        expr->as.slot = arg;
+        // Formula parameters stop being known numbers once assigned, expressions run in the order they are parsed
+        Local* local = &compiler->locals[arg];
+        if (canAssign && checkAssignment(parser)) {
+            local->isNumber = false;
         }
-    }
-}
-
-// Parses a variable call
-static void variable(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
-    namedVariable(compiler, parser, scanner, parser->previous, canAssign);
-}
-
-// Assignment helper
-static void assignVarWithOpStack(Compiler* compiler, Parser* parser, Scanner* scanner, OpCode op) {
-    emitByte(parser, &compiler->function->chunk, OP_GET_GLOBAL_STACK_POPLESS);
-    expression(compiler, parser, scanner);
-    emitByte(parser, &compiler->function->chunk, op);
-    emitByte(parser, &compiler->function->chunk, OP_SET_GLOBAL_STACK);
-}
-// Access or assign a variable with a value on the stack
-static void stackVariable(Compiler* compiler, Parser* parser, Scanner* scanner, bool canAssign) {
-    if (canAssign) {
-        if (match(parser, scanner, TOKEN_EQUAL)) {
-            expression(compiler, parser, scanner);
-            emitByte(parser, &compiler->function->chunk, OP_SET_GLOBAL_STACK);
-        } else if (match(parser, scanner, TOKEN_PLUS_EQUAL)) assignVarWithOpStack(compiler, parser, scanner, OP_ADD);
-        else if (match(parser, scanner, TOKEN_MINUS_EQUAL)) assignVarWithOpStack(compiler, parser, scanner, OP_SUBTRACT);
-        else if (match(parser, scanner, TOKEN_STAR_EQUAL)) assignVarWithOpStack(compiler, parser, scanner, OP_MULTIPLY);
-        else if (match(parser, scanner, TOKEN_SLASH_EQUAL)) assignVarWithOpStack(compiler, parser, scanner, OP_DIVIDE);
-        else if (match(parser, scanner, TOKEN_PERCENT_EQUAL)) assignVarWithOpStack(compiler, parser, scanner, OP_MOD);
-        else emitByte(parser, &compiler->function->chunk, OP_GET_GLOBAL_STACK);
+        expr->isNumber = local->isNumber;
     } else {
-        emitByte(parser, &compiler->function->chunk, OP_GET_GLOBAL_STACK);
+        expr = newExpr(&parser->arena, EXPR_GLOBAL, name.line);
+        expr->as.name = name;
+        // Natives are read only
+        if (canAssign && checkAssignment(parser) && copyString(parser->vm, name.start, name.length)->isNative) {
+            advance(parser, scanner);
+            error(parser, "Cannot assign to a native");
+            return expr;
+        }
     }
+    return assignment(compiler, parser, scanner, expr, canAssign);
 }
 
-/* 
+/*
     ---------------
-    GRAMMAR EXECUTION 
+    GRAMMAR EXECUTION
     ---------------
 */
 
@@ -797,6 +1082,7 @@ ParseRule rules[] = {
 	[TOKEN_FOR]             = {NULL,        NULL,        PREC_NONE},
 	[TOKEN_FUN]             = {NULL,        NULL,        PREC_NONE},
 	[TOKEN_IF]              = {NULL,        NULL,        PREC_NONE},
+	[TOKEN_IMPORT]          = {NULL,        NULL,        PREC_NONE},
 	[TOKEN_NIL]             = {literal,     NULL,        PREC_NONE},
 	[TOKEN_OR]              = {NULL,        or_,         PREC_OR},
 	[TOKEN_PRINT]           = {NULL,        NULL,        PREC_NONE},
@@ -812,28 +1098,198 @@ ParseRule rules[] = {
 };
 
 // Defines operator precedence
-static void parsePrecedence(Compiler* compiler, Parser* parser, Scanner* scanner, Precedence precedence) {
+// Returns the parsed tree, a nil literal if there was no expression
+static Expr* parsePrecedence(Compiler* compiler, Parser* parser, Scanner* scanner, Precedence precedence) {
     advance(parser, scanner);
     // Prefix operators
     ParseFn prefixRule = getRule(parser->previous.type)->prefix;
     if (prefixRule == NULL) {
         error(parser, "Expected an expression");
-        return;
+        return newLiteralExpr(&parser->arena, OP_NIL, parser->previous.line);
     }
 
     bool canAssign = precedence <= PREC_ASSIGNMENT;
-    prefixRule(compiler, parser, scanner, canAssign);
+    Expr* expr = prefixRule(compiler, parser, scanner, NULL, canAssign);
 
-    // All other operators
+    // All other operators, the tree so far is their left operand
     while (precedence <= getRule(parser->current.type)->precedence) {
         advance(parser, scanner);
         ParseFn anyfixRule = getRule(parser->previous.type)->anyfix;
-        anyfixRule(compiler, parser, scanner, canAssign);
+        expr = anyfixRule(compiler, parser, scanner, expr, canAssign);
     }
 
     if (canAssign && (matchRange(parser, scanner, TOKEN_EQUAL, TOKEN_PERCENT_EQUAL))) {
         error(parser, "Invalid assignment target");
     }
+    return expr;
+}
+
+/*
+    ---------------
+    BYTECODE BACKEND
+    ---------------
+*/
+
+static void emitExpr(Compiler* compiler, Parser* parser, Expr* expr);
+
+// Emit an op with a variable's slot, the long form of op follows it
+static void emitVariableOp(Parser* parser, Chunk* chunk, uint8_t op, uint32_t arg) {
+    if (arg < UINT8_MAX) {
+        emitBytes(parser, chunk, op, (uint8_t)arg);
+    } else {
+        emitLong(parser, chunk, op + 1, arg);
+    }
+}
+
+// Emit the store of an assignment, compound assignments load the old value before the new one
+static void emitAssignment(Compiler* compiler, Parser* parser, Expr* expr) {
+    Chunk* chunk = &compiler->function->chunk;
+    Expr* target = expr->as.assign.target;
+    uint8_t op = expr->as.assign.op;
+    bool isCompound = op != OP_RETURN;
+
+    switch (target->type) {
+        case EXPR_LOCAL:
+        case EXPR_GLOBAL: {
+            bool isLocal = target->type == EXPR_LOCAL;
+            uint32_t arg = isLocal ? target->as.slot : identifierConstant(parser, chunk, &target->as.name);
+            if (isCompound) emitVariableOp(parser, chunk, isLocal ? OP_GET_LOCAL : OP_GET_GLOBAL, arg);
+            emitExpr(compiler, parser, expr->as.assign.value);
+            if (isCompound) emitByte(parser, chunk, op);
+            emitVariableOp(parser, chunk, isLocal ? OP_SET_LOCAL : OP_SET_GLOBAL, arg);
+            break;
+        }
+        case EXPR_POINTER:
+            emitExpr(compiler, parser, target->as.unary.operand);
+            if (isCompound) emitByte(parser, chunk, OP_GET_GLOBAL_STACK_POPLESS);
+            emitExpr(compiler, parser, expr->as.assign.value);
+            if (isCompound) emitByte(parser, chunk, op);
+            emitByte(parser, chunk, OP_SET_GLOBAL_STACK);
+            break;
+        case EXPR_INDEX:
+            emitExpr(compiler, parser, target->as.binary.left);
+            emitExpr(compiler, parser, target->as.binary.right);
+            if (isCompound) emitByte(parser, chunk, OP_INDEX_POPLESS);
+            emitExpr(compiler, parser, expr->as.assign.value);
+            if (isCompound) emitByte(parser, chunk, op);
+            emitByte(parser, chunk, OP_SET_INDEX);
+            break;
+        default: return; // Unreachable
+    }
+}
+
+// Emit the bytecode of a tree, each node's code is reported at its own line
+static void emitExpr(Compiler* compiler, Parser* parser, Expr* expr) {
+    Chunk* chunk = &compiler->function->chunk;
+    int line = parser->line;
+    parser->line = expr->line;
+
+    switch (expr->type) {
+        case EXPR_NUMBER: {
+            uint32_t slot = emitConstant(parser, chunk, NUMBER_VAL(expr->as.number.value));
+            // Formula templates patch new literals into the slots they are loaded from
+            if (expr->as.number.literal != -1) {
+                parser->literals[expr->as.number.literal] = slot;
+                parser->literalCount++;
+            }
+            break;
+        }
+        case EXPR_LITERAL:
+            emitByte(parser, chunk, expr->as.literal);
+            break;
+        case EXPR_STRING:
+            emitConstant(parser, chunk, OBJ_VAL(copyString(parser->vm, expr->as.name.start + 1, expr->as.name.length - 2)));
+            break;
+        case EXPR_INTERPOLATION: {
+            int pieces = 0;
+            for (Expr* piece = expr->as.call.arguments; piece != NULL; piece = piece->next) {
+                // The joined string so far is the first piece of the rest
+                if (pieces == UINT8_MAX) {
+                    emitBytes(parser, chunk, OP_BUILD_STRING, (uint8_t)pieces);
+                    pieces = 1;
+                }
+                emitExpr(compiler, parser, piece);
+                pieces++;
+            }
+            emitBytes(parser, chunk, OP_BUILD_STRING, (uint8_t)pieces);
+            break;
+        }
+        case EXPR_LOCAL:
+            emitVariableOp(parser, chunk, OP_GET_LOCAL, expr->as.slot);
+            break;
+        case EXPR_GLOBAL:
+            emitVariableOp(parser, chunk, OP_GET_GLOBAL, identifierConstant(parser, chunk, &expr->as.name));
+            break;
+        case EXPR_POINTER:
+            emitExpr(compiler, parser, expr->as.unary.operand);
+            emitByte(parser, chunk, OP_GET_GLOBAL_STACK);
+            break;
+        case EXPR_UNARY:
+            emitExpr(compiler, parser, expr->as.unary.operand);
+            emitByte(parser, chunk, expr->as.unary.op);
+            break;
+        case EXPR_BINARY:
+            emitExpr(compiler, parser, expr->as.binary.left);
+            emitExpr(compiler, parser, expr->as.binary.right);
+            emitByte(parser, chunk, expr->as.binary.op);
+            break;
+        case EXPR_AND:
+        case EXPR_OR: {
+            // Short circuit with the left value still on the stack
+            emitExpr(compiler, parser, expr->as.binary.left);
+            int endJump = emitJump(parser, chunk, expr->as.binary.op);
+            emitByte(parser, chunk, OP_POP);
+            emitExpr(compiler, parser, expr->as.binary.right);
+            patchJump(parser, chunk, endJump);
+            break;
+        }
+        case EXPR_CONDITIONAL: {
+            emitExpr(compiler, parser, expr->as.conditional.condition);
+            int thenJump = emitJump(parser, chunk, OP_JUMP_IF_FALSE);
+            emitByte(parser, chunk, OP_POP);
+            emitExpr(compiler, parser, expr->as.conditional.then);
+            // Jump over the else branch
+            int elseJump = emitJump(parser, chunk, OP_JUMP);
+            patchJump(parser, chunk, thenJump);
+            emitByte(parser, chunk, OP_POP);
+            emitExpr(compiler, parser, expr->as.conditional.other);
+            patchJump(parser, chunk, elseJump);
+            break;
+        }
+        case EXPR_CALL:
+            emitExpr(compiler, parser, expr->as.call.callee);
+            for (Expr* argument = expr->as.call.arguments; argument != NULL; argument = argument->next) {
+                emitExpr(compiler, parser, argument);
+            }
+            emitBytes(parser, chunk, OP_CALL, (uint8_t)expr->as.call.count);
+            break;
+        case EXPR_INDEX:
+            emitExpr(compiler, parser, expr->as.binary.left);
+            emitExpr(compiler, parser, expr->as.binary.right);
+            emitByte(parser, chunk, OP_INDEX);
+            break;
+        case EXPR_RANGE:
+            emitExpr(compiler, parser, expr->as.range.object);
+            emitExpr(compiler, parser, expr->as.range.start);
+            emitExpr(compiler, parser, expr->as.range.end);
+            if (expr->as.range.interval != NULL) {
+                emitExpr(compiler, parser, expr->as.range.interval);
+                emitByte(parser, chunk, OP_INDEX_RANGE_INTERVAL);
+            } else {
+                emitByte(parser, chunk, OP_INDEX_RANGE);
+            }
+            break;
+        case EXPR_ASSIGN:
+            emitAssignment(compiler, parser, expr);
+            break;
+    }
+
+    parser->line = line;
+}
+
+// Fold a parsed tree and emit it
+static void emitTree(Compiler* compiler, Parser* parser, Expr* expr) {
+    emitExpr(compiler, parser, foldExpr(parser->vm, &parser->arena, expr));
 }
 
 // Parse a variable identifier
@@ -843,7 +1299,11 @@ static uint32_t parseVariable(Compiler* compiler, Parser* parser, Scanner* scann
     declareVariable(compiler, parser);
     if (compiler->scopeDepth > 0) return 0;
 
-    return identifierConstant(parser, &compiler->function->chunk, &parser->previous);
+    uint32_t global = identifierConstant(parser, &compiler->function->chunk, &parser->previous);
+    if (AS_STRING(compiler->function->chunk.constants.values[global])->isNative) {
+        error(parser, "Cannot redefine a native");
+    }
+    return global;
 }
 
 // Initialize a local
@@ -871,9 +1331,9 @@ static ParseRule* getRule(TokenType type) {
     return &rules[type];
 }
 
-// Parses an expression
+// Parses an expression and emits it
 static void expression(Compiler* compiler, Parser* parser, Scanner* scanner) {
-    parsePrecedence(compiler, parser, scanner, PREC_ASSIGNMENT);
+    emitTree(compiler, parser, parseExpression(compiler, parser, scanner));
 }
 
 /* --- STATEMENTS --- */
@@ -933,8 +1393,8 @@ static void varDeclaration(Compiler* compiler, Parser* parser, Scanner* scanner)
     // Check if using stack "pointer"
     if (match(parser, scanner, TOKEN_STAR)) {
         // Parse expression
-        parsePrecedence(compiler, parser, scanner, PREC_CONDITIONAL);
-        
+        emitTree(compiler, parser, parsePrecedence(compiler, parser, scanner, PREC_CONDITIONAL));
+
         // Parse equal or push nil
         if (match(parser, scanner, TOKEN_EQUAL)) {
         expression(compiler, parser, scanner);
@@ -962,6 +1422,30 @@ static void varDeclaration(Compiler* compiler, Parser* parser, Scanner* scanner)
     }
 }
 
+// Import statement, runs a module's top level into the globals once
+// The VM compiles each module path once per process
+static void importStatement(Compiler* compiler, Parser* parser, Scanner* scanner) {
+    Chunk* chunk = &compiler->function->chunk;
+    if (compiler->type != TYPE_SCRIPT || compiler->scopeDepth > 0) {
+        error(parser, "Can only import at top-level");
+    }
+    consume(parser, scanner, TOKEN_STRING, "Expect module path after 'import'");
+    if (check(parser, TOKEN_DOLLAR_BRACE)) {
+        error(parser, "Module path cannot be interpolated");
+    }
+    Token path = parser->previous;
+    uint32_t constant = makeConstant(parser, chunk, OBJ_VAL(copyString(parser->vm, path.start + 1, path.length - 2)));
+    consume(parser, scanner, TOKEN_SEMICOLON, "Expect ';' after module path");
+
+    if (constant > UINT8_MAX) {
+        emitLong(parser, chunk, OP_IMPORT_LONG, constant);
+    } else {
+        emitBytes(parser, chunk, OP_IMPORT, constant);
+    }
+    // The module's top level returns nil like any script
+    emitByte(parser, chunk, OP_POP);
+}
+
 static void ifStatement(Compiler* compiler, Parser* parser, Scanner* scanner, int loopDepth) {
     consume(parser, scanner, TOKEN_LEFT_PAREN, "Expect '(' after 'if'");
     expression(compiler, parser, scanner);
@@ -1096,8 +1580,42 @@ static void doStatement(Compiler* compiler, Parser* parser, Scanner* scanner) {
     patchBreaks(compiler, parser);
 }
 
+// Fills in loop if the condition compares a local to a number constant and the increment steps the same local by a number constant
+// Returns false for any other shape of loop
+static bool countedLoop(Parser* parser, Chunk* chunk, Expr* condition, Expr* increment, CountedLoop* loop) {
+    if (condition->type != EXPR_BINARY || increment->type != EXPR_ASSIGN) return false;
+    uint8_t comparison = condition->as.binary.op;
+    Expr* counter = condition->as.binary.left;
+    Expr* limit = condition->as.binary.right;
+    if (comparison != OP_LESS && comparison != OP_LESS_EQUAL && comparison != OP_GREATER && comparison != OP_GREATER_EQUAL) return false;
+    if (counter->type != EXPR_LOCAL || counter->as.slot >= UINT8_MAX || limit->type != EXPR_NUMBER) return false;
+
+    // 'local op= step' or 'local = local op step'
+    Expr* target = increment->as.assign.target;
+    uint8_t arithmetic = increment->as.assign.op;
+    Expr* step = increment->as.assign.value;
+    if (arithmetic == OP_RETURN && step->type == EXPR_BINARY && step->as.binary.left->type == EXPR_LOCAL
+        && step->as.binary.left->as.slot == counter->as.slot) {
+        arithmetic = step->as.binary.op;
+        step = step->as.binary.right;
+    }
+    if (target->type != EXPR_LOCAL || target->as.slot != counter->as.slot) return false;
+    if ((arithmetic != OP_ADD && arithmetic != OP_SUBTRACT) || step->type != EXPR_NUMBER) return false;
+
+    uint32_t stepConstant = makeConstant(parser, chunk, NUMBER_VAL(step->as.number.value));
+    uint32_t limitConstant = makeConstant(parser, chunk, NUMBER_VAL(limit->as.number.value));
+    if (stepConstant > UINT8_MAX || limitConstant > UINT8_MAX) return false;
+    loop->slot = counter->as.slot;
+    loop->step = stepConstant;
+    loop->limit = limitConstant;
+    loop->arithmetic = arithmetic;
+    loop->comparison = comparison;
+    return true;
+}
+
 // For loop
 static void forStatement(Compiler* compiler, Parser* parser, Scanner* scanner) {
+    Chunk* chunk = &compiler->function->chunk;
     // Set up scope for the loop
     beginScope(compiler);
 
@@ -1112,32 +1630,43 @@ static void forStatement(Compiler* compiler, Parser* parser, Scanner* scanner) {
     }
 
     // Get loop start
-    int loopStart = compiler->function->chunk.count;
+    int loopStart = chunk->count;
 
     // Get condition if there is one
     int exitJump = -1;
+    Expr* condition = NULL;
     if (!match(parser, scanner, TOKEN_SEMICOLON)) {
         // Get condition
-        expression(compiler, parser, scanner);
+        condition = foldExpr(parser->vm, &parser->arena, parseExpression(compiler, parser, scanner));
+        emitExpr(compiler, parser, condition);
         consume(parser, scanner, TOKEN_SEMICOLON, "Expect ';' after loop  condition");
 
         // Jump out of the loop if the condition is false
-        exitJump = emitJump(parser, &compiler->function->chunk, OP_JUMP_IF_FALSE);
-        emitByte(parser, &compiler->function->chunk, OP_POP);
+        exitJump = emitJump(parser, chunk, OP_JUMP_IF_FALSE);
+        emitByte(parser, chunk, OP_POP);
     }
 
     // Check for increment clause
+    // A counted loop tests its condition again at the bottom, so the increment is not emitted up here
+    CountedLoop counted;
+    bool isCounted = false;
+    int incrementLine = parser->line;
     if (!match(parser, scanner, TOKEN_RIGHT_PAREN)) {
-        int bodyJump = emitJump(parser, &compiler->function->chunk, OP_JUMP);
-        int incrementStart = compiler->function->chunk.count;
-        expression(compiler, parser, scanner);
-        emitByte(parser, &compiler->function->chunk, OP_POP);
+        Expr* increment = foldExpr(parser->vm, &parser->arena, parseExpression(compiler, parser, scanner));
+        incrementLine = increment->line;
+        isCounted = condition != NULL && !parser->hadError && countedLoop(parser, chunk, condition, increment, &counted);
+        if (!isCounted) {
+            int bodyJump = emitJump(parser, chunk, OP_JUMP);
+            int incrementStart = chunk->count;
+            emitExpr(compiler, parser, increment);
+            emitByte(parser, chunk, OP_POP);
+            emitLoop(parser, chunk, OP_LOOP, loopStart);
+            loopStart = incrementStart;
+            patchJump(parser, chunk, bodyJump);
+        }
         consume(parser, scanner, TOKEN_RIGHT_PAREN, "Expect ')' after for clause");
-
-        emitLoop(parser, &compiler->function->chunk, OP_LOOP, loopStart);
-        loopStart = incrementStart;
-        patchJump(parser, &compiler->function->chunk, bodyJump);
     }
+    int bodyStart = chunk->count;
 
     // Loop body, pass it scope depth for break/continue statements
     // Use scope to seperate break statements (in the case the use types for(...) break; for some reason)
@@ -1147,13 +1676,34 @@ static void forStatement(Compiler* compiler, Parser* parser, Scanner* scanner) {
 
     // Continues point to loop back
     patchContinues(compiler, parser);
-    // Emit loop backwards
-    emitLoop(parser, &compiler->function->chunk, OP_LOOP, loopStart);
 
-    // Create exit jump if there is a condition
-    if (exitJump != -1) {
-        patchJump(parser, &compiler->function->chunk, exitJump);
-        emitByte(parser, &compiler->function->chunk, OP_POP);
+    if (isCounted) {
+        // Step and test in one instruction, reported at the increment's line
+        int line = parser->line;
+        parser->line = incrementLine;
+        emitByte(parser, chunk, OP_FOR_LOCAL);
+        emitBytes(parser, chunk, counted.slot, counted.step);
+        emitBytes(parser, chunk, counted.limit, counted.arithmetic);
+        emitByte(parser, chunk, counted.comparison);
+        int jumpDist = chunk->count + 2 - bodyStart;
+        if (jumpDist > UINT16_MAX) error(parser, "Loop body too large");
+        emitBytes(parser, chunk, (jumpDist >> 8) & 0xff, jumpDist & 0xff);
+        parser->line = line;
+
+        // Only the first test leaves its false condition on the stack
+        int endJump = emitJump(parser, chunk, OP_JUMP);
+        patchJump(parser, chunk, exitJump);
+        emitByte(parser, chunk, OP_POP);
+        patchJump(parser, chunk, endJump);
+    } else {
+        // Emit loop backwards
+        emitLoop(parser, chunk, OP_LOOP, loopStart);
+
+        // Create exit jump if there is a condition
+        if (exitJump != -1) {
+            patchJump(parser, chunk, exitJump);
+            emitByte(parser, chunk, OP_POP);
+        }
     }
     // Outside of loop, breaks point here
     patchBreaks(compiler, parser);
@@ -1176,6 +1726,7 @@ static void synchronize(Parser* parser, Scanner* scanner) {
             case TOKEN_VAR:
             case TOKEN_FOR:
             case TOKEN_IF:
+            case TOKEN_IMPORT:
             case TOKEN_SWITCH:
             case TOKEN_WHILE:
             case TOKEN_PRINT:
@@ -1220,6 +1771,8 @@ static void declaration(Compiler* compiler, Parser* parser, Scanner* scanner, in
         funDeclaration(compiler, parser, scanner);
     } else if (match(parser, scanner, TOKEN_VAR)) {
         varDeclaration(compiler, parser, scanner);
+    } else if (match(parser, scanner, TOKEN_IMPORT)) {
+        importStatement(compiler, parser, scanner);
     } else {
         statement(compiler, parser, scanner, loopDepth);
     }
@@ -1233,11 +1786,11 @@ static void declaration(Compiler* compiler, Parser* parser, Scanner* scanner, in
     ---------------
 */
 
-ObjFunction* compile(const char* source) {
+ObjFunction* compile(VM* vm, const char* source) {
     Scanner scanner;
     initScanner(&scanner, source);
     Parser parser;
-    initParser(&parser);
+    initParser(&parser, vm);
     Compiler scriptCompiler;
     initCompiler(&scriptCompiler, &parser, TYPE_SCRIPT);
     
@@ -1251,6 +1804,7 @@ ObjFunction* compile(const char* source) {
 
     consume(&parser, &scanner, TOKEN_EOF, "Expect end of file");
     ObjFunction* function = endCompiler(&scriptCompiler, &parser);
+    freeArena(&parser.arena);
     return parser.hadError ? NULL : function;
 }
 
@@ -1260,42 +1814,55 @@ ObjFunction* compile(const char* source) {
 
 */
 // Initialize a compiler with some locals already
-void initRuntimeCompiler(Compiler* compiler, Parser* parser) {
+// The chunk grows in arena if it is not NULL
+void initRuntimeCompiler(Compiler* compiler, Parser* parser, Arena* arena) {
     // Clear fields
     compiler->function = NULL;
+    compiler->enclosing = parser->vm->compiler;
+    parser->vm->compiler = compiler;
+    compiler->locals = NULL;
     compiler->localCount = 0;
+    compiler->localCapacity = 0;
     compiler->scopeDepth = 0;
-    compiler->breakCount = 0;
-    compiler->continueCount = 0;
+    initFlowList(&compiler->breaks);
+    initFlowList(&compiler->continues);
     // Initialize function
     compiler->type = TYPE_SCRIPT;
-    compiler->function = newFunction();
+    compiler->function = newFunction(parser->vm);
     compiler->function->arity = 2;
+    initArenaChunk(&compiler->function->chunk, arena);
  
     // Put self as local
-    Local* local = &compiler->locals[compiler->localCount++];
+    Local* local = pushLocal(compiler, parser);
     local->depth = 0;
+    local->isNumber = false;
     local->name.start = "";
     local->name.length = 0;
     // Put frame as local
-    local = &compiler->locals[compiler->localCount++];
+    local = pushLocal(compiler, parser);
     local->depth = 0;
+    local->isNumber = true;
     local->name.start = "frame";
     local->name.length = 5;
     // Put index as local
-    local = &compiler->locals[compiler->localCount++];
+    local = pushLocal(compiler, parser);
     local->depth = 0;
+    local->isNumber = true;
     local->name.start = "index";
     local->name.length = 5;
 }
 
-ObjFunction* runtimeCompile(const char* source) {
+// Same as runtimeCompile, recording the constant slot of up to literalMax number literals into literals
+// isTemplate is set if every literal was emitted, so each loads from its own slot
+static ObjFunction* compileTemplate(VM* vm, const char* source, Arena* arena, uint32_t* literals, int literalMax, bool* isTemplate) {
     Scanner scanner;
     initScanner(&scanner, source);
     Parser parser;
-    initParser(&parser);
+    initParser(&parser, vm);
+    parser.literals = literals;
+    parser.literalMax = literalMax;
     Compiler runtimeCompiler;
-    initRuntimeCompiler(&runtimeCompiler, &parser);
+    initRuntimeCompiler(&runtimeCompiler, &parser, arena);
 
     advance(&parser, &scanner);
 
@@ -1304,8 +1871,168 @@ ObjFunction* runtimeCompile(const char* source) {
 
     consume(&parser, &scanner, TOKEN_EOF, "Expect end of file");
     ObjFunction* function = endCompiler(&runtimeCompiler, &parser);
+    freeArena(&parser.arena);
+    if (isTemplate != NULL) {
+        *isTemplate = parser.literalCount == literalMax;
+    }
     return parser.hadError ? NULL : function;
 }
 
-#undef BREAK_MAX
-#undef CONTINUE_MAX
\ No newline at end of file
+ObjFunction* runtimeCompile(VM* vm, const char* source, Arena* arena) {
+    return compileTemplate(vm, source, arena, NULL, 0, NULL);
+}
+
+void markCompilerRoots(VM* vm) {
+    for (Compiler* compiler = vm->compiler; compiler != NULL; compiler = compiler->enclosing) {
+        markObject(vm, (Obj*)compiler->function);
+    }
+}
+
+/*
+    ---------------
+    FORMULA CACHE
+    ---------------
+*/
+
+// Source with every number literal replaced by '#', not interned since most keys are only compared once
+// Returns NULL if the source does not scan, it is compiled uncached to report the error
+static ObjString* formulaKey(VM* vm, ObjString* source, int* literalCount) {
+    char* key = ALLOCATE(char, source->length + 1);
+    int length = 0;
+    *literalCount = 0;
+
+    Scanner scanner;
+    initScanner(&scanner, source->chars);
+    const char* copied = source->chars;
+    for (;;) {
+        Token token = scanToken(&scanner);
+        if (token.type == TOKEN_ERROR) {
+            FREE_ARRAY(char, key, source->length + 1);
+            return NULL;
+        }
+        if (token.type == TOKEN_EOF) break;
+        if (token.type != TOKEN_NUMBER) continue;
+
+        // Text up to the literal is kept as is
+        memcpy(key + length, copied, token.start - copied);
+        length += (int)(token.start - copied);
+        key[length++] = '#';
+        copied = token.start + token.length;
+        (*literalCount)++;
+    }
+    const char* end = source->chars + source->length;
+    memcpy(key + length, copied, end - copied);
+    length += (int)(end - copied);
+    key[length] = '\0';
+
+    // Shrink to fit, strings are freed with their exact length
+    key = GROW_ARRAY(char, key, source->length + 1, length + 1);
+    return takeTransientString(vm, key, length);
+}
+
+// Write the number literals of source into the constant slots the template's literals were compiled to
+static void patchLiterals(CachedFormula* cached, ObjString* source) {
+    ValueArray* constants = &cached->function->chunk.constants;
+    int literal = 0;
+
+    Scanner scanner;
+    initScanner(&scanner, source->chars);
+    for (Token token = scanToken(&scanner); token.type != TOKEN_EOF; token = scanToken(&scanner)) {
+        if (token.type != TOKEN_NUMBER) continue;
+        constants->values[cached->literals[literal++]] = NUMBER_VAL(strtod(token.start, NULL));
+    }
+}
+
+static CachedFormula* useFormula(VM* vm, CachedFormula* cached) {
+    cached->inUse = true;
+    cached->lastUsed = ++vm->formulaClock;
+    return cached;
+}
+
+// Free the function's code with the entry's arena, leaving the entry empty
+static void evictFormula(CachedFormula* cached) {
+    if (cached->function != NULL) {
+        initChunk(&cached->function->chunk);
+    }
+    freeArena(&cached->arena);
+    cached->source = NULL;
+    cached->key = NULL;
+    cached->function = NULL;
+    cached->literals = NULL;
+}
+
+ObjFunction* compileFormula(VM* vm, ObjString* source) {
+    // Same formula as last time
+    for (int entry = 0; entry < FORMULA_CACHE_MAX; entry++) {
+        CachedFormula* cached = &vm->formulas[entry];
+        if (cached->function != NULL && !cached->inUse && stringsEqual(cached->source, source)) {
+            return useFormula(vm, cached)->function;
+        }
+    }
+
+    int literalCount;
+    ObjString* key = formulaKey(vm, source, &literalCount);
+    if (key == NULL) {
+        return runtimeCompile(vm, source->chars, NULL);
+    }
+
+    // Same formula with different literals
+    for (int entry = 0; entry < FORMULA_CACHE_MAX; entry++) {
+        CachedFormula* cached = &vm->formulas[entry];
+        if (cached->function != NULL && cached->isTemplate && !cached->inUse && stringsEqual(cached->key, key)) {
+            patchLiterals(cached, source);
+            cached->source = source;
+            return useFormula(vm, cached)->function;
+        }
+    }
+
+    // Replace an empty or the least recently used entry
+    CachedFormula* victim = NULL;
+    for (int entry = 0; entry < FORMULA_CACHE_MAX; entry++) {
+        CachedFormula* cached = &vm->formulas[entry];
+        if (cached->inUse) continue;
+        if (victim == NULL || cached->function == NULL || cached->lastUsed < victim->lastUsed) {
+            victim = cached;
+            if (cached->function == NULL) break;
+        }
+    }
+    // Every entry is running, stays uncached
+    if (victim == NULL) {
+        return runtimeCompile(vm, source->chars, NULL);
+    }
+    evictFormula(victim);
+
+    // Compiled into the entry's arena, key stays reachable while compiling
+    push(vm, OBJ_VAL(key));
+    uint32_t* literals = ALLOCATE_IN(&victim->arena, uint32_t, literalCount);
+    bool isTemplate;
+    ObjFunction* function = compileTemplate(vm, source->chars, &victim->arena, literals, literalCount, &isTemplate);
+    pop(vm);
+    if (function == NULL) {
+        freeArena(&victim->arena);
+        return NULL;
+    }
+
+    victim->source = source;
+    victim->key = key;
+    victim->function = function;
+    victim->literals = literals;
+    victim->isTemplate = isTemplate;
+    return useFormula(vm, victim)->function;
+}
+
+void releaseFormula(VM* vm, ObjFunction* function) {
+    for (int entry = 0; entry < FORMULA_CACHE_MAX; entry++) {
+        if (vm->formulas[entry].function == function) {
+            vm->formulas[entry].inUse = false;
+            return;
+        }
+    }
+    freeChunk(&function->chunk);
+}
+
+void freeFormulas(VM* vm) {
+    for (int entry = 0; entry < FORMULA_CACHE_MAX; entry++) {
+        evictFormula(&vm->formulas[entry]);
+    }
+}
\ No newline at end of file
@@ -3,7 +3,17 @@
 
 #include "object.h"
 
-ObjFunction* compile(const char* source);
-ObjFunction* runtimeCompile(const char* source);
+ObjFunction* compile(VM* vm, const char* source);
+// The chunk grows in arena if it is not NULL
+ObjFunction* runtimeCompile(VM* vm, const char* source, Arena* arena);
+// Mark the functions of every compiler running
+void markCompilerRoots(VM* vm);
+// runtimeCompile through the formula cache
+// Formulas differing only in number literals share one compiled function
+ObjFunction* compileFormula(VM* vm, ObjString* source);
+// Done running a function from compileFormula
+void releaseFormula(VM* vm, ObjFunction* function);
+// Free the code of every cached formula
+void freeFormulas(VM* vm);
 
 #endif
\ No newline at end of file
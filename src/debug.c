@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "debug.h"
 #include "value.h"
@@ -39,6 +40,25 @@ static int jumpNpopInstruction(const char* name, Chunk* chunk, int offset) {
     return offset + 6;
 }
 
+// Prints the local and the constant it is stepped by
+static int stepInstruction(const char* name, Chunk* chunk, int offset) {
+    printf("%-24s %4d '", name, chunk->code[offset + 1]);
+    printValue(chunk->constants.values[chunk->code[offset + 2]]);
+    printf("'\n");
+    return offset + 3;
+}
+// Prints the local, step, limit and instruction number a counted loop jumps back to
+static int forInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t* code = &chunk->code[offset];
+    uint16_t jump = code[6] << 8 | code[7];
+    printf("%-24s %4d %s ", name, code[1], code[4] == OP_ADD ? "+=" : "-=");
+    printValue(chunk->constants.values[code[2]]);
+    printf(" while %s ", code[5] == OP_LESS ? "<" : code[5] == OP_LESS_EQUAL ? "<=" : code[5] == OP_GREATER ? ">" : ">=");
+    printValue(chunk->constants.values[code[3]]);
+    printf(" -> %d\n", offset + 8 - jump);
+    return offset + 8;
+}
+
 // Get a constant from current chunks constant list
 static int constantInstruction(const char* name, Chunk* chunk, int offset) {
     uint8_t constant = chunk->code[offset + 1];
@@ -81,6 +101,10 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return simpleInstruction("OP_INDEX_RANGE", offset);
         case OP_INDEX_RANGE_INTERVAL:
             return simpleInstruction("OP_INDEX_RANGE_INTERVAL", offset);
+        case OP_INDEX_POPLESS:
+            return simpleInstruction("OP_INDEX_POPLESS", offset);
+        case OP_SET_INDEX:
+            return simpleInstruction("OP_SET_INDEX", offset);
         case OP_CONSTANT:
             return constantInstruction("OP_CONSTANT", chunk, offset);
         case OP_CONSTANT_LONG:
@@ -113,8 +137,8 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return simpleInstruction("OP_DIVIDE", offset);
         case OP_MOD:
             return simpleInstruction("OP_MOD", offset);
-        case OP_INTERPOLATE_STR:
-            return simpleInstruction("OP_INTERPOLATE_STR", offset);
+        case OP_BUILD_STRING:
+            return byteInstruction("OP_BUILD_STRING", chunk, offset);
         case OP_NEGATE:
             return simpleInstruction("OP_NEGATE", offset);
         case OP_NOT:
@@ -153,6 +177,10 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return longInstruction("OP_SET_LOCAL_LONG", chunk, offset); // Not used
         case OP_PRINT:
             return simpleInstruction("OP_PRINT", offset);
+        case OP_IMPORT:
+            return constantInstruction("OP_IMPORT", chunk, offset);
+        case OP_IMPORT_LONG:
+            return longConstantInstruction("OP_IMPORT_LONG", chunk, offset);
         case OP_JUMP:
             return jumpInstruction("OP_JUMP", 1, chunk, offset);
         case OP_JUMP_IF_FALSE:
@@ -167,9 +195,220 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return jumpInstruction("OP_LOOP_IF_TRUE", -1, chunk, offset);
         case OP_RETURN:
             return simpleInstruction("OP_RETURN", offset);
+        case OP_ADD_CONSTANT:
+            return constantInstruction("OP_ADD_CONSTANT", chunk, offset);
+        case OP_SUBTRACT_CONSTANT:
+            return constantInstruction("OP_SUBTRACT_CONSTANT", chunk, offset);
+        case OP_MULTIPLY_CONSTANT:
+            return constantInstruction("OP_MULTIPLY_CONSTANT", chunk, offset);
+        case OP_DIVIDE_CONSTANT:
+            return constantInstruction("OP_DIVIDE_CONSTANT", chunk, offset);
+        case OP_ADD_LOCAL:
+            return byteInstruction("OP_ADD_LOCAL", chunk, offset);
+        case OP_SUBTRACT_LOCAL:
+            return byteInstruction("OP_SUBTRACT_LOCAL", chunk, offset);
+        case OP_MULTIPLY_LOCAL:
+            return byteInstruction("OP_MULTIPLY_LOCAL", chunk, offset);
+        case OP_DIVIDE_LOCAL:
+            return byteInstruction("OP_DIVIDE_LOCAL", chunk, offset);
+        case OP_ADD_GLOBAL:
+            return constantInstruction("OP_ADD_GLOBAL", chunk, offset);
+        case OP_SUBTRACT_GLOBAL:
+            return constantInstruction("OP_SUBTRACT_GLOBAL", chunk, offset);
+        case OP_MULTIPLY_GLOBAL:
+            return constantInstruction("OP_MULTIPLY_GLOBAL", chunk, offset);
+        case OP_DIVIDE_GLOBAL:
+            return constantInstruction("OP_DIVIDE_GLOBAL", chunk, offset);
+        case OP_GREATER_JUMP:
+            return jumpInstruction("OP_GREATER_JUMP", 1, chunk, offset);
+        case OP_GREATER_EQUAL_JUMP:
+            return jumpInstruction("OP_GREATER_EQUAL_JUMP", 1, chunk, offset);
+        case OP_LESS_JUMP:
+            return jumpInstruction("OP_LESS_JUMP", 1, chunk, offset);
+        case OP_LESS_EQUAL_JUMP:
+            return jumpInstruction("OP_LESS_EQUAL_JUMP", 1, chunk, offset);
+        case OP_INCREMENT_LOCAL:
+            return stepInstruction("OP_INCREMENT_LOCAL", chunk, offset);
+        case OP_DECREMENT_LOCAL:
+            return stepInstruction("OP_DECREMENT_LOCAL", chunk, offset);
+        case OP_FOR_LOCAL:
+            return forInstruction("OP_FOR_LOCAL", chunk, offset);
         default:
             printf("Unknown opcode %d\n", instruction);
             return offset + 1;
     }
 }
 
+
+/*
+    Register code
+*/
+
+static const char* regOpNames[] = {
+    [REG_ADD] = "REG_ADD",
+    [REG_SUBTRACT] = "REG_SUBTRACT",
+    [REG_MULTIPLY] = "REG_MULTIPLY",
+    [REG_DIVIDE] = "REG_DIVIDE",
+    [REG_MOD] = "REG_MOD",
+    [REG_NEGATE] = "REG_NEGATE",
+    [REG_NOT] = "REG_NOT",
+    [REG_EQUAL] = "REG_EQUAL",
+    [REG_NOT_EQUAL] = "REG_NOT_EQUAL",
+    [REG_GREATER] = "REG_GREATER",
+    [REG_GREATER_EQUAL] = "REG_GREATER_EQUAL",
+    [REG_LESS] = "REG_LESS",
+    [REG_LESS_EQUAL] = "REG_LESS_EQUAL",
+    [REG_SELECT] = "REG_SELECT",
+    [REG_SIN] = "REG_SIN",
+    [REG_COS] = "REG_COS",
+    [REG_TAN] = "REG_TAN",
+    [REG_ASIN] = "REG_ASIN",
+    [REG_ACOS] = "REG_ACOS",
+    [REG_ATAN] = "REG_ATAN",
+    [REG_SQRT] = "REG_SQRT",
+    [REG_FLOOR] = "REG_FLOOR",
+    [REG_CEIL] = "REG_CEIL",
+    [REG_ROUND] = "REG_ROUND",
+    [REG_SAW] = "REG_SAW",
+    [REG_POW] = "REG_POW",
+    [REG_ATAN2] = "REG_ATAN2",
+    [REG_MAIN_T] = "REG_MAIN_T",
+    [REG_AUX1_T] = "REG_AUX1_T",
+};
+
+// Prints every instruction as 'dst <- a b c', then the registers holding constants
+void disassembleRegisters(RegFunction* function, const char* name) {
+    printf("== %s ==\n", name);
+
+    bool isConstant[REGISTERS_MAX];
+    for (int reg = 0; reg < function->registerCount; reg++) {
+        isConstant[reg] = reg > REG_INDEX;
+    }
+    for (int offset = 0; offset < function->count; offset++) {
+        if (offset == 0 && function->indexStart > 0) printf("-- frame --\n");
+        if (offset == function->indexStart && function->sampleStart > function->indexStart) printf("-- index --\n");
+        if (offset == function->sampleStart) printf("-- sample --\n");
+        RegInstruction* instruction = &function->code[offset];
+        isConstant[instruction->dst] = false;
+        printf("%04d %-24s r%-3d <- r%d r%d r%d\n", offset, regOpNames[instruction->op],
+            instruction->dst, instruction->a, instruction->b, instruction->c);
+    }
+    for (int reg = 0; reg < function->registerCount; reg++) {
+        if (isConstant[reg]) {
+            printf("     r%-3d = %g\n", reg, function->registers[reg]);
+        }
+    }
+    printf("     result r%d\n", function->result);
+}
+
+/*
+    Opcode n-gram profiling
+    Counts every executed pair and triple of opcodes, used to pick superinstructions
+*/
+
+#define PROFILE_TABLE_SIZE 65536
+#define PROFILE_TOP 20
+
+// Counts for an opcode sequence packed into 'key'
+typedef struct {
+    uint32_t key;
+    uint64_t count;
+} NgramCount;
+
+static uint64_t bigrams[UINT8_COUNT * UINT8_COUNT];
+static NgramCount trigrams[PROFILE_TABLE_SIZE];
+static int history[2] = {-1, -1};
+
+static const char* opNames[UINT8_COUNT] = {
+    [OP_ADD] = "ADD", [OP_CALL] = "CALL", [OP_EXTRACT] = "EXTRACT", [OP_CONDITIONAL] = "CONDITIONAL",
+    [OP_CONSTANT] = "CONSTANT", [OP_CONSTANT_LONG] = "CONSTANT_LONG",
+    [OP_DEFINE_GLOBAL] = "DEFINE_GLOBAL", [OP_DEFINE_GLOBAL_LONG] = "DEFINE_GLOBAL_LONG",
+    [OP_DEFINE_GLOBAL_STACK] = "DEFINE_GLOBAL_STACK", [OP_DIVIDE] = "DIVIDE", [OP_EQUAL] = "EQUAL",
+    [OP_NOT_EQUAL] = "NOT_EQUAL", [OP_FALSE] = "FALSE", [OP_GET_GLOBAL] = "GET_GLOBAL",
+    [OP_GET_GLOBAL_LONG] = "GET_GLOBAL_LONG", [OP_GET_GLOBAL_STACK] = "GET_GLOBAL_STACK",
+    [OP_GET_GLOBAL_STACK_POPLESS] = "GET_GLOBAL_STACK_POPLESS", [OP_GET_LOCAL] = "GET_LOCAL",
+    [OP_GET_LOCAL_LONG] = "GET_LOCAL_LONG", [OP_GREATER] = "GREATER", [OP_GREATER_EQUAL] = "GREATER_EQUAL",
+    [OP_BUILD_STRING] = "BUILD_STRING", [OP_LESS] = "LESS", [OP_LESS_EQUAL] = "LESS_EQUAL",
+    [OP_MOD] = "MOD", [OP_MULTIPLY] = "MULTIPLY", [OP_NOT] = "NOT", [OP_NEGATE] = "NEGATE", [OP_NIL] = "NIL",
+    [OP_POP] = "POP", [OP_POPN] = "POPN", [OP_PRINT] = "PRINT", [OP_JUMP] = "JUMP",
+    [OP_JUMP_IF_FALSE] = "JUMP_IF_FALSE", [OP_JUMP_IF_TRUE] = "JUMP_IF_TRUE", [OP_JUMP_NPOP] = "JUMP_NPOP",
+    [OP_LOOP] = "LOOP", [OP_LOOP_IF_TRUE] = "LOOP_IF_TRUE", [OP_RETURN] = "RETURN",
+    [OP_SET_GLOBAL] = "SET_GLOBAL", [OP_SET_GLOBAL_LONG] = "SET_GLOBAL_LONG",
+    [OP_SET_GLOBAL_STACK] = "SET_GLOBAL_STACK", [OP_SET_LOCAL] = "SET_LOCAL",
+    [OP_SET_LOCAL_LONG] = "SET_LOCAL_LONG", [OP_SUBTRACT] = "SUBTRACT", [OP_TRUE] = "TRUE",
+    [OP_INDEX] = "INDEX", [OP_INDEX_RANGE] = "INDEX_RANGE", [OP_INDEX_RANGE_INTERVAL] = "INDEX_RANGE_INTERVAL",
+    [OP_INDEX_POPLESS] = "INDEX_POPLESS", [OP_SET_INDEX] = "SET_INDEX",
+    [OP_IMPORT] = "IMPORT", [OP_IMPORT_LONG] = "IMPORT_LONG",
+    [OP_ADD_CONSTANT] = "ADD_CONSTANT", [OP_SUBTRACT_CONSTANT] = "SUBTRACT_CONSTANT",
+    [OP_MULTIPLY_CONSTANT] = "MULTIPLY_CONSTANT", [OP_DIVIDE_CONSTANT] = "DIVIDE_CONSTANT",
+    [OP_ADD_LOCAL] = "ADD_LOCAL", [OP_SUBTRACT_LOCAL] = "SUBTRACT_LOCAL",
+    [OP_MULTIPLY_LOCAL] = "MULTIPLY_LOCAL", [OP_DIVIDE_LOCAL] = "DIVIDE_LOCAL",
+    [OP_ADD_GLOBAL] = "ADD_GLOBAL", [OP_SUBTRACT_GLOBAL] = "SUBTRACT_GLOBAL",
+    [OP_MULTIPLY_GLOBAL] = "MULTIPLY_GLOBAL", [OP_DIVIDE_GLOBAL] = "DIVIDE_GLOBAL",
+    [OP_GREATER_JUMP] = "GREATER_JUMP", [OP_GREATER_EQUAL_JUMP] = "GREATER_EQUAL_JUMP",
+    [OP_LESS_JUMP] = "LESS_JUMP", [OP_LESS_EQUAL_JUMP] = "LESS_EQUAL_JUMP",
+    [OP_INCREMENT_LOCAL] = "INCREMENT_LOCAL", [OP_DECREMENT_LOCAL] = "DECREMENT_LOCAL", [OP_FOR_LOCAL] = "FOR_LOCAL",
+};
+
+// Get the printable name of an opcode
+static const char* opName(int instruction) {
+    return opNames[instruction] != NULL ? opNames[instruction] : "?";
+}
+
+// Count an executed instruction
+void profileInstruction(uint8_t instruction) {
+    if (history[1] != -1) {
+        bigrams[history[1] << 8 | instruction]++;
+    }
+    if (history[0] != -1) {
+        uint32_t key = (uint32_t)history[0] << 16 | (uint32_t)history[1] << 8 | instruction;
+        uint32_t index = (key * 2654435761u) & (PROFILE_TABLE_SIZE - 1);
+        // Linear probe for the triple, dropping it if the table is full
+        for (int probe = 0; probe < PROFILE_TABLE_SIZE; probe++) {
+            NgramCount* entry = &trigrams[index];
+            if (entry->count == 0 || entry->key == key) {
+                entry->key = key;
+                entry->count++;
+                break;
+            }
+            index = (index + 1) & (PROFILE_TABLE_SIZE - 1);
+        }
+    }
+    history[0] = history[1];
+    history[1] = instruction;
+}
+
+// Print the most executed opcode pairs and triples
+void printProfile() {
+    uint64_t total = 0;
+    for (int i = 0; i < UINT8_COUNT * UINT8_COUNT; i++) total += bigrams[i];
+    if (total == 0) return;
+
+    printf("== top opcode pairs (%llu total) ==\n", (unsigned long long)total);
+    for (int rank = 0; rank < PROFILE_TOP; rank++) {
+        int best = -1;
+        for (int i = 0; i < UINT8_COUNT * UINT8_COUNT; i++) {
+            if (bigrams[i] > 0 && (best == -1 || bigrams[i] > bigrams[best])) best = i;
+        }
+        if (best == -1) break;
+        printf("%12llu  %5.2f%%  %s %s\n", (unsigned long long)bigrams[best], 100.0 * bigrams[best] / total,
+            opName(best >> 8), opName(best & 0xff));
+        bigrams[best] = 0;
+    }
+
+    printf("== top opcode triples ==\n");
+    for (int rank = 0; rank < PROFILE_TOP; rank++) {
+        int best = -1;
+        for (int i = 0; i < PROFILE_TABLE_SIZE; i++) {
+            if (trigrams[i].count > 0 && (best == -1 || trigrams[i].count > trigrams[best].count)) best = i;
+        }
+        if (best == -1) break;
+        uint32_t key = trigrams[best].key;
+        printf("%12llu  %5.2f%%  %s %s %s\n", (unsigned long long)trigrams[best].count, 100.0 * trigrams[best].count / total,
+            opName(key >> 16), opName((key >> 8) & 0xff), opName(key & 0xff));
+        trigrams[best].count = 0;
+    }
+}
+
+#undef PROFILE_TABLE_SIZE
+#undef PROFILE_TOP
@@ -2,8 +2,12 @@
 #define cave_debug_h
 
 #include "chunk.h"
+#include "regvm.h"
 
 void disassembleChunk(Chunk* chunk, const char* name);
 int disassembleInstruction(Chunk* chunk, int offset);
+void disassembleRegisters(RegFunction* function, const char* name);
+void profileInstruction(uint8_t instruction);
+void printProfile();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,355 @@
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "jit.h"
+
+#if !defined(DISABLE_JIT) && (defined(__x86_64__) || defined(_M_X64))
+#define JIT_ENABLED
+#endif
+
+#ifdef JIT_ENABLED
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Most machine code bytes one register instruction compiles to
+#define JIT_INSTRUCTION_MAX 48
+// Prologue and epilogue bytes
+#define JIT_FRAME_MAX 32
+
+// Compiled code takes the register file in rbx for its whole run
+typedef void (*JitFn)(double* registers);
+
+typedef struct {
+    uint8_t* code;
+    size_t count;
+} Assembler;
+
+/*
+    ---------------
+    CODE EMITTING
+    ---------------
+*/
+
+static void emit8(Assembler* as, uint8_t byte) {
+    as->code[as->count++] = byte;
+}
+
+static void emit32(Assembler* as, uint32_t value) {
+    for (int byte = 0; byte < 4; byte++) {
+        emit8(as, (uint8_t)(value >> (byte * 8)));
+    }
+}
+
+static void emit64(Assembler* as, uint64_t value) {
+    for (int byte = 0; byte < 8; byte++) {
+        emit8(as, (uint8_t)(value >> (byte * 8)));
+    }
+}
+
+// Any instruction with a [rbx + reg * 8] operand
+static void emitRegisterOperand(Assembler* as, int field, uint8_t reg) {
+    emit8(as, 0x83 | field << 3);
+    emit32(as, reg * sizeof(double));
+}
+
+// movsd xmm, [rbx + reg * 8]
+static void loadXmm(Assembler* as, int xmm, uint8_t reg) {
+    emit8(as, 0xF2); emit8(as, 0x0F); emit8(as, 0x10);
+    emitRegisterOperand(as, xmm, reg);
+}
+
+// movsd [rbx + reg * 8], xmm
+static void storeXmm(Assembler* as, int xmm, uint8_t reg) {
+    emit8(as, 0xF2); emit8(as, 0x0F); emit8(as, 0x11);
+    emitRegisterOperand(as, xmm, reg);
+}
+
+// addsd/subsd/mulsd/divsd xmm0, [rbx + reg * 8]
+static void arithmeticXmm(Assembler* as, uint8_t opcode, uint8_t reg) {
+    emit8(as, 0xF2); emit8(as, 0x0F); emit8(as, opcode);
+    emitRegisterOperand(as, 0, reg);
+}
+
+// mov rax/rcx, [rbx + reg * 8]
+static void loadGeneral(Assembler* as, int general, uint8_t reg) {
+    emit8(as, 0x48); emit8(as, 0x8B);
+    emitRegisterOperand(as, general, reg);
+}
+
+// mov [rbx + reg * 8], rax
+static void storeRax(Assembler* as, uint8_t reg) {
+    emit8(as, 0x48); emit8(as, 0x89);
+    emitRegisterOperand(as, 0, reg);
+}
+
+// Compare a with b, setcc al
+static void compare(Assembler* as, uint8_t a, uint8_t b, uint8_t setcc) {
+    loadXmm(as, 0, a);
+    // ucomisd xmm0, [rbx + b * 8]
+    emit8(as, 0x66); emit8(as, 0x0F); emit8(as, 0x2E);
+    emitRegisterOperand(as, 0, b);
+    emit8(as, 0x0F); emit8(as, setcc); emit8(as, 0xC0);
+}
+
+// Compare a with 0, leaves the flags set
+static void compareZero(Assembler* as, uint8_t a) {
+    loadXmm(as, 0, a);
+    // xorpd xmm1, xmm1
+    emit8(as, 0x66); emit8(as, 0x0F); emit8(as, 0x57); emit8(as, 0xC9);
+    // ucomisd xmm0, xmm1
+    emit8(as, 0x66); emit8(as, 0x0F); emit8(as, 0x2E); emit8(as, 0xC1);
+}
+
+// Combine al with a second setcc on cl, 'and' if both must hold, 'or' if either does
+static void combineFlag(Assembler* as, uint8_t setcc, bool both) {
+    emit8(as, 0x0F); emit8(as, setcc); emit8(as, 0xC1);
+    emit8(as, both ? 0x20 : 0x08); emit8(as, 0xC8);
+}
+
+// Store al into dst as 0.0 or 1.0
+static void storeFlag(Assembler* as, uint8_t dst) {
+    // movzx eax, al
+    emit8(as, 0x0F); emit8(as, 0xB6); emit8(as, 0xC0);
+    // cvtsi2sd xmm0, eax
+    emit8(as, 0xF2); emit8(as, 0x0F); emit8(as, 0x2A); emit8(as, 0xC0);
+    storeXmm(as, 0, dst);
+}
+
+// mov rax, function; call rax
+static void callFunction(Assembler* as, void* function) {
+    emit8(as, 0x48); emit8(as, 0xB8);
+    emit64(as, (uint64_t)(uintptr_t)function);
+    emit8(as, 0xFF); emit8(as, 0xD0);
+}
+
+// dst = function(a)
+static void callUnary(Assembler* as, RegInstruction* instruction, double (*function)(double)) {
+    loadXmm(as, 0, instruction->a);
+    callFunction(as, (void*)function);
+    storeXmm(as, 0, instruction->dst);
+}
+
+// dst = function(a, b)
+static void callBinary(Assembler* as, RegInstruction* instruction, double (*function)(double, double)) {
+    loadXmm(as, 0, instruction->a);
+    loadXmm(as, 1, instruction->b);
+    callFunction(as, (void*)function);
+    storeXmm(as, 0, instruction->dst);
+}
+
+// dst = readTimeBuffer(buffer, a, b)
+static void callReadBuffer(Assembler* as, RegInstruction* instruction, double* buffer) {
+#ifdef _WIN32
+    // Win64 passes arguments by position: rcx, xmm1, xmm2
+    emit8(as, 0x48); emit8(as, 0xB9);
+    emit64(as, (uint64_t)(uintptr_t)buffer);
+    loadXmm(as, 1, instruction->a);
+    loadXmm(as, 2, instruction->b);
+#else
+    // System V: rdi, xmm0, xmm1
+    emit8(as, 0x48); emit8(as, 0xBF);
+    emit64(as, (uint64_t)(uintptr_t)buffer);
+    loadXmm(as, 0, instruction->a);
+    loadXmm(as, 1, instruction->b);
+#endif
+    callFunction(as, (void*)readTimeBuffer);
+    storeXmm(as, 0, instruction->dst);
+}
+
+static void compileInstruction(Assembler* as, RegFunction* function, RegInstruction* instruction) {
+    switch (instruction->op) {
+        case REG_ADD:
+        case REG_SUBTRACT:
+        case REG_MULTIPLY:
+        case REG_DIVIDE: {
+            static const uint8_t opcodes[] = {0x58, 0x5C, 0x59, 0x5E};
+            loadXmm(as, 0, instruction->a);
+            arithmeticXmm(as, opcodes[instruction->op - REG_ADD], instruction->b);
+            storeXmm(as, 0, instruction->dst);
+            break;
+        }
+        case REG_MOD: callBinary(as, instruction, fmod); break;
+        case REG_NEGATE:
+            // Flip the sign bit, -0 stays distinct from 0
+            loadGeneral(as, 0, instruction->a);
+            emit8(as, 0x48); emit8(as, 0x0F); emit8(as, 0xBA); emit8(as, 0xF8); emit8(as, 0x3F);
+            storeRax(as, instruction->dst);
+            break;
+
+        // Unordered (NaN) compares are false, except for !=
+        case REG_NOT:
+            compareZero(as, instruction->a);
+            emit8(as, 0x0F); emit8(as, 0x94); emit8(as, 0xC0);
+            combineFlag(as, 0x9B, true);
+            storeFlag(as, instruction->dst);
+            break;
+        case REG_EQUAL:
+            compare(as, instruction->a, instruction->b, 0x94);
+            combineFlag(as, 0x9B, true);
+            storeFlag(as, instruction->dst);
+            break;
+        case REG_NOT_EQUAL:
+            compare(as, instruction->a, instruction->b, 0x95);
+            combineFlag(as, 0x9A, false);
+            storeFlag(as, instruction->dst);
+            break;
+        case REG_GREATER:
+            compare(as, instruction->a, instruction->b, 0x97);
+            storeFlag(as, instruction->dst);
+            break;
+        case REG_GREATER_EQUAL:
+            compare(as, instruction->a, instruction->b, 0x93);
+            storeFlag(as, instruction->dst);
+            break;
+        case REG_LESS:
+            compare(as, instruction->b, instruction->a, 0x97);
+            storeFlag(as, instruction->dst);
+            break;
+        case REG_LESS_EQUAL:
+            compare(as, instruction->b, instruction->a, 0x93);
+            storeFlag(as, instruction->dst);
+            break;
+        case REG_SELECT:
+            compareZero(as, instruction->a);
+            loadGeneral(as, 0, instruction->b);
+            loadGeneral(as, 1, instruction->c);
+            // NaN is true, jump over the cmove
+            emit8(as, 0x7A); emit8(as, 0x04);
+            // cmove rax, rcx
+            emit8(as, 0x48); emit8(as, 0x0F); emit8(as, 0x44); emit8(as, 0xC1);
+            storeRax(as, instruction->dst);
+            break;
+
+        // Intrinsics
+        case REG_SIN: callUnary(as, instruction, sin); break;
+        case REG_COS: callUnary(as, instruction, cos); break;
+        case REG_TAN: callUnary(as, instruction, tan); break;
+        case REG_ASIN: callUnary(as, instruction, asin); break;
+        case REG_ACOS: callUnary(as, instruction, acos); break;
+        case REG_ATAN: callUnary(as, instruction, atan); break;
+        case REG_SQRT: callUnary(as, instruction, sqrt); break;
+        case REG_FLOOR: callUnary(as, instruction, floor); break;
+        case REG_CEIL: callUnary(as, instruction, ceil); break;
+        case REG_ROUND: callUnary(as, instruction, round); break;
+        case REG_SAW: callUnary(as, instruction, sawIntrinsic); break;
+        case REG_POW: callBinary(as, instruction, pow); break;
+        case REG_ATAN2: callBinary(as, instruction, atan2); break;
+        case REG_MAIN_T: callReadBuffer(as, instruction, function->wavetable->main_time); break;
+        case REG_AUX1_T: callReadBuffer(as, instruction, function->wavetable->aux1_time); break;
+    }
+}
+
+/*
+    -----------------
+    EXECUTABLE MEMORY
+    -----------------
+*/
+
+static uint8_t* allocateCode(size_t size) {
+#ifdef _WIN32
+    return (uint8_t*)VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? NULL : (uint8_t*)memory;
+#endif
+}
+
+// Code is never writable and executable at the same time
+static bool protectCode(uint8_t* code, size_t size) {
+#ifdef _WIN32
+    DWORD oldProtect;
+    return VirtualProtect(code, size, PAGE_EXECUTE_READ, &oldProtect);
+#else
+    return mprotect(code, size, PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+static void freeCode(uint8_t* code, size_t size) {
+#ifdef _WIN32
+    VirtualFree(code, 0, MEM_RELEASE);
+#else
+    munmap(code, size);
+#endif
+}
+
+bool compileJit(JitFunction* jit, RegFunction* function) {
+    // Only the per sample code, the rest is hoisted out of the loop
+    jit->size = JIT_FRAME_MAX + (size_t)(function->count - function->sampleStart) * JIT_INSTRUCTION_MAX;
+    jit->code = allocateCode(jit->size);
+    if (jit->code == NULL) {
+        return false;
+    }
+
+    Assembler as;
+    as.code = jit->code;
+    as.count = 0;
+
+    // push rbx; sub rsp, 32
+    // Keeps the stack 16 byte aligned for calls, and is the Win64 shadow space
+    emit8(&as, 0x53);
+    emit8(&as, 0x48); emit8(&as, 0x83); emit8(&as, 0xEC); emit8(&as, 0x20);
+#ifdef _WIN32
+    // mov rbx, rcx
+    emit8(&as, 0x48); emit8(&as, 0x89); emit8(&as, 0xCB);
+#else
+    // mov rbx, rdi
+    emit8(&as, 0x48); emit8(&as, 0x89); emit8(&as, 0xFB);
+#endif
+
+    for (int offset = function->sampleStart; offset < function->count; offset++) {
+        compileInstruction(&as, function, &function->code[offset]);
+    }
+
+    // add rsp, 32; pop rbx; ret
+    emit8(&as, 0x48); emit8(&as, 0x83); emit8(&as, 0xC4); emit8(&as, 0x20);
+    emit8(&as, 0x5B);
+    emit8(&as, 0xC3);
+
+    if (!protectCode(jit->code, jit->size)) {
+        freeJit(jit);
+        return false;
+    }
+    return true;
+}
+
+void runJit(JitFunction* jit, RegFunction* function, int frame, int minIndex, int maxIndex, double* out) {
+    double registers[REGISTERS_MAX];
+    beginFrameRegisters(function, registers, frame);
+
+    JitFn run = (JitFn)(void*)jit->code;
+    for (int index = minIndex; index < maxIndex; index++) {
+        loadIndexRegisters(function, registers, index);
+        run(registers);
+        out[index] = registers[function->result];
+    }
+}
+
+void freeJit(JitFunction* jit) {
+    if (jit->code != NULL) {
+        freeCode(jit->code, jit->size);
+        jit->code = NULL;
+    }
+}
+
+#else
+
+// No JIT, register functions stay in the register VM
+bool compileJit(JitFunction* jit, RegFunction* function) {
+    jit->code = NULL;
+    jit->size = 0;
+    return false;
+}
+
+void runJit(JitFunction* jit, RegFunction* function, int frame, int minIndex, int maxIndex, double* out) {
+    runRegisters(function, frame, minIndex, maxIndex, out);
+}
+
+void freeJit(JitFunction* jit) {
+}
+
+#endif
\ No newline at end of file
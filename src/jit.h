@@ -0,0 +1,20 @@
+#ifndef cave_jit_h
+#define cave_jit_h
+
+#include "common.h"
+#include "regvm.h"
+
+// Native code for one run of a register function
+typedef struct {
+    uint8_t* code;
+    size_t size;
+} JitFunction;
+
+// Compile register code into x86-64 machine code
+// Returns false if the JIT is disabled or unsupported on this platform
+bool compileJit(JitFunction* jit, RegFunction* function);
+// Same as runRegisters, using the compiled code
+void runJit(JitFunction* jit, RegFunction* function, int frame, int minIndex, int maxIndex, double* out);
+void freeJit(JitFunction* jit);
+
+#endif
\ No newline at end of file
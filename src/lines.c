@@ -6,10 +6,15 @@ void initLinesArray(LinesArray* lines) {
     lines->count = 0;
     lines->capacity = 0;
     lines->lines = NULL;
+    lines->starts = NULL;
+    lines->startCount = 0;
+    lines->startCapacity = 0;
+    lines->arena = NULL;
 }
 
 void freeLinesArray(LinesArray* lines) {
-    FREE_ARRAY(int, lines->lines, lines->capacity);
+    FREE_ARRAY_IN(lines->arena, int, lines->lines, lines->capacity);
+    FREE_ARRAY_IN(lines->arena, int, lines->starts, lines->startCapacity);
     // Zero out the fields, leaving array in empty state
     initLinesArray(lines);
 }
@@ -27,7 +32,7 @@ void writeLinesArray(LinesArray* lines, int line) {
     if (lines->capacity < lines->count + 2) {
         int oldCapacity = lines->capacity;
         lines->capacity = GROW_CAPACITY(oldCapacity);
-        lines->lines = GROW_ARRAY(int, lines->lines, oldCapacity, lines->capacity);
+        lines->lines = GROW_ARRAY_IN(lines->arena, int, lines->lines, oldCapacity, lines->capacity);
     }
 
     // Else add at end
@@ -36,15 +41,40 @@ void writeLinesArray(LinesArray* lines, int line) {
     lines->lines[lines->count++] = line;
 }
 
+// Add the starts of the runs written since the last lookup
+static void indexRuns(LinesArray* lines) {
+    int runs = lines->count / 2;
+    if (lines->startCapacity < runs) {
+        int oldCapacity = lines->startCapacity;
+        // Sized like the runs so far, it grows as often as the line array does
+        lines->startCapacity = lines->capacity / 2;
+        lines->starts = GROW_ARRAY_IN(lines->arena, int, lines->starts, oldCapacity, lines->startCapacity);
+    }
+
+    for (int run = lines->startCount; run < runs; run++) {
+        lines->starts[run] = run == 0 ? 0 : lines->starts[run - 1] + lines->lines[(run - 1) * 2];
+    }
+    lines->startCount = runs;
+}
+
 // Returns line stored for bytecode at 'index'
 int getLine(LinesArray* lines, int index) {
-    for (int lineArrayPos = 0; lineArrayPos < lines->capacity; lineArrayPos += 2) {
-        index -= lines->lines[lineArrayPos];
-        if (index < 0) {
-            return lines->lines[lineArrayPos + 1];
+    if (lines->startCount < lines->count / 2) indexRuns(lines);
+    if (lines->startCount == 0 || index < 0) return -1;
+
+    // Last run starting at or before index
+    int low = 0;
+    int high = lines->startCount - 1;
+    while (low < high) {
+        int middle = low + (high - low + 1) / 2;
+        if (lines->starts[middle] <= index) {
+            low = middle;
+        } else {
+            high = middle - 1;
         }
     }
 
     // Index does not exist
-    return -1;
+    if (index >= lines->starts[low] + lines->lines[low * 2]) return -1;
+    return lines->lines[low * 2 + 1];
 }
\ No newline at end of file
@@ -1,16 +1,28 @@
 #ifndef cave_lines_h
 #define cave_lines_h
 
+#include "arena.h"
+
+// Run length encoded lines, a count of bytes then their line
 typedef struct {
     int count;
     int capacity;
     int* lines;
+    // Code offset each run starts at, filled in by getLine for the runs written since its last call
+    // A run's start never changes once the run is written, only its count grows
+    int* starts;
+    int startCount;
+    int startCapacity;
+    // Grows in this arena instead of the heap if set
+    Arena* arena;
 } LinesArray;
 
 void initLinesArray(LinesArray* lines);
 void freeLinesArray(LinesArray* lines);
 void writeLinesArray(LinesArray* lines, int line);
 
+// Line of the bytecode at 'index', -1 if it is past the end
+// Binary search over the run starts
 int getLine(LinesArray* lines, int index);
 
 #endif
\ No newline at end of file
@@ -3,11 +3,17 @@
 #include <string.h>
 #include <time.h>
 
+#include "bytecode.h"
 #include "common.h"
 #include "chunk.h"
+#include "compiler.h"
 #include "debug.h"
+#include "memory.h"
 #include "vm.h"
 
+// Stack and frames are too big for the C stack
+static VM vm;
+
 static void repl() {
     char line[1024];
     for(;;) {
@@ -18,16 +24,17 @@ static void repl() {
             break;
         }
 
-        interpret(line);
+        interpret(&vm, line);
     }
 }
 
+// Returns NULL if the file could not be read
 static char* readFile(const char* path) {
     FILE* file = fopen(path, "rb");
     // Check if file successfully opened
     if (file == NULL) {
         fprintf(stderr, "Could not open file \"%s\"\n", path);
-        exit(74);
+        return NULL;
     }
 
     fseek(file, 0L, SEEK_END);
@@ -38,14 +45,17 @@ static char* readFile(const char* path) {
     // Check if buffer was successfully allocated
     if (buffer == NULL) {
         fprintf(stderr, "Not enough memory to read \"%s\"\n", path);
-        exit(74);
+        fclose(file);
+        return NULL;
     }
 
     size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
     // Check if file was successfully read
     if (bytesRead < fileSize) {
         fprintf(stderr, "Could not read file \"%s\"\n", path);
-        exit(74);
+        free(buffer);
+        fclose(file);
+        return NULL;
     }
     buffer[bytesRead] = '\0';
 
@@ -53,35 +63,56 @@ static char* readFile(const char* path) {
     return buffer;
 }
 
-static void runFile(const char* path) {
+// Runs the bytecode file next to the script if it was compiled from the same source
+// Otherwise compiles the script and writes the file for the next run
+// Returns the exit status of the script, 0 if it ran to the end
+static int runFile(const char* path) {
     char* source = readFile(path);
+    if (source == NULL) return 74;
+    char* cachePath = bytecodePath(path);
 
-    InterpretResult result;
-    for (int i = 0; i < 1; i++)
-        result = interpret(source);
+    ObjFunction* function = loadBytecode(&vm, cachePath, source);
+    if (function == NULL) {
+        function = compile(&vm, source);
+        if (function != NULL) saveBytecode(function, cachePath, source);
+    }
+    FREE_ARRAY(char, cachePath, strlen(cachePath) + 1);
+    if (function == NULL) {
+        free(source);
+        return 65;
+    }
+
+    InterpretResult result = interpretFunction(&vm, function);
     free(source);
 
-    if (result == INTERPRET_COMPILE_ERROR) exit(65);
-    if (result == INTERPRET_RUNTIME_ERROR) exit(70);
+    if (result == INTERPRET_COMPILE_ERROR) return 65;
+    if (result == INTERPRET_RUNTIME_ERROR) return 70;
+    return 0;
 }
 
 int main(int argc, const char* argv[]) {
-    initVM();
+    initVM(&vm);
+    int status = 0;
 
     if (argc == 1) {
         repl();
-    } else if (argc == 2) {
+    } else {
         float start, end;
         start = (float)clock()/CLOCKS_PER_SEC;
-        runFile(argv[1]);
+        // Scripts of a batch run one after another, each with its own globals
+        // Modules they import are compiled once for the whole batch
+        // A failing script does not stop the rest, the first failure is the exit status
+        for (int script = 1; script < argc; script++) {
+            if (script > 1) resetGlobals(&vm);
+            vm.scriptPath = argv[script];
+            int scriptStatus = runFile(argv[script]);
+            if (status == 0) status = scriptStatus;
+        }
         end = (float)clock()/CLOCKS_PER_SEC;
         printf("Total time to run was %2f s", end - start);
-    } else {
-        fprintf(stderr, "Usage: cave [path]\n");
-        exit(64);
     }
 
     
-    freeVM();
-    return 0;
+    freeVM(&vm);
+    return status;
 }
\ No newline at end of file
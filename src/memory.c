@@ -1,8 +1,13 @@
 #include <stdlib.h>
 
+#include "compiler.h"
 #include "memory.h"
 #include "vm.h"
 
+#ifdef DEBUG_LOG_GC
+#include <stdio.h>
+#endif
+
 /* Reallocates the memory of a pointer 
    Can delete data or resize data */
 void* reallocate(void* pointer, size_t oldsize, size_t newSize) {
@@ -18,32 +23,171 @@ void* reallocate(void* pointer, size_t oldsize, size_t newSize) {
     return result;
 }
 
-static void freeObject(Obj* object) {
+void* reallocateIn(Arena* arena, void* pointer, size_t oldSize, size_t newSize) {
+    if (arena == NULL) {
+        return reallocate(pointer, oldSize, newSize);
+    }
+    if (newSize == 0) {
+        return NULL;
+    }
+    return arenaReallocate(arena, pointer, oldSize, newSize);
+}
+
+static void freeObject(VM* vm, Obj* object) {
     switch (object->type) {
         case OBJ_FUNCTION: {
             ObjFunction* function = (ObjFunction*)object;
             freeChunk(&function->chunk);
             FREE(ObjFunction, object);
+            vm->bytesAllocated -= sizeof(ObjFunction);
             break;
         }
         case OBJ_NATIVE: {
-            FREE(OBJ_NATIVE, object);
+            FREE(ObjNative, object);
+            vm->bytesAllocated -= sizeof(ObjNative);
             break;
         }
         case OBJ_STRING: {
             ObjString* string = (ObjString*)object;
+            vm->bytesAllocated -= sizeof(ObjString) + string->length + 1;
             FREE_ARRAY(char, string->chars, string->length + 1);
             FREE(ObjString, object);
             break;
         }
+        case OBJ_ARRAY: {
+            ObjArray* array = (ObjArray*)object;
+            vm->bytesAllocated -= sizeof(ObjArray);
+            if (!isArrayView(array)) {
+                vm->bytesAllocated -= sizeof(double) * array->length;
+                FREE_ARRAY(double, array->values, array->length);
+            }
+            FREE(ObjArray, object);
+            break;
+        }
+    }
+}
+
+/*
+    ---------------
+    GARBAGE COLLECTION
+    ---------------
+*/
+
+void markObject(VM* vm, Obj* object) {
+    if (object == NULL || object->isMarked) return;
+    object->isMarked = true;
+    // Strings, natives and arrays that own their values point to nothing
+    if (object->type != OBJ_FUNCTION && (object->type != OBJ_ARRAY || ((ObjArray*)object)->owner == NULL)) return;
+
+    if (vm->grayCapacity < vm->grayCount + 1) {
+        vm->grayCapacity = GROW_CAPACITY(vm->grayCapacity);
+        // Not through reallocate, the gray stack is not part of the heap
+        vm->grayStack = (Obj**)realloc(vm->grayStack, sizeof(Obj*) * vm->grayCapacity);
+        if (vm->grayStack == NULL) exit(1);
+    }
+    vm->grayStack[vm->grayCount++] = object;
+}
+
+void markValue(VM* vm, Value value) {
+    if (IS_OBJ(value)) markObject(vm, AS_OBJ(value));
+}
+
+static void markRoots(VM* vm) {
+    for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
+        markValue(vm, *slot);
+    }
+    for (int frame = 0; frame < vm->frameCount; frame++) {
+        markObject(vm, (Obj*)vm->frames[frame].function);
+    }
+    markTable(vm, &vm->globals);
+    markValue(vm, vm->output);
+    for (int entry = 0; entry < FORMULA_CACHE_MAX; entry++) {
+        markObject(vm, (Obj*)vm->formulas[entry].source);
+        markObject(vm, (Obj*)vm->formulas[entry].key);
+        markObject(vm, (Obj*)vm->formulas[entry].function);
     }
+    for (int module = 0; module < vm->moduleCount; module++) {
+        markObject(vm, (Obj*)vm->modules[module].path);
+        markObject(vm, (Obj*)vm->modules[module].function);
+    }
+    markCompilerRoots(vm);
+}
+
+// Mark everything a gray object points to
+static void blackenObject(VM* vm, Obj* object) {
+    switch (object->type) {
+        case OBJ_FUNCTION: {
+            ObjFunction* function = (ObjFunction*)object;
+            markObject(vm, (Obj*)function->name);
+            for (int constant = 0; constant < function->chunk.constants.count; constant++) {
+                markValue(vm, function->chunk.constants.values[constant]);
+            }
+            break;
+        }
+        case OBJ_ARRAY:
+            markObject(vm, ((ObjArray*)object)->owner);
+            break;
+        default:
+            break;
+    }
+}
+
+static void traceReferences(VM* vm) {
+    while (vm->grayCount > 0) {
+        blackenObject(vm, vm->grayStack[--vm->grayCount]);
+    }
+}
+
+static void sweep(VM* vm) {
+    Obj* previous = NULL;
+    Obj* object = vm->objects;
+    while (object != NULL) {
+        if (object->isMarked) {
+            object->isMarked = false;
+            previous = object;
+            object = object->next;
+            continue;
+        }
+
+        Obj* unreached = object;
+        object = object->next;
+        if (previous != NULL) {
+            previous->next = object;
+        } else {
+            vm->objects = object;
+        }
+        freeObject(vm, unreached);
+    }
+}
+
+void collectGarbage(VM* vm) {
+#ifdef DEBUG_LOG_GC
+    printf("-- gc begin\n");
+    size_t before = vm->bytesAllocated;
+#endif
+
+    markRoots(vm);
+    traceReferences(vm);
+    // Interned strings do not keep themselves alive
+    tableRemoveWhite(&vm->strings);
+    sweep(vm);
+
+    vm->nextGC = vm->bytesAllocated * vm->heapGrowFactor;
+    if (vm->nextGC < GC_HEAP_INITIAL) vm->nextGC = GC_HEAP_INITIAL;
+
+#ifdef DEBUG_LOG_GC
+    printf("-- gc end\n");
+    printf("   collected %zu bytes (from %zu to %zu) next at %zu\n",
+        before - vm->bytesAllocated, before, vm->bytesAllocated, vm->nextGC);
+#endif
 }
 
-void freeObjects() {
-    Obj* object = vm.objects;
+void freeObjects(VM* vm) {
+    Obj* object = vm->objects;
     while (object != NULL) {
         Obj* next = object->next;
-        freeObject(object);
+        freeObject(vm, object);
         object = next;
     }
+    free(vm->grayStack);
 }
\ No newline at end of file
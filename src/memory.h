@@ -1,6 +1,7 @@
 #ifndef cave_memory_h
 #define cave_memory_h
 
+#include "arena.h"
 #include "common.h"
 #include "object.h"
 
@@ -19,7 +20,24 @@
 #define FREE_ARRAY(type, pointer, oldCount) \
     reallocate(pointer, sizeof(type) * (oldCount), 0)
 
+// Same as the heap versions, from arena unless it is NULL
+#define ALLOCATE_IN(arena, type, count) \
+    (type*)reallocateIn(arena, NULL, 0, sizeof(type) * (count))
+
+#define GROW_ARRAY_IN(arena, type, pointer, oldCount, newCount) \
+    (type*)reallocateIn(arena, pointer, sizeof(type) * (oldCount), \
+    sizeof(type) * (newCount))
+
+#define FREE_ARRAY_IN(arena, type, pointer, oldCount) \
+    reallocateIn(arena, pointer, sizeof(type) * (oldCount), 0)
+
 void* reallocate(void* pointer, size_t oldSize, size_t newSize);
-void freeObjects();
+// Arena memory is never freed on its own, only with the whole arena
+void* reallocateIn(Arena* arena, void* pointer, size_t oldSize, size_t newSize);
+void markObject(VM* vm, Obj* object);
+void markValue(VM* vm, Value value);
+// Free every object unreachable from the stack, globals, formula cache and compilers
+void collectGarbage(VM* vm);
+void freeObjects(VM* vm);
 
 #endif
\ No newline at end of file
@@ -7,18 +7,29 @@
 #include "vm.h"
 
 #define ALLOCATE_OBJ(type, objectType) \
-    (type*)allocateObject(sizeof(type), objectType)
+    (type*)allocateObject(vm, sizeof(type), objectType)
+
+static Obj* allocateObject(VM* vm, size_t size, ObjType type) {
+    // Collect before the new object exists, it has nothing pointing to it yet
+    vm->bytesAllocated += size;
+#ifdef DEBUG_STRESS_GC
+    collectGarbage(vm);
+#else
+    if (vm->bytesAllocated > vm->nextGC) {
+        collectGarbage(vm);
+    }
+#endif
 
-static Obj* allocateObject(size_t size, ObjType type) {
     Obj* object = (Obj*)reallocate(NULL, 0, size);
     object->type = type;
+    object->isMarked = false;
 
-    object->next = vm.objects;
-    vm.objects = object;
+    object->next = vm->objects;
+    vm->objects = object;
     return object;
 }
 
-ObjFunction* newFunction() {
+ObjFunction* newFunction(VM* vm) {
     ObjFunction* function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
     function->arity = 0;
     function->name = NULL;
@@ -26,20 +37,58 @@ ObjFunction* newFunction() {
     return function;
 }
 
-ObjNative* newNative(NativeFn function, int arity) {
+ObjNative* newNative(VM* vm, NativeFn function, int arity) {
     ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
     native->arity = arity;
     native->function = function;
+    native->isPure = false;
     return native;
 }
 
-static ObjString* allocateString(char* chars, int length, uint32_t hash) {
+ObjArray* newArray(VM* vm, int length) {
+    ObjArray* array = ALLOCATE_OBJ(ObjArray, OBJ_ARRAY);
+    array->length = length;
+    array->owner = NULL;
+    array->buffer = -1;
+    array->isFreq = false;
+    array->values = ALLOCATE(double, length);
+    for (int index = 0; index < length; index++) {
+        array->values[index] = 0;
+    }
+    vm->bytesAllocated += sizeof(double) * length;
+    return array;
+}
+
+ObjArray* newArrayView(VM* vm, ObjArray* parent, int start, int length) {
+    ObjArray* array = ALLOCATE_OBJ(ObjArray, OBJ_ARRAY);
+    array->length = length;
+    array->values = parent->values + start;
+    // Views of views point at the owner directly
+    array->owner = isArrayView(parent) ? parent->owner : (Obj*)parent;
+    array->buffer = parent->buffer;
+    array->isFreq = parent->isFreq;
+    return array;
+}
+
+ObjArray* newBufferView(VM* vm, double* values, int length, int buffer, bool isFreq) {
+    ObjArray* array = ALLOCATE_OBJ(ObjArray, OBJ_ARRAY);
+    array->length = length;
+    array->values = values;
+    array->owner = NULL;
+    array->buffer = buffer;
+    array->isFreq = isFreq;
+    return array;
+}
+
+static ObjString* allocateString(VM* vm, char* chars, int length) {
     ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
     string->length = length;
     string->chars = chars;
-    string->hash = hash;
-    // Intern string
-    tableSet(&vm.strings, string, NIL_VAL);
+    string->hash = 0;
+    string->isHashed = false;
+    string->isInterned = false;
+    string->isNative = false;
+    vm->bytesAllocated += length + 1;
     return string;
 }
 
@@ -53,31 +102,83 @@ static uint32_t hashString(const char* key, int length) {
     return hash;
 }
 
-ObjString* takeString(char* chars, int length) {
+uint32_t stringHash(ObjString* string) {
+    if (!string->isHashed) {
+        string->hash = hashString(string->chars, string->length);
+        string->isHashed = true;
+    }
+    return string->hash;
+}
+
+bool stringsEqual(ObjString* a, ObjString* b) {
+    if (a == b) return true;
+    // Two interned strings are only equal if they are the same object
+    if (a->isInterned && b->isInterned) return false;
+    if (a->length != b->length) return false;
+    if (a->isHashed && b->isHashed && a->hash != b->hash) return false;
+    return memcmp(a->chars, b->chars, a->length) == 0;
+}
+
+ObjString* findInternedString(VM* vm, ObjString* string) {
+    if (string->isInterned) return string;
+    return tableFindString(&vm->strings, string->chars, string->length, stringHash(string));
+}
+
+// Add a string known to have no interned equal
+static ObjString* addInterned(VM* vm, ObjString* string) {
+    stringHash(string);
+    string->isInterned = true;
+    tableSet(&vm->strings, string, NIL_VAL);
+    return string;
+}
+
+ObjString* internString(VM* vm, ObjString* string) {
+    ObjString* interned = findInternedString(vm, string);
+    if (interned != NULL) return interned;
+    return addInterned(vm, string);
+}
+
+ObjString* takeString(VM* vm, char* chars, int length) {
     uint32_t hash = hashString(chars, length);
 
     // Check if string interned
-    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    ObjString* interned = tableFindString(&vm->strings, chars, length, hash);
     if (interned != NULL) {
         FREE_ARRAY(char, chars, length + 1);
         return interned;
     }
 
-    return allocateString(chars, length, hash);
+    ObjString* string = allocateString(vm, chars, length);
+    string->hash = hash;
+    string->isHashed = true;
+    return addInterned(vm, string);
 }
 
-ObjString* copyString(const char* chars, int length) {
+ObjString* copyString(VM* vm, const char* chars, int length) {
     uint32_t hash = hashString(chars, length);
 
     // Check if string interned
-    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    ObjString* interned = tableFindString(&vm->strings, chars, length, hash);
     if (interned != NULL) return interned;
 
+    char* heapChars = ALLOCATE(char, length + 1);
+    memcpy(heapChars, chars, length);
+    heapChars[length] = '\0';
+    ObjString* string = allocateString(vm, heapChars, length);
+    string->hash = hash;
+    string->isHashed = true;
+    return addInterned(vm, string);
+}
+
+ObjString* takeTransientString(VM* vm, char* chars, int length) {
+    return allocateString(vm, chars, length);
+}
 
+ObjString* copyTransientString(VM* vm, const char* chars, int length) {
     char* heapChars = ALLOCATE(char, length + 1);
     memcpy(heapChars, chars, length);
     heapChars[length] = '\0';
-    return allocateString(heapChars, length, hash);
+    return allocateString(vm, heapChars, length);
 }
 
 static void printFunction(ObjFunction* function) {
@@ -88,6 +189,14 @@ static void printFunction(ObjFunction* function) {
     printf("<fn %s>", function->name->chars);
 }
 
+static void printArray(ObjArray* array) {
+    printf("[");
+    for (int index = 0; index < array->length; index++) {
+        printf(index == 0 ? "%g" : ", %g", array->values[index]);
+    }
+    printf("]");
+}
+
 void printObject(Value value) {
     switch(OBJ_TYPE(value)) {
         case OBJ_FUNCTION:
@@ -99,5 +208,8 @@ void printObject(Value value) {
         case OBJ_STRING:
             printf("%s", AS_CSTRING(value));
             break;
+        case OBJ_ARRAY:
+            printArray(AS_ARRAY(value));
+            break;
     }
 }
\ No newline at end of file
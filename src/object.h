@@ -11,20 +11,24 @@
 #define IS_FUNCTION(value)      isObjType(value, OBJ_FUNCTION)
 #define IS_NATIVE(value)        isObjType(value, OBJ_NATIVE)
 #define IS_STRING(value)        isObjType(value, OBJ_STRING)
+#define IS_ARRAY(value)         isObjType(value, OBJ_ARRAY)
 
 #define AS_FUNCTION(value)      ((ObjFunction*)AS_OBJ(value))
 #define AS_NATIVE(value)        (((ObjNative*)AS_OBJ(value)))
 #define AS_STRING(value)        ((ObjString*)AS_OBJ(value))
 #define AS_CSTRING(value)       (((ObjString*)AS_OBJ(value))->chars)
+#define AS_ARRAY(value)         ((ObjArray*)AS_OBJ(value))
 
 typedef enum {
     OBJ_FUNCTION,
     OBJ_NATIVE,
     OBJ_STRING,
+    OBJ_ARRAY,
 } ObjType;
 
 struct Obj {
     ObjType type;
+    bool isMarked;
     Obj* next;
 };
 
@@ -46,25 +50,67 @@ typedef struct {
 } NativeFnReturn;
 /* End of NativeFnReturn */
 
-typedef NativeFnReturn (*NativeFn)(int argCount, Value* args);
+typedef NativeFnReturn (*NativeFn)(VM* vm, int argCount, Value* args);
 
 typedef struct {
     Obj obj;
     int arity;
     NativeFn function;
+    // Result depends only on the arguments, calls on constants are folded by the compiler
+    bool isPure;
 } ObjNative;
 
 struct ObjString {
     Obj obj;
     int length;
     char* chars;
+    // Computed on first use, see stringHash
     uint32_t hash;
+    bool isHashed;
+    // Interned strings are unique, equal interned strings are the same object
+    bool isInterned;
+    // Name of a native or native variable, the global it names is read only
+    bool isNative;
 };
 
-ObjFunction* newFunction();
-ObjNative* newNative(NativeFn function, int arity);
-ObjString* takeString(char* chars, int length);
-ObjString* copyString(const char* chars, int length);
+// Fixed length array of numbers, stored contiguously
+typedef struct {
+    Obj obj;
+    int length;
+    double* values;
+    // Views do not own their values
+    // A slice keeps the array that owns them alive, a buffer view reads wavetable memory
+    Obj* owner;
+    // Wavetable buffer a view reads, -1 if not a buffer view
+    int buffer;
+    // Views the frequency buffer as interleaved real and imaginary parts
+    bool isFreq;
+} ObjArray;
+
+ObjFunction* newFunction(VM* vm);
+ObjNative* newNative(VM* vm, NativeFn function, int arity);
+// Every value starts as 0
+ObjArray* newArray(VM* vm, int length);
+// View of length values of parent starting at start, sharing its memory
+ObjArray* newArrayView(VM* vm, ObjArray* parent, int start, int length);
+// View of a wavetable buffer's memory
+ObjArray* newBufferView(VM* vm, double* values, int length, int buffer, bool isFreq);
+// True if the array does not own its values
+static inline bool isArrayView(ObjArray* array) {
+    return array->owner != NULL || array->buffer >= 0;
+}
+ObjString* takeString(VM* vm, char* chars, int length);
+ObjString* copyString(VM* vm, const char* chars, int length);
+// Same as takeString and copyString without hashing or interning
+// For strings built at runtime that may never be used as a name
+ObjString* takeTransientString(VM* vm, char* chars, int length);
+ObjString* copyTransientString(VM* vm, const char* chars, int length);
+// The interned string equal to string, interning string itself if there is none
+ObjString* internString(VM* vm, ObjString* string);
+// The interned string equal to string, NULL if there is none
+ObjString* findInternedString(VM* vm, ObjString* string);
+uint32_t stringHash(ObjString* string);
+bool stringsEqual(ObjString* a, ObjString* b);
 void printObject(Value value);
 
 static inline bool isObjType(Value value, ObjType type) {
@@ -0,0 +1,100 @@
+#include "common.h"
+#include "parallel.h"
+
+#if !defined(DISABLE_THREADS) && (defined(_WIN32) || defined(__unix__) || defined(__APPLE__))
+#define THREADS_ENABLED
+#endif
+
+#ifdef THREADS_ENABLED
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+    ParallelFn fn;
+    void* context;
+    int worker;
+    int workers;
+} Worker;
+
+#ifdef _WIN32
+static DWORD WINAPI startWorker(LPVOID arg) {
+    Worker* worker = (Worker*)arg;
+    worker->fn(worker->context, worker->worker, worker->workers);
+    return 0;
+}
+#else
+static void* startWorker(void* arg) {
+    Worker* worker = (Worker*)arg;
+    worker->fn(worker->context, worker->worker, worker->workers);
+    return NULL;
+}
+#endif
+
+int parallelWorkers() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int workers = (int)info.dwNumberOfProcessors;
+#else
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (workers < 1) workers = 1;
+    if (workers > PARALLEL_WORKERS_MAX) workers = PARALLEL_WORKERS_MAX;
+    return workers;
+}
+
+void runParallel(ParallelFn fn, void* context, int workers) {
+    Worker args[PARALLEL_WORKERS_MAX];
+#ifdef _WIN32
+    HANDLE threads[PARALLEL_WORKERS_MAX];
+#else
+    pthread_t threads[PARALLEL_WORKERS_MAX];
+#endif
+    bool started[PARALLEL_WORKERS_MAX];
+
+    for (int worker = 1; worker < workers; worker++) {
+        args[worker] = (Worker){fn, context, worker, workers};
+#ifdef _WIN32
+        threads[worker] = CreateThread(NULL, 0, startWorker, &args[worker], 0, NULL);
+        started[worker] = threads[worker] != NULL;
+#else
+        started[worker] = pthread_create(&threads[worker], NULL, startWorker, &args[worker]) == 0;
+#endif
+        // Out of threads, do its share here
+        if (!started[worker]) {
+            fn(context, worker, workers);
+        }
+    }
+
+    fn(context, 0, workers);
+
+    for (int worker = 1; worker < workers; worker++) {
+        if (!started[worker]) continue;
+#ifdef _WIN32
+        WaitForSingleObject(threads[worker], INFINITE);
+        CloseHandle(threads[worker]);
+#else
+        pthread_join(threads[worker], NULL);
+#endif
+    }
+}
+
+#else
+
+// No threads, everything runs on the calling thread
+int parallelWorkers() {
+    return 1;
+}
+
+void runParallel(ParallelFn fn, void* context, int workers) {
+    for (int worker = 0; worker < workers; worker++) {
+        fn(context, worker, workers);
+    }
+}
+
+#endif
\ No newline at end of file
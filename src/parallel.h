@@ -0,0 +1,17 @@
+#ifndef cave_parallel_h
+#define cave_parallel_h
+
+#include "common.h"
+
+// Most threads one parallel run uses
+#define PARALLEL_WORKERS_MAX 64
+
+// Work of one thread, worker is in [0, workers)
+typedef void (*ParallelFn)(void* context, int worker, int workers);
+
+// Threads worth running at once on this machine, 1 if threads are disabled
+int parallelWorkers();
+// Run fn on workers threads and wait for all of them, the calling thread is worker 0
+void runParallel(ParallelFn fn, void* context, int workers);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,842 @@
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "memory.h"
+#include "regvm.h"
+#include "vm.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define REG_SIMD
+#endif
+
+#ifdef DEBUG_PRINT_CODE
+#include "debug.h"
+#endif
+
+// Max depth of the translated value stack
+#define REG_STACK_MAX 64
+// Max conditional jumps in one function
+#define REG_FORKS_MAX 64
+// Max paths waiting at jump targets at once
+#define REG_PENDING_MAX 16
+// Doubles per index cache row, one spare so the vector VM can run an odd last block as a full lane pair
+#define INDEX_CACHE_ROW (WAVETABLE_FRAME_LEN + 1)
+
+/*
+    ----------------------
+    STACK CODE TRANSLATION
+    ----------------------
+*/
+
+// Static type of a value on the translated stack
+typedef enum {
+    TYPE_NUMBER,
+    TYPE_BOOL,
+    TYPE_NATIVE,
+} RegType;
+
+// A value on the translated stack
+typedef struct {
+    RegType type;
+    uint8_t reg; // Register holding the value, or the intrinsic of a native
+    int arity; // Arity of a native
+} RegValue;
+
+// A conditional jump, splits translation into a path for each outcome of cond
+typedef struct {
+    int parent;
+    bool parentSide;
+    uint8_t cond;
+} Fork;
+
+// Translation state along one path through the bytecode
+typedef struct {
+    int fork; // Innermost fork the path went through, -1 if unconditional
+    bool side; // True if cond of that fork was true
+    int count;
+    RegValue stack[REG_STACK_MAX];
+} Path;
+
+// Path waiting to be joined at a jump target
+typedef struct {
+    int target;
+    Path path;
+} PendingPath;
+
+typedef struct {
+    VM* vm;
+    RegFunction* function;
+    Chunk* chunk;
+    bool failed;
+    // Conditional jumps
+    Fork forks[REG_FORKS_MAX];
+    int forkCount;
+    PendingPath pending[REG_PENDING_MAX];
+    int pendingCount;
+    // Constants and globals already given a register, by constant index
+    RegValue loaded[UINT8_COUNT];
+    bool isLoaded[UINT8_COUNT];
+} Translator;
+
+// Put a value in a new register of the initial register file
+static uint8_t constantRegister(Translator* translator, double value) {
+    RegFunction* function = translator->function;
+    if (function->registerCount == REGISTERS_MAX) {
+        translator->failed = true;
+        return 0;
+    }
+    function->registers[function->registerCount] = value;
+    return (uint8_t)function->registerCount++;
+}
+
+// Emit an instruction writing a new register
+static uint8_t emitRegister(Translator* translator, uint8_t op, uint8_t a, uint8_t b, uint8_t c) {
+    RegFunction* function = translator->function;
+    if (function->count == REG_CODE_MAX || function->registerCount == REGISTERS_MAX) {
+        translator->failed = true;
+        return 0;
+    }
+    uint8_t dst = (uint8_t)function->registerCount++;
+    function->registers[dst] = 0;
+    function->code[function->count++] = (RegInstruction){op, dst, a, b, c};
+    return dst;
+}
+
+static void pushValue(Translator* translator, Path* path, RegValue value) {
+    if (path->count == REG_STACK_MAX) {
+        translator->failed = true;
+        return;
+    }
+    path->stack[path->count++] = value;
+}
+
+static RegValue popValue(Translator* translator, Path* path) {
+    if (path->count == 0) {
+        translator->failed = true;
+        return (RegValue){TYPE_NUMBER, 0, 0};
+    }
+    return path->stack[--path->count];
+}
+
+// Numeric constant
+static void loadConstant(Translator* translator, Path* path, uint8_t index) {
+    if (!translator->isLoaded[index]) {
+        Value value = translator->chunk->constants.values[index];
+        if (!IS_NUMBER(value)) {
+            translator->failed = true;
+            return;
+        }
+        translator->loaded[index] = (RegValue){TYPE_NUMBER, constantRegister(translator, AS_NUMBER(value)), 0};
+        translator->isLoaded[index] = true;
+    }
+    pushValue(translator, path, translator->loaded[index]);
+}
+
+// Globals cannot change while a wave function runs, so their current value is used
+static void loadGlobal(Translator* translator, Path* path, uint8_t index) {
+    if (!translator->isLoaded[index]) {
+        ObjString* name = AS_STRING(translator->chunk->constants.values[index]);
+        Value value;
+        // Leave undefined variables for the stack VM to report
+        if (!tableGet(&translator->vm->globals, name, &value)) {
+            translator->failed = true;
+            return;
+        }
+
+        RegValue loaded;
+        if (IS_NUMBER(value)) {
+            loaded = (RegValue){TYPE_NUMBER, constantRegister(translator, AS_NUMBER(value)), 0};
+        } else if (IS_BOOL(value)) {
+            loaded = (RegValue){TYPE_BOOL, constantRegister(translator, AS_BOOL(value)), 0};
+        } else if (IS_NATIVE(value) && nativeRegisterOp(AS_NATIVE(value)->function) >= 0) {
+            loaded = (RegValue){TYPE_NATIVE, (uint8_t)nativeRegisterOp(AS_NATIVE(value)->function), AS_NATIVE(value)->arity};
+            // The tiers read buffers through plain pointers, so they are allocated now
+            if (loaded.reg == REG_MAIN_T) getTimeBuffer(translator->function->wavetable, BUFFER_MAIN);
+            if (loaded.reg == REG_AUX1_T) getTimeBuffer(translator->function->wavetable, BUFFER_AUX1);
+        } else {
+            translator->failed = true;
+            return;
+        }
+        translator->loaded[index] = loaded;
+        translator->isLoaded[index] = true;
+    }
+    pushValue(translator, path, translator->loaded[index]);
+}
+
+// Slot 0 is the function itself, 1 is frame and 2 is index
+static void loadLocal(Translator* translator, Path* path, uint8_t slot) {
+    switch (slot) {
+        case 1: pushValue(translator, path, (RegValue){TYPE_NUMBER, REG_FRAME, 0}); break;
+        case 2: pushValue(translator, path, (RegValue){TYPE_NUMBER, REG_INDEX, 0}); break;
+        default: translator->failed = true; break;
+    }
+}
+
+// Binary operation on the top two values
+static void binaryOp(Translator* translator, Path* path, uint8_t op) {
+    RegValue b = popValue(translator, path);
+    RegValue a = popValue(translator, path);
+    if (translator->failed || a.type == TYPE_NATIVE || b.type == TYPE_NATIVE) {
+        translator->failed = true;
+        return;
+    }
+
+    RegType type = TYPE_BOOL;
+    switch (op) {
+        case REG_ADD:
+        case REG_SUBTRACT:
+        case REG_MULTIPLY:
+        case REG_DIVIDE:
+        case REG_MOD:
+            // Arithmetic on two bools gives a bool, leave that to the stack VM
+            if (a.type == TYPE_BOOL && b.type == TYPE_BOOL) {
+                translator->failed = true;
+                return;
+            }
+            type = TYPE_NUMBER;
+            break;
+        case REG_EQUAL:
+        case REG_NOT_EQUAL:
+            // Values of different types are never equal
+            if (a.type != b.type) {
+                translator->failed = true;
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    pushValue(translator, path, (RegValue){type, emitRegister(translator, op, a.reg, b.reg, 0), 0});
+}
+
+// Unary operation on the top value
+static void unaryOp(Translator* translator, Path* path, uint8_t op) {
+    RegValue a = popValue(translator, path);
+    if (translator->failed || a.type == TYPE_NATIVE || (op == REG_NEGATE && a.type != TYPE_NUMBER)) {
+        translator->failed = true;
+        return;
+    }
+    RegType type = op == REG_NEGATE ? TYPE_NUMBER : TYPE_BOOL;
+    pushValue(translator, path, (RegValue){type, emitRegister(translator, op, a.reg, 0, 0), 0});
+}
+
+// Call an intrinsic, natives reject anything but numbers
+static void callOp(Translator* translator, Path* path, int argCount) {
+    if (path->count < argCount + 1) {
+        translator->failed = true;
+        return;
+    }
+    RegValue callee = path->stack[path->count - argCount - 1];
+    RegValue* args = &path->stack[path->count - argCount];
+    if (callee.type != TYPE_NATIVE || callee.arity != argCount) {
+        translator->failed = true;
+        return;
+    }
+    for (int arg = 0; arg < argCount; arg++) {
+        if (args[arg].type != TYPE_NUMBER) {
+            translator->failed = true;
+            return;
+        }
+    }
+
+    uint8_t dst = emitRegister(translator, callee.reg, args[0].reg, argCount > 1 ? args[1].reg : 0, 0);
+    path->count -= argCount + 1;
+    pushValue(translator, path, (RegValue){TYPE_NUMBER, dst, 0});
+}
+
+// Leave a copy of path waiting at target
+static void addPending(Translator* translator, int target, Path* path) {
+    if (translator->pendingCount == REG_PENDING_MAX) {
+        translator->failed = true;
+        return;
+    }
+    PendingPath* pending = &translator->pending[translator->pendingCount++];
+    pending->target = target;
+    pending->path = *path;
+}
+
+// Split path on the truthiness of cond
+// The copy that jumps waits at target, path continues with the other outcome
+static void forkPath(Translator* translator, Path* path, uint8_t cond, int target, bool jumpSide, bool popOnFallthrough) {
+    if (translator->forkCount == REG_FORKS_MAX) {
+        translator->failed = true;
+        return;
+    }
+    Fork* fork = &translator->forks[translator->forkCount];
+    fork->parent = path->fork;
+    fork->parentSide = path->side;
+    fork->cond = cond;
+
+    path->fork = translator->forkCount++;
+    path->side = jumpSide;
+    addPending(translator, target, path);
+
+    path->side = !jumpSide;
+    if (popOnFallthrough) {
+        popValue(translator, path);
+    }
+}
+
+// Join the two outcomes of a fork, selecting between values that differ
+static void mergePaths(Translator* translator, Path* whenTrue, Path* whenFalse) {
+    Fork* fork = &translator->forks[whenTrue->fork];
+    if (whenTrue->count != whenFalse->count) {
+        translator->failed = true;
+        return;
+    }
+    for (int slot = 0; slot < whenTrue->count; slot++) {
+        RegValue a = whenTrue->stack[slot];
+        RegValue b = whenFalse->stack[slot];
+        if (a.type != b.type || (a.type == TYPE_NATIVE && a.reg != b.reg)) {
+            translator->failed = true;
+            return;
+        }
+        if (a.reg != b.reg) {
+            whenTrue->stack[slot].reg = emitRegister(translator, REG_SELECT, fork->cond, a.reg, b.reg);
+        }
+    }
+    whenTrue->fork = fork->parent;
+    whenTrue->side = fork->parentSide;
+}
+
+// Join every path waiting at offset into path
+// Returns false if no path reaches offset
+static bool joinPaths(Translator* translator, int offset, Path* path, bool live) {
+    Path paths[REG_PENDING_MAX + 1];
+    int count = 0;
+    if (live) {
+        paths[count++] = *path;
+    }
+    for (int i = 0; i < translator->pendingCount;) {
+        if (translator->pending[i].target == offset) {
+            paths[count++] = translator->pending[i].path;
+            translator->pending[i] = translator->pending[--translator->pendingCount];
+        } else {
+            i++;
+        }
+    }
+    if (count == 0) return false;
+
+    // Expressions only nest conditionals, so there is always a pair from the same fork
+    while (count > 1 && !translator->failed) {
+        bool merged = false;
+        for (int i = 0; i < count && !merged; i++) {
+            for (int j = 0; j < count && !merged; j++) {
+                if (paths[i].fork >= 0 && paths[i].fork == paths[j].fork && paths[i].side && !paths[j].side) {
+                    mergePaths(translator, &paths[i], &paths[j]);
+                    paths[j] = paths[--count];
+                    merged = true;
+                }
+            }
+        }
+        if (!merged) {
+            translator->failed = true;
+        }
+    }
+    *path = paths[0];
+    return true;
+}
+
+// Offset a forward jump lands on
+static int jumpTarget(uint8_t* code, int offset) {
+    return offset + instructionSize(code[0]) + (code[1] << 8 | code[2]);
+}
+
+static uint8_t arithmeticOp(uint8_t instruction) {
+    switch (instruction) {
+        case OP_ADD_CONSTANT: case OP_ADD_LOCAL: case OP_ADD_GLOBAL: return REG_ADD;
+        case OP_SUBTRACT_CONSTANT: case OP_SUBTRACT_LOCAL: case OP_SUBTRACT_GLOBAL: return REG_SUBTRACT;
+        case OP_MULTIPLY_CONSTANT: case OP_MULTIPLY_LOCAL: case OP_MULTIPLY_GLOBAL: return REG_MULTIPLY;
+        default: return REG_DIVIDE;
+    }
+}
+
+static uint8_t compareOp(uint8_t instruction) {
+    switch (instruction) {
+        case OP_GREATER_JUMP: return REG_GREATER;
+        case OP_GREATER_EQUAL_JUMP: return REG_GREATER_EQUAL;
+        case OP_LESS_JUMP: return REG_LESS;
+        default: return REG_LESS_EQUAL;
+    }
+}
+
+bool compileRegisters(VM* vm, RegFunction* function, ObjFunction* source) {
+    Translator translator;
+    translator.vm = vm;
+    translator.function = function;
+    translator.chunk = &source->chunk;
+    translator.failed = false;
+    translator.forkCount = 0;
+    translator.pendingCount = 0;
+    memset(translator.isLoaded, 0, sizeof(translator.isLoaded));
+
+    function->count = 0;
+    function->registerCount = 2;
+    function->wavetable = &vm->wavetable;
+    function->indexStart = 0;
+    function->sampleStart = 0;
+    function->cachedCount = 0;
+    function->indexCache = NULL;
+    function->registers[REG_FRAME] = 0;
+    function->registers[REG_INDEX] = 0;
+
+    Chunk* chunk = &source->chunk;
+    Path path;
+    path.fork = -1;
+    path.side = true;
+    path.count = 0;
+    bool live = true;
+
+    for (int offset = 0; offset < chunk->count && !translator.failed; offset += instructionSize(chunk->code[offset])) {
+        live = joinPaths(&translator, offset, &path, live);
+        // Unreachable
+        if (!live) continue;
+
+        uint8_t* code = &chunk->code[offset];
+        switch (code[0]) {
+            case OP_CONSTANT: loadConstant(&translator, &path, code[1]); break;
+            case OP_GET_GLOBAL: loadGlobal(&translator, &path, code[1]); break;
+            case OP_GET_LOCAL: loadLocal(&translator, &path, code[1]); break;
+            case OP_TRUE: pushValue(&translator, &path, (RegValue){TYPE_BOOL, constantRegister(&translator, 1), 0}); break;
+            case OP_FALSE: pushValue(&translator, &path, (RegValue){TYPE_BOOL, constantRegister(&translator, 0), 0}); break;
+            case OP_POP: popValue(&translator, &path); break;
+
+            case OP_ADD: binaryOp(&translator, &path, REG_ADD); break;
+            case OP_SUBTRACT: binaryOp(&translator, &path, REG_SUBTRACT); break;
+            case OP_MULTIPLY: binaryOp(&translator, &path, REG_MULTIPLY); break;
+            case OP_DIVIDE: binaryOp(&translator, &path, REG_DIVIDE); break;
+            case OP_MOD: binaryOp(&translator, &path, REG_MOD); break;
+            case OP_EQUAL: binaryOp(&translator, &path, REG_EQUAL); break;
+            case OP_NOT_EQUAL: binaryOp(&translator, &path, REG_NOT_EQUAL); break;
+            case OP_GREATER: binaryOp(&translator, &path, REG_GREATER); break;
+            case OP_GREATER_EQUAL: binaryOp(&translator, &path, REG_GREATER_EQUAL); break;
+            case OP_LESS: binaryOp(&translator, &path, REG_LESS); break;
+            case OP_LESS_EQUAL: binaryOp(&translator, &path, REG_LESS_EQUAL); break;
+            case OP_NEGATE: unaryOp(&translator, &path, REG_NEGATE); break;
+            case OP_NOT: unaryOp(&translator, &path, REG_NOT); break;
+
+            // Superinstructions
+            case OP_ADD_CONSTANT:
+            case OP_SUBTRACT_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+            case OP_DIVIDE_CONSTANT:
+                loadConstant(&translator, &path, code[1]);
+                binaryOp(&translator, &path, arithmeticOp(code[0]));
+                break;
+            case OP_ADD_LOCAL:
+            case OP_SUBTRACT_LOCAL:
+            case OP_MULTIPLY_LOCAL:
+            case OP_DIVIDE_LOCAL:
+                loadLocal(&translator, &path, code[1]);
+                binaryOp(&translator, &path, arithmeticOp(code[0]));
+                break;
+            case OP_ADD_GLOBAL:
+            case OP_SUBTRACT_GLOBAL:
+            case OP_MULTIPLY_GLOBAL:
+            case OP_DIVIDE_GLOBAL:
+                loadGlobal(&translator, &path, code[1]);
+                binaryOp(&translator, &path, arithmeticOp(code[0]));
+                break;
+            case OP_GREATER_JUMP:
+            case OP_GREATER_EQUAL_JUMP:
+            case OP_LESS_JUMP:
+            case OP_LESS_EQUAL_JUMP:
+                binaryOp(&translator, &path, compareOp(code[0]));
+                if (!translator.failed) {
+                    forkPath(&translator, &path, path.stack[path.count - 1].reg, jumpTarget(code, offset), false, true);
+                }
+                break;
+
+            // Control flow, conditionals only jump forward
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE: {
+                if (path.count == 0 || path.stack[path.count - 1].type == TYPE_NATIVE) {
+                    translator.failed = true;
+                    break;
+                }
+                forkPath(&translator, &path, path.stack[path.count - 1].reg, jumpTarget(code, offset), code[0] == OP_JUMP_IF_TRUE, false);
+                break;
+            }
+            case OP_JUMP:
+                addPending(&translator, jumpTarget(code, offset), &path);
+                live = false;
+                break;
+
+            case OP_CALL: callOp(&translator, &path, code[1]); break;
+
+            // Result of the function
+            case OP_EXTRACT: {
+                RegValue result = popValue(&translator, &path);
+                if (translator.failed || result.type != TYPE_NUMBER || translator.pendingCount != 0) {
+                    return false;
+                }
+                function->result = result.reg;
+                hoistRegisters(function);
+#ifdef DEBUG_PRINT_CODE
+                disassembleRegisters(function, "<registers>");
+#endif
+                return true;
+            }
+
+            // Strings, assignments, user functions, loops, etc.
+            default:
+                translator.failed = true;
+                break;
+        }
+    }
+    return false;
+}
+
+/*
+    --------------
+    REGISTER VM
+    --------------
+*/
+
+// Same as the saw native
+double sawIntrinsic(double value) {
+    return 1 - 2 * fmod(value, 1);
+}
+
+// Run one instruction on a scalar register file
+static inline void runInstruction(RegFunction* function, RegInstruction* ip, double* registers) {
+#define A (registers[ip->a])
+#define B (registers[ip->b])
+#define C (registers[ip->c])
+#define DST (registers[ip->dst])
+    switch (ip->op) {
+        case REG_ADD:           DST = A + B; break;
+        case REG_SUBTRACT:      DST = A - B; break;
+        case REG_MULTIPLY:      DST = A * B; break;
+        case REG_DIVIDE:        DST = A / B; break;
+        case REG_MOD:           DST = fmod(A, B); break;
+        case REG_NEGATE:        DST = -A; break;
+        case REG_NOT:           DST = A == 0; break;
+        case REG_EQUAL:         DST = A == B; break;
+        case REG_NOT_EQUAL:     DST = A != B; break;
+        case REG_GREATER:       DST = A > B; break;
+        case REG_GREATER_EQUAL: DST = A >= B; break;
+        case REG_LESS:          DST = A < B; break;
+        case REG_LESS_EQUAL:    DST = A <= B; break;
+        case REG_SELECT:        DST = A != 0 ? B : C; break;
+        // Intrinsics
+        case REG_SIN:           DST = sin(A); break;
+        case REG_COS:           DST = cos(A); break;
+        case REG_TAN:           DST = tan(A); break;
+        case REG_ASIN:          DST = asin(A); break;
+        case REG_ACOS:          DST = acos(A); break;
+        case REG_ATAN:          DST = atan(A); break;
+        case REG_SQRT:          DST = sqrt(A); break;
+        case REG_FLOOR:         DST = floor(A); break;
+        case REG_CEIL:          DST = ceil(A); break;
+        case REG_ROUND:         DST = round(A); break;
+        case REG_SAW:           DST = sawIntrinsic(A); break;
+        case REG_POW:           DST = pow(A, B); break;
+        case REG_ATAN2:         DST = atan2(A, B); break;
+        case REG_MAIN_T:        DST = readTimeBuffer(function->wavetable->main_time, A, B); break;
+        case REG_AUX1_T:        DST = readTimeBuffer(function->wavetable->aux1_time, A, B); break;
+    }
+#undef A
+#undef B
+#undef C
+#undef DST
+}
+
+void beginFrameRegisters(RegFunction* function, double* registers, int frame) {
+    memcpy(registers, function->registers, sizeof(double) * function->registerCount);
+    registers[REG_FRAME] = frame;
+    for (int offset = 0; offset < function->indexStart; offset++) {
+        runInstruction(function, &function->code[offset], registers);
+    }
+}
+
+void loadIndexRegisters(RegFunction* function, double* registers, int index) {
+    registers[REG_INDEX] = index;
+    for (int cached = 0; cached < function->cachedCount; cached++) {
+        registers[function->cached[cached]] = function->indexCache[cached * INDEX_CACHE_ROW + index];
+    }
+}
+
+void runRegisters(RegFunction* function, int frame, int minIndex, int maxIndex, double* out) {
+    double registers[REGISTERS_MAX];
+    beginFrameRegisters(function, registers, frame);
+
+    RegInstruction* start = function->code + function->sampleStart;
+    RegInstruction* end = function->code + function->count;
+    for (int index = minIndex; index < maxIndex; index++) {
+        loadIndexRegisters(function, registers, index);
+        for (RegInstruction* ip = start; ip < end; ip++) {
+            runInstruction(function, ip, registers);
+        }
+        out[index] = registers[function->result];
+    }
+}
+
+/*
+    -------
+    HOISTING
+    -------
+*/
+
+// What a register depends on, bit flags
+#define DEPENDS_FRAME 1
+#define DEPENDS_INDEX 2
+#define DEPENDS_SAMPLE (DEPENDS_FRAME | DEPENDS_INDEX)
+
+// Number of registers an op reads
+static int operandCount(uint8_t op) {
+    switch (op) {
+        case REG_NEGATE:
+        case REG_NOT:
+        case REG_SIN:
+        case REG_COS:
+        case REG_TAN:
+        case REG_ASIN:
+        case REG_ACOS:
+        case REG_ATAN:
+        case REG_SQRT:
+        case REG_FLOOR:
+        case REG_CEIL:
+        case REG_ROUND:
+        case REG_SAW:
+            return 1;
+        case REG_SELECT:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+void hoistRegisters(RegFunction* function) {
+    uint8_t depends[REGISTERS_MAX] = {0};
+    depends[REG_FRAME] = DEPENDS_FRAME;
+    depends[REG_INDEX] = DEPENDS_INDEX;
+
+    RegInstruction frameCode[REG_CODE_MAX];
+    RegInstruction indexCode[REG_CODE_MAX];
+    RegInstruction sampleCode[REG_CODE_MAX];
+    int frameCount = 0, indexCount = 0, sampleCount = 0;
+
+    for (int offset = 0; offset < function->count; offset++) {
+        RegInstruction* instruction = &function->code[offset];
+        uint8_t operands[3] = {instruction->a, instruction->b, instruction->c};
+        uint8_t depend = 0;
+        for (int operand = 0; operand < operandCount(instruction->op); operand++) {
+            depend |= depends[operands[operand]];
+        }
+        // The buffer being edited changes from sample to sample
+        if (instruction->op == REG_MAIN_T || instruction->op == REG_AUX1_T) {
+            depend = DEPENDS_SAMPLE;
+        }
+        depends[instruction->dst] = depend;
+
+        switch (depend) {
+            // Constant, computed once now
+            case 0: runInstruction(function, instruction, function->registers); break;
+            case DEPENDS_FRAME: frameCode[frameCount++] = *instruction; break;
+            case DEPENDS_INDEX: indexCode[indexCount++] = *instruction; break;
+            default: sampleCode[sampleCount++] = *instruction; break;
+        }
+    }
+
+    // Lay the code out as frame, index then sample segments
+    memcpy(function->code, frameCode, sizeof(RegInstruction) * frameCount);
+    memcpy(function->code + frameCount, indexCode, sizeof(RegInstruction) * indexCount);
+    memcpy(function->code + frameCount + indexCount, sampleCode, sizeof(RegInstruction) * sampleCount);
+    function->indexStart = frameCount;
+    function->sampleStart = frameCount + indexCount;
+    function->count = frameCount + indexCount + sampleCount;
+
+    // Cache index-only values used per sample
+    bool used[REGISTERS_MAX] = {false};
+    used[function->result] = true;
+    for (int offset = function->sampleStart; offset < function->count; offset++) {
+        RegInstruction* instruction = &function->code[offset];
+        uint8_t operands[3] = {instruction->a, instruction->b, instruction->c};
+        for (int operand = 0; operand < operandCount(instruction->op); operand++) {
+            used[operands[operand]] = true;
+        }
+    }
+    function->cachedCount = 0;
+    for (int offset = function->indexStart; offset < function->sampleStart; offset++) {
+        uint8_t dst = function->code[offset].dst;
+        if (used[dst]) {
+            function->cached[function->cachedCount++] = dst;
+        }
+    }
+}
+
+void cacheIndexRegisters(RegFunction* function, int minIndex, int maxIndex) {
+    if (function->cachedCount == 0) return;
+    function->indexCache = ALLOCATE(double, function->cachedCount * INDEX_CACHE_ROW);
+    // Read by the spare lane only, its result is never stored
+    for (int cached = 0; cached < function->cachedCount; cached++) {
+        function->indexCache[cached * INDEX_CACHE_ROW + WAVETABLE_FRAME_LEN] = 0;
+    }
+
+    double registers[REGISTERS_MAX];
+    memcpy(registers, function->registers, sizeof(double) * function->registerCount);
+    for (int index = minIndex; index < maxIndex; index++) {
+        registers[REG_INDEX] = index;
+        for (int offset = function->indexStart; offset < function->sampleStart; offset++) {
+            runInstruction(function, &function->code[offset], registers);
+        }
+        for (int cached = 0; cached < function->cachedCount; cached++) {
+            function->indexCache[cached * INDEX_CACHE_ROW + index] = registers[function->cached[cached]];
+        }
+    }
+}
+
+void freeRegisters(RegFunction* function) {
+    if (function->indexCache != NULL) {
+        FREE_ARRAY(double, function->indexCache, function->cachedCount * INDEX_CACHE_ROW);
+        function->indexCache = NULL;
+    }
+}
+
+#undef DEPENDS_FRAME
+#undef DEPENDS_INDEX
+#undef DEPENDS_SAMPLE
+
+/*
+    ---------
+    VECTOR VM
+    ---------
+*/
+
+bool readsOtherSamples(RegFunction* function, uint8_t op) {
+    for (int offset = 0; offset < function->count; offset++) {
+        RegInstruction* instruction = &function->code[offset];
+        if (instruction->op == op && (instruction->a != REG_FRAME || instruction->b != REG_INDEX)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef REG_SIMD
+// Two lanes at a time, count is always even
+#define VECTOR_BINARY(simd, scalar) \
+    for (int i = 0; i < count; i += 2) \
+        _mm_storeu_pd(dst + i, simd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)))
+#define VECTOR_COMPARE(simd, scalar) \
+    for (int i = 0; i < count; i += 2) \
+        _mm_storeu_pd(dst + i, _mm_and_pd(simd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)), _mm_set1_pd(1)))
+#else
+#define VECTOR_BINARY(simd, scalar) \
+    for (int i = 0; i < count; i++) dst[i] = a[i] scalar b[i]
+#define VECTOR_COMPARE(simd, scalar) \
+    for (int i = 0; i < count; i++) dst[i] = a[i] scalar b[i]
+#endif
+#define VECTOR_UNARY_CALL(function) \
+    for (int i = 0; i < count; i++) dst[i] = function(a[i])
+#define VECTOR_BINARY_CALL(function) \
+    for (int i = 0; i < count; i++) dst[i] = function(a[i], b[i])
+
+// Run one instruction over count lanes
+static void runVectorInstruction(RegFunction* function, RegInstruction* instruction, double** lanes, int count) {
+    double* dst = lanes[instruction->dst];
+    const double* a = lanes[instruction->a];
+    const double* b = lanes[instruction->b];
+    const double* c = lanes[instruction->c];
+
+    switch (instruction->op) {
+        case REG_ADD:           VECTOR_BINARY(_mm_add_pd, +); break;
+        case REG_SUBTRACT:      VECTOR_BINARY(_mm_sub_pd, -); break;
+        case REG_MULTIPLY:      VECTOR_BINARY(_mm_mul_pd, *); break;
+        case REG_DIVIDE:        VECTOR_BINARY(_mm_div_pd, /); break;
+        case REG_MOD:           VECTOR_BINARY_CALL(fmod); break;
+        case REG_EQUAL:         VECTOR_COMPARE(_mm_cmpeq_pd, ==); break;
+        case REG_NOT_EQUAL:     VECTOR_COMPARE(_mm_cmpneq_pd, !=); break;
+        case REG_GREATER:       VECTOR_COMPARE(_mm_cmpgt_pd, >); break;
+        case REG_GREATER_EQUAL: VECTOR_COMPARE(_mm_cmpge_pd, >=); break;
+        case REG_LESS:          VECTOR_COMPARE(_mm_cmplt_pd, <); break;
+        case REG_LESS_EQUAL:    VECTOR_COMPARE(_mm_cmple_pd, <=); break;
+#ifdef REG_SIMD
+        case REG_NEGATE:
+            for (int i = 0; i < count; i += 2)
+                _mm_storeu_pd(dst + i, _mm_xor_pd(_mm_loadu_pd(a + i), _mm_set1_pd(-0.0)));
+            break;
+        case REG_NOT:
+            for (int i = 0; i < count; i += 2)
+                _mm_storeu_pd(dst + i, _mm_and_pd(_mm_cmpeq_pd(_mm_loadu_pd(a + i), _mm_setzero_pd()), _mm_set1_pd(1)));
+            break;
+        case REG_SELECT:
+            // NaN conditions are true, same as cmpneq
+            for (int i = 0; i < count; i += 2) {
+                __m128d mask = _mm_cmpneq_pd(_mm_loadu_pd(a + i), _mm_setzero_pd());
+                _mm_storeu_pd(dst + i, _mm_or_pd(_mm_and_pd(mask, _mm_loadu_pd(b + i)), _mm_andnot_pd(mask, _mm_loadu_pd(c + i))));
+            }
+            break;
+#else
+        case REG_NEGATE:        for (int i = 0; i < count; i++) dst[i] = -a[i]; break;
+        case REG_NOT:           for (int i = 0; i < count; i++) dst[i] = a[i] == 0; break;
+        case REG_SELECT:        for (int i = 0; i < count; i++) dst[i] = a[i] != 0 ? b[i] : c[i]; break;
+#endif
+        // Intrinsics call libm per lane, so results match the scalar tiers exactly
+        case REG_SIN:           VECTOR_UNARY_CALL(sin); break;
+        case REG_COS:           VECTOR_UNARY_CALL(cos); break;
+        case REG_TAN:           VECTOR_UNARY_CALL(tan); break;
+        case REG_ASIN:          VECTOR_UNARY_CALL(asin); break;
+        case REG_ACOS:          VECTOR_UNARY_CALL(acos); break;
+        case REG_ATAN:          VECTOR_UNARY_CALL(atan); break;
+        case REG_SQRT:          VECTOR_UNARY_CALL(sqrt); break;
+        case REG_FLOOR:         VECTOR_UNARY_CALL(floor); break;
+        case REG_CEIL:          VECTOR_UNARY_CALL(ceil); break;
+        case REG_ROUND:         VECTOR_UNARY_CALL(round); break;
+        case REG_SAW:           VECTOR_UNARY_CALL(sawIntrinsic); break;
+        case REG_POW:           VECTOR_BINARY_CALL(pow); break;
+        case REG_ATAN2:         VECTOR_BINARY_CALL(atan2); break;
+        case REG_MAIN_T:
+            for (int i = 0; i < count; i++) dst[i] = readTimeBuffer(function->wavetable->main_time, a[i], b[i]);
+            break;
+        case REG_AUX1_T:
+            for (int i = 0; i < count; i++) dst[i] = readTimeBuffer(function->wavetable->aux1_time, a[i], b[i]);
+            break;
+    }
+}
+
+void runRegistersVector(RegFunction* function, RegVector* vectors, int frame, int minIndex, int maxIndex, double* out) {
+    // Lanes of each register, cached index-only registers read straight from the cache
+    double* lanes[REGISTERS_MAX];
+
+    // Broadcast constants and frame-only values
+    double registers[REGISTERS_MAX];
+    beginFrameRegisters(function, registers, frame);
+    bool written[REGISTERS_MAX] = {false};
+    for (int offset = function->indexStart; offset < function->count; offset++) {
+        written[function->code[offset].dst] = true;
+    }
+    for (int reg = 0; reg < function->registerCount; reg++) {
+        lanes[reg] = vectors[reg];
+        if (!written[reg] && reg != REG_INDEX) {
+            for (int lane = 0; lane < REG_VECTOR_LEN; lane++) {
+                vectors[reg][lane] = registers[reg];
+            }
+        }
+    }
+
+    for (int blockStart = minIndex; blockStart < maxIndex; blockStart += REG_VECTOR_LEN) {
+        int length = maxIndex - blockStart < REG_VECTOR_LEN ? maxIndex - blockStart : REG_VECTOR_LEN;
+        // Spare lanes of the last block compute junk that is never stored
+        int count = (length + 1) & ~1;
+        for (int lane = 0; lane < count; lane++) {
+            vectors[REG_INDEX][lane] = blockStart + lane;
+        }
+        for (int reg = 0; reg < function->cachedCount; reg++) {
+            lanes[function->cached[reg]] = function->indexCache + reg * INDEX_CACHE_ROW + blockStart;
+        }
+
+        for (int offset = function->sampleStart; offset < function->count; offset++) {
+            runVectorInstruction(function, &function->code[offset], lanes, count);
+        }
+        memcpy(out + blockStart, lanes[function->result], sizeof(double) * length);
+    }
+}
+
+#undef VECTOR_BINARY
+#undef VECTOR_COMPARE
+#undef VECTOR_UNARY_CALL
+#undef VECTOR_BINARY_CALL
\ No newline at end of file
@@ -0,0 +1,112 @@
+#ifndef cave_regvm_h
+#define cave_regvm_h
+
+#include "common.h"
+#include "object.h"
+
+#include "Wavetable/wavetable.h"
+
+// Register file size, frame and index are always the first two registers
+#define REGISTERS_MAX 256
+// Max instructions in a register function
+#define REG_CODE_MAX 256
+
+#define REG_FRAME 0
+#define REG_INDEX 1
+
+// Indexes the vector VM runs each instruction over at once
+// Small enough that the vectors of a typical function stay in L1 cache
+#define REG_VECTOR_LEN 128
+
+// Three-address operations over the register file
+// Conditionals are if-converted into REG_SELECT, so register code never branches
+typedef enum {
+    REG_ADD, // dst = a + b
+    REG_SUBTRACT, // dst = a - b
+    REG_MULTIPLY, // dst = a * b
+    REG_DIVIDE, // dst = a / b
+    REG_MOD, // dst = fmod(a, b)
+    REG_NEGATE, // dst = -a
+    REG_NOT, // dst = !a
+    REG_EQUAL, // dst = a == b
+    REG_NOT_EQUAL, // dst = a != b
+    REG_GREATER, // dst = a > b
+    REG_GREATER_EQUAL, // dst = a >= b
+    REG_LESS, // dst = a < b
+    REG_LESS_EQUAL, // dst = a <= b
+    REG_SELECT, // dst = a ? b : c
+
+    // Intrinsics, same results as the native functions they replace
+    REG_SIN, // dst = sin(a)
+    REG_COS, // dst = cos(a)
+    REG_TAN, // dst = tan(a)
+    REG_ASIN, // dst = asin(a)
+    REG_ACOS, // dst = acos(a)
+    REG_ATAN, // dst = atan(a)
+    REG_SQRT, // dst = sqrt(a)
+    REG_FLOOR, // dst = floor(a)
+    REG_CEIL, // dst = ceil(a)
+    REG_ROUND, // dst = round(a)
+    REG_SAW, // dst = saw(a)
+    REG_POW, // dst = pow(a, b)
+    REG_ATAN2, // dst = atan2(a, b)
+    REG_MAIN_T, // dst = main_t(a, b)
+    REG_AUX1_T, // dst = aux1_t(a, b)
+} RegOpCode;
+
+typedef struct {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+} RegInstruction;
+
+// A runtime compiled wave function translated for the register tier
+typedef struct {
+    int count;
+    RegInstruction code[REG_CODE_MAX];
+    int registerCount;
+    uint8_t result;
+    // Initial register file, holds the constants and globals the function reads
+    double registers[REGISTERS_MAX];
+    // Buffers main_t and aux1_t read
+    Wavetable* wavetable;
+
+    // After hoisting, code is laid out as [frame only, index only, per sample]
+    int indexStart;
+    int sampleStart;
+    // Index-only registers read per sample, cached for every index of the edit
+    int cachedCount;
+    uint8_t cached[REGISTERS_MAX];
+    double* indexCache;
+} RegFunction;
+
+// Vector register, one value per index of a block
+typedef double RegVector[REG_VECTOR_LEN];
+
+// Translate a runtime compiled function into register code
+// Returns false if it uses anything only the stack VM can run
+bool compileRegisters(VM* vm, RegFunction* function, ObjFunction* source);
+// Fold constant code into the initial register file and move frame-only and index-only code out of the sample loop
+void hoistRegisters(RegFunction* function);
+// Compute the cached index-only registers for [minIndex, maxIndex), once per edit
+void cacheIndexRegisters(RegFunction* function, int minIndex, int maxIndex);
+void freeRegisters(RegFunction* function);
+// Load the initial register file and run the frame-only code
+void beginFrameRegisters(RegFunction* function, double* registers, int frame);
+// Set the index and its cached registers
+void loadIndexRegisters(RegFunction* function, double* registers, int index);
+// Run the function for every index in [minIndex, maxIndex) of a frame
+// Each result is stored in out[index] before the next index runs
+void runRegisters(RegFunction* function, int frame, int minIndex, int maxIndex, double* out);
+// Same as runRegisters, running each instruction over a block of indexes at a time
+// vectors must hold function->registerCount vectors
+void runRegistersVector(RegFunction* function, RegVector* vectors, int frame, int minIndex, int maxIndex, double* out);
+// True if the function reads the buffer of op (REG_MAIN_T or REG_AUX1_T) anywhere but at (frame, index)
+// Results of earlier indexes would not be in the buffer yet in the vector VM
+bool readsOtherSamples(RegFunction* function, uint8_t op);
+// REG_SAW
+double sawIntrinsic(double value);
+
+#endif
\ No newline at end of file
@@ -4,9 +4,87 @@
 #include "common.h"
 #include "scanner.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCANNER_SIMD
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Bytes skipped per step over runs of spaces and identifier characters
+#define SCAN_BLOCK 16
+// Length of a run checked one character at a time before switching to blocks
+#define SCAN_SHORT 8
+
+// Character classes
+#define CHAR_ALPHA 0x01 // Letters and '_'
+#define CHAR_DIGIT 0x02
+#define CHAR_SPACE 0x04 // Space, tab and carriage return, newlines are counted on their own
+
+#define A CHAR_ALPHA
+#define D CHAR_DIGIT
+#define S CHAR_SPACE
+// Class of every byte, anything past ASCII is in none
+static const uint8_t charClasses[UINT8_COUNT] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, S, 0, 0, 0, S, 0, 0, // control characters, tab and carriage return
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // control characters
+    S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // space to '/'
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0, // '0' to '?'
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, // '@' to 'O'
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A, // 'P' to '_'
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, // '`' to 'o'
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0, // 'p' to DEL
+};
+#undef A
+#undef D
+#undef S
+
+// Keywords sit at distinct slots by their first letter, last letter and length
+#define KEYWORD_SLOTS 64
+#define KEYWORD_HASH(first, last, length) (((first) * 7 + (last) * 2 + (length)) & (KEYWORD_SLOTS - 1))
+
+typedef struct {
+    const char* name;
+    int length;
+    TokenType type;
+} Keyword;
+
+#define KEYWORD(name, first, last, type) [KEYWORD_HASH(first, last, sizeof(name) - 1)] = {name, sizeof(name) - 1, type}
+static const Keyword keywords[KEYWORD_SLOTS] = {
+    KEYWORD("and", 'a', 'd', TOKEN_AND),
+    KEYWORD("break", 'b', 'k', TOKEN_BREAK),
+    KEYWORD("case", 'c', 'e', TOKEN_CASE),
+    KEYWORD("class", 'c', 's', TOKEN_CLASS),
+    KEYWORD("continue", 'c', 'e', TOKEN_CONTINUE),
+    KEYWORD("default", 'd', 't', TOKEN_DEFAULT),
+    KEYWORD("del", 'd', 'l', TOKEN_DEL),
+    KEYWORD("do", 'd', 'o', TOKEN_DO),
+    KEYWORD("elif", 'e', 'f', TOKEN_ELIF),
+    KEYWORD("else", 'e', 'e', TOKEN_ELSE),
+    KEYWORD("false", 'f', 'e', TOKEN_FALSE),
+    KEYWORD("for", 'f', 'r', TOKEN_FOR),
+    KEYWORD("fun", 'f', 'n', TOKEN_FUN),
+    KEYWORD("if", 'i', 'f', TOKEN_IF),
+    KEYWORD("import", 'i', 't', TOKEN_IMPORT),
+    KEYWORD("nil", 'n', 'l', TOKEN_NIL),
+    KEYWORD("or", 'o', 'r', TOKEN_OR),
+    KEYWORD("print", 'p', 't', TOKEN_PRINT),
+    KEYWORD("return", 'r', 'n', TOKEN_RETURN),
+    KEYWORD("super", 's', 'r', TOKEN_SUPER),
+    KEYWORD("switch", 's', 'h', TOKEN_SWITCH),
+    KEYWORD("this", 't', 's', TOKEN_THIS),
+    KEYWORD("true", 't', 'e', TOKEN_TRUE),
+    KEYWORD("var", 'v', 'r', TOKEN_VAR),
+    KEYWORD("while", 'w', 'e', TOKEN_WHILE),
+};
+#undef KEYWORD
+
 void initScanner(Scanner* scanner, const char* source) {
     scanner->start = source;
     scanner->current = source;
+    scanner->end = source + strlen(source);
     scanner->line = 1;
     scanner->str_depth = 0;
     scanner->in_str = false;
@@ -19,14 +97,94 @@ static bool isAtEnd(const char* current) {
 
 // Returns true if char c is a letter
 static bool isAlpha(char c) {
-    return (c >= 'a' && c <= 'z') ||
-           (c >= 'A' && c <= 'Z') ||
-            c == '_';
+    return charClasses[(uint8_t)c] & CHAR_ALPHA;
 }
 
 // Returns true if char c is a number
 static bool isDigit(char c) {
-    return c >= '0' && c <= '9';    
+    return charClasses[(uint8_t)c] & CHAR_DIGIT;
+}
+
+#ifdef SCANNER_SIMD
+// Index of the lowest set bit of a non-zero mask
+static inline int lowestBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return (int)bit;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Bit i is set if byte i is in charClass, only spaces and identifier characters are matched
+static inline uint32_t matchClass(__m128i bytes, uint8_t charClass) {
+    __m128i matched;
+    if (charClass == CHAR_SPACE) {
+        matched = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+    } else {
+        // Unsigned x - low <= high - low is a range check, lowering case with 0x20 only maps letters onto letters
+        __m128i letter = _mm_sub_epi8(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        __m128i digit = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+        matched = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8('z' - 'a')), letter),
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'))));
+    }
+    return (uint32_t)_mm_movemask_epi8(matched);
+}
+#endif
+
+// Consumes the run of characters in charClass
+// Most runs are a few characters, longer ones are checked a block at a time while blocks fit before the end of the source
+static void skipClass(Scanner* scanner, uint8_t charClass) {
+    const char* current = scanner->current;
+    for (const char* shortEnd = current + SCAN_SHORT; current < shortEnd; current++) {
+        if (!(charClasses[(uint8_t)*current] & charClass)) {
+            scanner->current = current;
+            return;
+        }
+    }
+#ifdef SCANNER_SIMD
+    while (scanner->end - current >= SCAN_BLOCK) {
+        uint32_t stops = ~matchClass(_mm_loadu_si128((const __m128i*)current), charClass) & 0xFFFF;
+        if (stops != 0) {
+            scanner->current = current + lowestBit(stops);
+            return;
+        }
+        current += SCAN_BLOCK;
+    }
+#endif
+    while (charClasses[(uint8_t)*current] & charClass) current++;
+    scanner->current = current;
+}
+
+// Consumes string text up to a quote, '$', newline or the end of the source
+static void skipText(Scanner* scanner) {
+    const char* current = scanner->current;
+#ifdef SCANNER_SIMD
+    while (scanner->end - current >= SCAN_BLOCK) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)current);
+        __m128i stops = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\"')),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('$')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(stops);
+        if (mask != 0) {
+            scanner->current = current + lowestBit(mask);
+            return;
+        }
+        current += SCAN_BLOCK;
+    }
+#endif
+    while (*current != '\"' && *current != '$' && *current != '\n' && *current != '\0') current++;
+    scanner->current = current;
+}
+
+// Number of newlines from start up to stop
+static int countLines(const char* start, const char* stop) {
+    int lines = 0;
+    for (const char* newline = memchr(start, '\n', stop - start); newline != NULL; newline = memchr(newline + 1, '\n', stop - newline - 1)) {
+        lines++;
+    }
+    return lines;
 }
 
 // Consumes current character
@@ -94,7 +252,7 @@ static void skipWhitespace(Scanner* scanner) {
             case ' ':
             case '\r':
             case '\t':
-                advance(scanner);
+                skipClass(scanner, CHAR_SPACE);
                 break;
             
             // Keep track of line
@@ -106,15 +264,20 @@ static void skipWhitespace(Scanner* scanner) {
             // Look for comments
             case '/':
                 if (peekNext(scanner) == '/') { // Single line comment
-                    while (peek(scanner) != '\n' && !isAtEnd(scanner->current)) advance(scanner);
+                    const char* newline = memchr(scanner->current, '\n', scanner->end - scanner->current);
+                    scanner->current = newline != NULL ? newline : scanner->end;
                 } else if (peekNext(scanner) == '*') { // Multi line comment
-                    while (!isAtEnd(scanner->current) && (peek(scanner) != '*' || peekNext(scanner) != '/')) {
-                        if (peek(scanner) == '\n') scanner->line++;
-                        advance(scanner);
+                    // Jump from star to star, counting the lines passed
+                    for (;;) {
+                        const char* star = memchr(scanner->current, '*', scanner->end - scanner->current);
+                        const char* stop = star != NULL ? star : scanner->end;
+                        scanner->line += countLines(scanner->current, stop);
+                        scanner->current = stop;
+                        if (star == NULL || star[1] == '/') break;
+                        scanner->current++;
                     }
                     // Consume "*/"
-                    advance(scanner);
-                    advance(scanner);
+                    if (!isAtEnd(scanner->current)) scanner->current += 2;
                 } else {
                     return;
                 }
@@ -127,90 +290,20 @@ static void skipWhitespace(Scanner* scanner) {
     }
 }
 
-// Checks for keyword
-static TokenType checkKeyword(const char* checkStart, const char* checkCurrent, int start, int length, const char* rest, TokenType type) {
-    if (checkCurrent - checkStart == start + length && memcmp(checkStart + start, rest, length) == 0) {
-        return type;
-    }
-
-    return TOKEN_IDENTIFIER;
-}
-
 // Determine correct type of identifier/keyword
 static TokenType identifierType(Scanner* scanner) {
-    // Check if token is a keywords
-    switch (scanner->start[0]) {
-        case 'a': return checkKeyword(scanner->start, scanner->current, 1, 2, "nd", TOKEN_AND);
-        case 'b': return checkKeyword(scanner->start, scanner->current, 1, 4, "reak", TOKEN_BREAK);
-        case 'c':
-            if (scanner->current - scanner->start > 1) {
-                switch (scanner->start[1]) {
-                    case 'a': return checkKeyword(scanner->start, scanner->current, 2, 2, "se", TOKEN_CASE);
-                    case 'l': return checkKeyword(scanner->start, scanner->current, 2, 3, "ass", TOKEN_CLASS);
-                    case 'o': return checkKeyword(scanner->start, scanner->current, 2, 6, "ntinue", TOKEN_CONTINUE);
-                }
-            }
-            break;
-        case 'd':
-            if (scanner->current - scanner->start > 1) {
-                switch (scanner->start[1]) {
-                    case 'e': if (scanner->current - scanner->start > 2) {
-                        switch (scanner->start[2]) {
-                            case 'f': return checkKeyword(scanner->start, scanner->current, 3, 4, "ault", TOKEN_DEFAULT);
-                            case 'l': return checkKeyword(scanner->start, scanner->current, 3, 0, "", TOKEN_DEL);
-                        }
-                    }
-                    case 'o': return checkKeyword(scanner->start, scanner->current, 2, 0, "", TOKEN_DO);
-                }
-            }
-        case 'e':
-            if (scanner->current - scanner->start > 2 && scanner->start[1] == 'l') {
-                switch (scanner->start[2]) {
-                    case 'i': return checkKeyword(scanner->start, scanner->current, 3, 1, "f", TOKEN_ELIF);
-                    case 's': return checkKeyword(scanner->start, scanner->current, 3, 1, "e", TOKEN_ELSE);
-                }
-            }
-            break;
-        case 'f':
-            if (scanner->current - scanner->start > 1) {
-                switch (scanner->start[1]) {
-                    case 'a': return checkKeyword(scanner->start, scanner->current, 2, 3, "lse", TOKEN_FALSE);
-                    case 'o': return checkKeyword(scanner->start, scanner->current, 2, 1, "r", TOKEN_FOR);
-                    case 'u': return checkKeyword(scanner->start, scanner->current, 2, 1, "n", TOKEN_FUN);
-                }
-            }
-            break;
-        case 'i': return checkKeyword(scanner->start, scanner->current, 1, 1, "f", TOKEN_IF);
-        case 'n': return checkKeyword(scanner->start, scanner->current, 1, 2, "il", TOKEN_NIL);
-        case 'o': return checkKeyword(scanner->start, scanner->current, 1, 1, "r", TOKEN_OR);
-        case 'p': return checkKeyword(scanner->start, scanner->current, 1, 4, "rint", TOKEN_PRINT);
-        case 'r': return checkKeyword(scanner->start, scanner->current, 1, 5, "eturn", TOKEN_RETURN);
-        case 's': 
-            if (scanner->current - scanner->start > 1) {
-                switch (scanner->start[1]) {
-                    case 'w': return checkKeyword(scanner->start, scanner->current, 2, 4, "itch", TOKEN_SWITCH);
-                    case 'u': return checkKeyword(scanner->start, scanner->current, 2, 3, "per", TOKEN_SUPER);
-                }
-            }
-            break;
-        case 't':
-            if (scanner->current - scanner->start > 1) {
-                switch (scanner->start[1]) {
-                    case 'h': return checkKeyword(scanner->start, scanner->current, 2, 2, "is", TOKEN_THIS);
-                    case 'r': return checkKeyword(scanner->start, scanner->current, 2, 2, "ue", TOKEN_TRUE);
-                }
-            }
-            break;
-        case 'v': return checkKeyword(scanner->start, scanner->current, 1, 2, "ar", TOKEN_VAR);
-        case 'w': return checkKeyword(scanner->start, scanner->current, 1, 4, "hile", TOKEN_WHILE);
+    int length = (int)(scanner->current - scanner->start);
+    const Keyword* keyword = &keywords[KEYWORD_HASH((uint8_t)scanner->start[0], (uint8_t)scanner->current[-1], length)];
+    if (keyword->length == length && memcmp(scanner->start, keyword->name, length) == 0) {
+        return keyword->type;
     }
-    // Fell through, must be a variable name
+    // Must be a variable name
     return TOKEN_IDENTIFIER;
 }
 
 // Create a identifier token or keyword token from source code
 static Token identifier(Scanner* scanner) {
-    while (isAlpha(peek(scanner)) || isDigit(peek(scanner))) advance(scanner);
+    skipClass(scanner, CHAR_ALPHA | CHAR_DIGIT);
     return makeToken(scanner, identifierType(scanner));
 }
 
@@ -243,8 +336,13 @@ static Token number(Scanner* scanner) {
 
 // Extracts a string from source code
 static Token string(Scanner* scanner) {
-    while (peek(scanner) != '\"' && !isAtEnd(scanner->current) && (peek(scanner) != '$' || peekNext(scanner) != '{')) {
-        if (peek(scanner) == '\n') scanner->line++;
+    for (;;) {
+        skipText(scanner);
+        if (peek(scanner) == '\n') {
+            scanner->line++;
+        } else if (peek(scanner) != '$' || peekNext(scanner) == '{') {
+            break;
+        }
         advance(scanner);
     }
 
@@ -35,7 +35,7 @@ typedef enum {
 
     // Keywords
     TOKEN_AND, TOKEN_BREAK, TOKEN_CASE, TOKEN_CLASS, TOKEN_CONTINUE, TOKEN_DEFAULT, TOKEN_DEL, TOKEN_DO,
-    TOKEN_ELIF, TOKEN_ELSE, TOKEN_FALSE, TOKEN_FOR, TOKEN_FUN, TOKEN_IF,
+    TOKEN_ELIF, TOKEN_ELSE, TOKEN_FALSE, TOKEN_FOR, TOKEN_FUN, TOKEN_IF, TOKEN_IMPORT,
     TOKEN_NIL, TOKEN_OR, TOKEN_PRINT, TOKEN_RETURN, TOKEN_SUPER, TOKEN_SWITCH,
     TOKEN_THIS, TOKEN_TRUE, TOKEN_VAR, TOKEN_WHILE,
 
@@ -53,6 +53,8 @@ typedef struct {
 typedef struct {
     const char* start;
     const char* current;
+    // Terminating '\0' of the source
+    const char* end;
     int line;
     int str_depth;
     bool in_str;
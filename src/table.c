@@ -6,113 +6,239 @@
 #include "table.h"
 #include "value.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TABLE_SIMD
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Control bytes, full slots hold the low 7 bits of their key's hash
+#define CONTROL_EMPTY 0x80
+#define CONTROL_DELETED 0xFE
+
+#define CONTROL_FULL(control) ((control) < 0x80)
+// Low 7 bits pick the control byte, the rest pick the first slot probed
+#define HASH_CONTROL(hash) ((uint8_t)((hash) & 0x7F))
+#define HASH_SLOT(hash) ((hash) >> 7)
+// The first group - 1 control bytes are repeated after the last, so a group can start at any slot
+#define CONTROL_SIZE(capacity) ((capacity) + TABLE_GROUP_SIZE - 1)
+
 void initTable(Table* table) {
     table->count = 0;
+    table->tombstones = 0;
     table->capacity = 0;
+    table->control = NULL;
     table->entries = NULL;
 }
 
 void freeTable(Table* table) {
-    FREE_ARRAY(Entry, table->entries, table-> capacity);
+    FREE_ARRAY(uint8_t, table->control, CONTROL_SIZE(table->capacity));
+    FREE_ARRAY(Entry, table->entries, table->capacity);
     initTable(table);
 }
 
-// Finds an entry slot in a table
-static Entry* findEntry(Entry* entries, int capacity, ObjString* key) {
-    uint32_t index = key->hash & (capacity - 1);
-    Entry* tombstone = NULL;
-
-    for (;;) {
-        Entry* entry = &entries[index];
-        if (entry->key == NULL) {
-            if(IS_NIL(entry->value)) {
-                // Empty entry
-                return tombstone != NULL ? tombstone : entry;
-            } else {
-                // Found tombstone
-                if (tombstone == NULL) tombstone = entry;
-            }
-        } else if (entry->key == key) {
-            // Found entry
-            return entry;
+// Index of the lowest set bit of a non-zero mask
+static inline int lowestSlot(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long slot;
+    _BitScanForward(&slot, mask);
+    return (int)slot;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Index of the highest set bit of a non-zero mask
+static inline int highestSlot(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long slot;
+    _BitScanReverse(&slot, mask);
+    return (int)slot;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+// Bit i is set if group[i] == control
+static inline uint32_t matchControl(const uint8_t* group, uint8_t control) {
+#ifdef TABLE_SIMD
+    __m128i bytes = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)control)));
+#else
+    uint32_t mask = 0;
+    for (int slot = 0; slot < TABLE_GROUP_SIZE; slot++) {
+        if (group[slot] == control) mask |= 1u << slot;
+    }
+    return mask;
+#endif
+}
+
+// Bit i is set if group[i] is empty or deleted, both have the high bit set
+static inline uint32_t matchFree(const uint8_t* group) {
+#ifdef TABLE_SIMD
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+    uint32_t mask = 0;
+    for (int slot = 0; slot < TABLE_GROUP_SIZE; slot++) {
+        if (!CONTROL_FULL(group[slot])) mask |= 1u << slot;
+    }
+    return mask;
+#endif
+}
+
+// Groups start a multiple of the group size apart, in triangular steps that reach every slot of a power of two table
+// Probing stops at a group with an empty slot, nothing was ever placed past it
+#define FOR_EACH_GROUP(capacity, hash, start) \
+    for (uint32_t slotMask_ = (uint32_t)(capacity) - 1, step_ = 0, start = HASH_SLOT(hash) & slotMask_; ; \
+            step_ += TABLE_GROUP_SIZE, start = (start + step_) & slotMask_)
+
+static void setControl(uint8_t* control, int capacity, int slot, uint8_t byte) {
+    control[slot] = byte;
+    if (slot < TABLE_GROUP_SIZE - 1) control[capacity + slot] = byte;
+}
+
+// Finds the entry of a key, NULL if it is not in the table
+// Keys are interned, so they are compared by pointer and always hashed
+static inline Entry* findEntry(Table* table, ObjString* key) {
+    // Most keys sit in the first slot they probe
+    Entry* home = &table->entries[HASH_SLOT(key->hash) & (table->capacity - 1)];
+    if (home->key == key) return home;
+
+    uint8_t control = HASH_CONTROL(key->hash);
+    FOR_EACH_GROUP(table->capacity, key->hash, start) {
+        const uint8_t* group = table->control + start;
+        for (uint32_t matches = matchControl(group, control); matches != 0; matches &= matches - 1) {
+            Entry* entry = &table->entries[(start + lowestSlot(matches)) & (table->capacity - 1)];
+            if (entry->key == key) return entry;
         }
+        if (matchControl(group, CONTROL_EMPTY) != 0) return NULL;
+    }
+}
 
-        index = (index + 1) & (capacity - 1);
+// Finds the first empty or deleted slot on a hash's probe sequence
+static int findFreeSlot(uint8_t* control, int capacity, uint32_t hash) {
+    FOR_EACH_GROUP(capacity, hash, start) {
+        uint32_t slots = matchFree(control + start);
+        if (slots != 0) return (start + lowestSlot(slots)) & (capacity - 1);
     }
 }
 
-// Resize a table
-static void adjustCapacity(Table* table, int capacity) {
+// Rebuild the table with capacity slots and without tombstones
+static void resizeTable(Table* table, int capacity) {
+    uint8_t* control = ALLOCATE(uint8_t, CONTROL_SIZE(capacity));
     Entry* entries = ALLOCATE(Entry, capacity);
-    for (int i = 0; i < capacity; i++) {
-        entries[i].key = NULL;
-        entries[i].value = NIL_VAL;
+    memset(control, CONTROL_EMPTY, CONTROL_SIZE(capacity));
+    // Free slots never hold a key, findEntry checks the first slot without its control byte
+    for (int slot = 0; slot < capacity; slot++) {
+        entries[slot].key = NULL;
     }
 
-    // Remove tombstones from count
-    table->count = 0;
-    // Replace entries
-    for (int i = 0; i < table->capacity; i++) {
-        Entry* entry = &table->entries[i];
-        if (entry->key == NULL) continue;
+    for (int slot = 0; slot < table->capacity; slot++) {
+        if (!CONTROL_FULL(table->control[slot])) continue;
 
-        Entry* dest = findEntry(entries, capacity, entry->key);
-        dest->key = entry->key;
-        dest->value = entry->value;
-        table->count++;
+        Entry* entry = &table->entries[slot];
+        int dest = findFreeSlot(control, capacity, entry->key->hash);
+        setControl(control, capacity, dest, table->control[slot]);
+        entries[dest] = *entry;
     }
 
+    FREE_ARRAY(uint8_t, table->control, CONTROL_SIZE(table->capacity));
     FREE_ARRAY(Entry, table->entries, table->capacity);
+    table->control = control;
     table->entries = entries;
     table->capacity = capacity;
+    table->tombstones = 0;
+}
+
+// Rebuild the table without tombstones, growing it if it is more than half full
+static void rehashTable(Table* table) {
+    int capacity = table->capacity;
+    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD / 2) {
+        capacity = GROW_CAPACITY(table->capacity);
+        if (capacity < TABLE_GROUP_SIZE) capacity = TABLE_GROUP_SIZE;
+    }
+    resizeTable(table, capacity);
+}
+
+void tableReserve(Table* table, int count) {
+    int capacity = table->capacity < TABLE_GROUP_SIZE ? TABLE_GROUP_SIZE : table->capacity;
+    while (count > capacity * TABLE_MAX_LOAD) {
+        capacity = GROW_CAPACITY(capacity);
+    }
+    if (capacity > table->capacity) resizeTable(table, capacity);
 }
 
 // Get a value from a table and make 'value' point to it
 bool tableGet(Table* table, ObjString* key, Value* value) {
     if (table->count == 0) return false;
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key == NULL) return false;
+    Entry* entry = findEntry(table, key);
+    if (entry == NULL) return false;
 
     *value = entry->value;
     return true;
 }
 
 bool tableSet(Table* table, ObjString* key, Value value) {
-    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
-        int capacity = GROW_CAPACITY(table->capacity);
-        adjustCapacity(table, capacity);
+    if (table->count != 0) {
+        Entry* entry = findEntry(table, key);
+        if (entry != NULL) {
+            entry->value = value;
+            return false;
+        }
     }
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
-    if (isNewKey && IS_NIL(entry->value)) table->count++;
+    if (table->count + table->tombstones + 1 > table->capacity * TABLE_MAX_LOAD) {
+        rehashTable(table);
+    }
 
-    entry->key = key;
-    entry->value = value;
-    return isNewKey;
+    int slot = findFreeSlot(table->control, table->capacity, key->hash);
+    if (table->control[slot] == CONTROL_DELETED) table->tombstones--;
+    setControl(table->control, table->capacity, slot, HASH_CONTROL(key->hash));
+    table->entries[slot].key = key;
+    table->entries[slot].value = value;
+    table->count++;
+    return true;
 }
 
+// Free a full slot
+// Needs no tombstone if no group holding it was ever without an empty slot, no probe went past it
+static void deleteSlot(Table* table, int slot) {
+    int mask = table->capacity - 1;
+    uint32_t emptyAfter = matchControl(table->control + slot, CONTROL_EMPTY);
+    uint32_t emptyBefore = matchControl(table->control + ((slot - TABLE_GROUP_SIZE) & mask), CONTROL_EMPTY);
+    bool wasNeverFull = emptyAfter != 0 && emptyBefore != 0
+        && lowestSlot(emptyAfter) + (TABLE_GROUP_SIZE - 1 - highestSlot(emptyBefore)) < TABLE_GROUP_SIZE;
+
+    if (wasNeverFull) {
+        setControl(table->control, table->capacity, slot, CONTROL_EMPTY);
+    } else {
+        setControl(table->control, table->capacity, slot, CONTROL_DELETED);
+        table->tombstones++;
+    }
+    table->entries[slot].key = NULL;
+    table->count--;
+}
 
-// Remove an entry from a table, turning it into a tombstone
+// Remove an entry from a table
 bool tableDelete(Table* table, ObjString* key) {
     if (table->count == 0) return false;
 
     // Find the entry
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key == NULL) return false;
+    Entry* entry = findEntry(table, key);
+    if (entry == NULL) return false;
 
-    // Place a tombstone
-    entry->key = NULL;
-    entry->value = BOOL_VAL(true);
+    deleteSlot(table, (int)(entry - table->entries));
     return true;
 }
 
 void tableAddAll(Table* from, Table* to) {
-    for (int i = 0; i < from->capacity; i++) {
-        Entry* entry = &from->entries[i];
-        if (entry->key != NULL) {
-            tableSet(to, entry->key, entry->value);
+    for (int slot = 0; slot < from->capacity; slot++) {
+        if (CONTROL_FULL(from->control[slot])) {
+            tableSet(to, from->entries[slot].key, from->entries[slot].value);
         }
     }
 }
@@ -121,18 +247,44 @@ void tableAddAll(Table* from, Table* to) {
 ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash) {
     if (table->count == 0) return NULL;
 
-    uint32_t index = hash & (table->capacity - 1);
-    for (;;) {
-        Entry* entry = &table->entries[index];
-        if (entry->key == NULL) {
-            // Stop if find empty non-tombstone entry
-            if (IS_NIL(entry->value)) return NULL;
-        } else if (entry->key->length == length && entry->key->hash == hash && memcmp(entry->key->chars, chars, length) == 0) {
-            // Found it
-            return entry->key;
+    uint8_t control = HASH_CONTROL(hash);
+    FOR_EACH_GROUP(table->capacity, hash, start) {
+        const uint8_t* group = table->control + start;
+        for (uint32_t matches = matchControl(group, control); matches != 0; matches &= matches - 1) {
+            ObjString* key = table->entries[(start + lowestSlot(matches)) & (table->capacity - 1)].key;
+            if (key->length == length && key->hash == hash && memcmp(key->chars, chars, length) == 0) {
+                // Found it
+                return key;
+            }
+        }
+        // Stop if find empty slot
+        if (matchControl(group, CONTROL_EMPTY) != 0) return NULL;
+    }
+}
+
+void markTable(VM* vm, Table* table) {
+    for (int slot = 0; slot < table->capacity; slot++) {
+        if (!CONTROL_FULL(table->control[slot])) continue;
+        Entry* entry = &table->entries[slot];
+        markObject(vm, (Obj*)entry->key);
+        markValue(vm, entry->value);
+    }
+}
+
+void tableRemoveWhite(Table* table) {
+    for (int slot = 0; slot < table->capacity; slot++) {
+        if (CONTROL_FULL(table->control[slot]) && !table->entries[slot].key->obj.isMarked) {
+            deleteSlot(table, slot);
         }
+    }
+}
 
-        //Increment
-        index = (index + 1) & (table->capacity - 1);
+void tableRemoveNonNatives(Table* table) {
+    for (int slot = 0; slot < table->capacity; slot++) {
+        if (CONTROL_FULL(table->control[slot]) && !table->entries[slot].key->isNative) {
+            deleteSlot(table, slot);
+        }
     }
-}
\ No newline at end of file
+}
+
+#undef FOR_EACH_GROUP
\ No newline at end of file
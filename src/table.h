@@ -4,16 +4,24 @@
 #include "common.h"
 #include "value.h"
 
-#define TABLE_MAX_LOAD 0.75
+// Full plus deleted slots allowed before the table is rebuilt
+// Kept low so lookups rarely go past the first group, globals are looked up on every access
+#define TABLE_MAX_LOAD 0.5
+// Slots probed at once, one control byte each
+#define TABLE_GROUP_SIZE 16
 
 typedef struct {
     ObjString* key;
     Value value;
 } Entry;
 
+// Swiss table, probed a group of control bytes at a time
+// A control byte is empty, deleted, or the low 7 bits of a full slot's key hash
 typedef struct {
     int count;
+    int tombstones;
     int capacity;
+    uint8_t* control;
     Entry* entries;
 } Table;
 
@@ -23,6 +31,14 @@ bool tableSet(Table* table, ObjString* key, Value value);
 bool tableGet(Table* table, ObjString* key, Value* value);
 bool tableDelete(Table* table, ObjString* key);
 void tableAddAll(Table* from, Table* to);
+// Grow the table once so count entries fit without rebuilding it again
+void tableReserve(Table* table, int count);
 ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash);
+// Mark every key and value
+void markTable(VM* vm, Table* table);
+// Delete entries whose keys were not marked
+void tableRemoveWhite(Table* table);
+// Delete entries whose keys are not natives
+void tableRemoveNonNatives(Table* table);
 
 #endif
\ No newline at end of file
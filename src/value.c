@@ -9,6 +9,7 @@ void initValueArray(ValueArray* array) {
     array->values = NULL;
     array->capacity = 0;
     array->count = 0;
+    array->arena = NULL;
 }
 
 // Write constant to array, not adding duplicates
@@ -60,7 +61,7 @@ uint32_t writeValueArray(ValueArray* array, Value value) {
     if (array->capacity < array->count + 1) {
         int oldCapacity = array->capacity;
         array->capacity = GROW_CAPACITY(oldCapacity);
-        array->values = GROW_ARRAY(Value, array->values, oldCapacity, array->capacity);
+        array->values = GROW_ARRAY_IN(array->arena, Value, array->values, oldCapacity, array->capacity);
     }
 
     array->values[array->count] = value;
@@ -69,7 +70,7 @@ uint32_t writeValueArray(ValueArray* array, Value value) {
 
 
 void freeValueArray(ValueArray* array) {
-    FREE_ARRAY(Value, array->values, array->capacity);
+    FREE_ARRAY_IN(array->arena, Value, array->values, array->capacity);
     initValueArray(array);
 }
 
@@ -90,6 +91,8 @@ bool valuesEqual(Value a, Value b) {
     if (IS_NIL(a)) return IS_NIL(b);
     if (IS_OBJ(a)) {
         if (IS_OBJ(b)) {
+            // Strings built at runtime are not interned, compare their chars
+            if (IS_STRING(a) && IS_STRING(b)) return stringsEqual(AS_STRING(a), AS_STRING(b));
             return AS_OBJ(a) == AS_OBJ(b);
 
         } else {
@@ -1,10 +1,12 @@
 #ifndef cave_value_h
 #define cave_value_h
 
+#include "arena.h"
 #include "common.h"
 
 typedef struct Obj Obj;
 typedef struct ObjString ObjString;
+typedef struct VM VM;
 
 typedef enum {
     VAL_BOOL,
@@ -41,6 +43,8 @@ typedef struct {
     int capacity;
     int count;
     Value* values;
+    // Grows in this arena instead of the heap if set
+    Arena* arena;
 } ValueArray;
 
 
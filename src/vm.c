@@ -1,51 +1,148 @@
 #include <stdarg.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include <time.h>
 
+#include "bytecode.h"
 #include "common.h"
 #include "memory.h"
 #include "compiler.h"
 #include "debug.h"
+#include "jit.h"
+#include "parallel.h"
+#include "regvm.h"
 #include "vm.h"
 
 // From least sig on right
 // CHECK IF TERNARY 0,1,2,3 is faster than a BITARRAY *********************************************
 #define FOUR_TYPE_ID() \
-    ((IS_STRING(vm.stackTop[-1]) * 3 | (IS_NUMBER(vm.stackTop[-1]) << 1 | IS_BOOL(vm.stackTop[-1]))) << 2) | \
-    (IS_STRING(vm.stackTop[-2]) * 3 | IS_NUMBER(vm.stackTop[-2]) << 1 | IS_BOOL(vm.stackTop[-2]))
+    ((IS_STRING(vm->stackTop[-1]) * 3 | (IS_NUMBER(vm->stackTop[-1]) << 1 | IS_BOOL(vm->stackTop[-1]))) << 2) | \
+    (IS_STRING(vm->stackTop[-2]) * 3 | IS_NUMBER(vm->stackTop[-2]) << 1 | IS_BOOL(vm->stackTop[-2]))
 // End of FOUR_TYPE_ID
 
-VM vm;
 
 /*
     Native Functions
 */
-static void runtimeError(const char* format, ...);
-static bool call(ObjFunction* function, int argCount);
-static InterpretResult run();
+static void runtimeError(VM* vm, const char* format, ...);
+static bool call(VM* vm, ObjFunction* function, int argCount);
+static InterpretResult run(VM* vm);
 
 // Returns a number value of the clock
 // Arity 0
-static NativeFnReturn clockNative(int argCount, Value* args) {
+static NativeFnReturn clockNative(VM* vm, int argCount, Value* args) {
     return NATIVE_SUCCESS(NUMBER_VAL((double)clock() / CLOCKS_PER_SEC));
 }
 
-// Returns a number value of the length of a string
-// Arity 0
-static NativeFnReturn lenNative(int argCount, Value* args) {
+// Returns a number value of the length of a string or array
+// Arity 1
+static NativeFnReturn lenNative(VM* vm, int argCount, Value* args) {
+    if (IS_ARRAY(args[0])) {
+        return NATIVE_SUCCESS(NUMBER_VAL(AS_ARRAY(args[0])->length));
+    }
     if (!IS_STRING(args[0])) {
-        runtimeError("Can only us len() on strings");
+        runtimeError(vm, "Can only us len() on strings and arrays");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(AS_STRING(args[0])->length));
 }
 
+// Put a buffer view's buffer in the mode it reads, converting it if another view or native left it in the other
+static inline void syncBufferView(VM* vm, ObjArray* array) {
+    if (array->buffer >= 0) {
+        setTimeMode(&vm->wavetable, (BufferType)array->buffer, !array->isFreq);
+    }
+}
+
+// Returns a new array of zeros
+// Arity 1
+static NativeFnReturn newArrayNative(VM* vm, int argCount, Value* args) {
+    if (!IS_NUMBER(args[0])) {
+        runtimeError(vm, "newArray: Expect newArray(number)");
+        return NATIVE_FAIL();
+    }
+    double length = AS_NUMBER(args[0]);
+    if (length < 0 || length > INT_MAX) {
+        runtimeError(vm, "newArray: Expect length to be in range [0,%d]", INT_MAX);
+        return NATIVE_FAIL();
+    }
+    return NATIVE_SUCCESS(OBJ_VAL(newArray(vm, (int)length)));
+}
+
+// Set every value of an array
+// Arity 2
+static NativeFnReturn fillArrayNative(VM* vm, int argCount, Value* args) {
+    if (!IS_ARRAY(args[0]) || !IS_NUMBER(args[1])) {
+        runtimeError(vm, "fillArray: Expect fillArray(array, number)");
+        return NATIVE_FAIL();
+    }
+    ObjArray* array = AS_ARRAY(args[0]);
+    double value = AS_NUMBER(args[1]);
+    syncBufferView(vm, array);
+    for (int index = 0; index < array->length; index++) {
+        array->values[index] = value;
+    }
+    return NATIVE_SUCCESS(args[0]);
+}
+
+// Multiply every value of an array
+// Arity 2
+static NativeFnReturn scaleArrayNative(VM* vm, int argCount, Value* args) {
+    if (!IS_ARRAY(args[0]) || !IS_NUMBER(args[1])) {
+        runtimeError(vm, "scaleArray: Expect scaleArray(array, number)");
+        return NATIVE_FAIL();
+    }
+    ObjArray* array = AS_ARRAY(args[0]);
+    double factor = AS_NUMBER(args[1]);
+    syncBufferView(vm, array);
+    for (int index = 0; index < array->length; index++) {
+        array->values[index] *= factor;
+    }
+    return NATIVE_SUCCESS(args[0]);
+}
+
+// Copy src into dest, up to the shorter length, the two may overlap
+// Arity 2
+static NativeFnReturn copyArrayNative(VM* vm, int argCount, Value* args) {
+    if (!IS_ARRAY(args[0]) || !IS_ARRAY(args[1])) {
+        runtimeError(vm, "copyArray: Expect copyArray(array, array)");
+        return NATIVE_FAIL();
+    }
+    ObjArray* dest = AS_ARRAY(args[0]);
+    ObjArray* src = AS_ARRAY(args[1]);
+    int length = dest->length < src->length ? dest->length : src->length;
+    // Source is read in its own mode before dest may convert the buffer
+    syncBufferView(vm, src);
+    syncBufferView(vm, dest);
+    memmove(dest->values, src->values, sizeof(double) * length);
+    return NATIVE_SUCCESS(args[0]);
+}
+
+// Add src times gain into dest, up to the shorter length
+// Arity 3
+static NativeFnReturn mixArrayNative(VM* vm, int argCount, Value* args) {
+    if (!IS_ARRAY(args[0]) || !IS_ARRAY(args[1]) || !IS_NUMBER(args[2])) {
+        runtimeError(vm, "mixArray: Expect mixArray(array, array, number)");
+        return NATIVE_FAIL();
+    }
+    ObjArray* dest = AS_ARRAY(args[0]);
+    ObjArray* src = AS_ARRAY(args[1]);
+    double gain = AS_NUMBER(args[2]);
+    int length = dest->length < src->length ? dest->length : src->length;
+    syncBufferView(vm, src);
+    syncBufferView(vm, dest);
+    for (int index = 0; index < length; index++) {
+        dest->values[index] += src->values[index] * gain;
+    }
+    return NATIVE_SUCCESS(args[0]);
+}
+
 // Returns enum value of the Value* type
 // Arity 1
-static NativeFnReturn typeNative(int argCount, Value* args) {
+static NativeFnReturn typeNative(VM* vm, int argCount, Value* args) {
     int typeCode = args[0].type;
     if (IS_OBJ(args[0])) {
         typeCode += AS_OBJ(args[0])->type;
@@ -55,9 +152,9 @@ static NativeFnReturn typeNative(int argCount, Value* args) {
 
 // Round
 // Arity 1
-static NativeFnReturn roundNative(int argCount, Value *args) {
+static NativeFnReturn roundNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("round: Expect round(number)");
+        runtimeError(vm, "round: Expect round(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(round(AS_NUMBER(args[0]))));
@@ -65,9 +162,9 @@ static NativeFnReturn roundNative(int argCount, Value *args) {
 
 // Floor
 // Arity 1
-static NativeFnReturn floorNative(int argCount, Value *args) {
+static NativeFnReturn floorNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("floor: Expect floor(number)");
+        runtimeError(vm, "floor: Expect floor(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(floor(AS_NUMBER(args[0]))));
@@ -75,9 +172,9 @@ static NativeFnReturn floorNative(int argCount, Value *args) {
 
 // Ceil
 // Arity 1
-static NativeFnReturn ceilNative(int argCount, Value *args) {
+static NativeFnReturn ceilNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("ceil: Expect ceil(number)");
+        runtimeError(vm, "ceil: Expect ceil(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(ceil(AS_NUMBER(args[0]))));
@@ -85,9 +182,9 @@ static NativeFnReturn ceilNative(int argCount, Value *args) {
 
 // Sqrt
 // Arity 1
-static NativeFnReturn sqrtNative(int argCount, Value *args) {
+static NativeFnReturn sqrtNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("sqrt: Expect sqrt(number)");
+        runtimeError(vm, "sqrt: Expect sqrt(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(sqrt(AS_NUMBER(args[0]))));
@@ -95,9 +192,9 @@ static NativeFnReturn sqrtNative(int argCount, Value *args) {
 
 // pow
 // Arity 2
-static NativeFnReturn powNative(int argCount, Value *args) {
+static NativeFnReturn powNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0]) || !IS_NUMBER(args[1])) {
-        runtimeError("pow: Expect pow(number, number)");
+        runtimeError(vm, "pow: Expect pow(number, number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(pow(AS_NUMBER(args[0]), AS_NUMBER(args[1]))));
@@ -105,9 +202,9 @@ static NativeFnReturn powNative(int argCount, Value *args) {
 
 // Sin
 // Arity 1
-static NativeFnReturn sinNative(int argCount, Value* args) {
+static NativeFnReturn sinNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("sin: Expect sin(number)");
+        runtimeError(vm, "sin: Expect sin(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(sin(AS_NUMBER(args[0]))));
@@ -115,9 +212,9 @@ static NativeFnReturn sinNative(int argCount, Value* args) {
 
 // Cos
 // Arity 1
-static NativeFnReturn cosNative(int argCount, Value* args) {
+static NativeFnReturn cosNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("cos: Expect cos(number)");
+        runtimeError(vm, "cos: Expect cos(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(cos(AS_NUMBER(args[0]))));
@@ -125,9 +222,9 @@ static NativeFnReturn cosNative(int argCount, Value* args) {
 
 // tan
 // Arity 1
-static NativeFnReturn tanNative(int argCount, Value* args) {
+static NativeFnReturn tanNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("tan: Expect tan(number)");
+        runtimeError(vm, "tan: Expect tan(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(tan(AS_NUMBER(args[0]))));
@@ -135,9 +232,9 @@ static NativeFnReturn tanNative(int argCount, Value* args) {
 
 // arcsin
 // Arity 1
-static NativeFnReturn asinNative(int argCount, Value* args) {
+static NativeFnReturn asinNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("asin: Expect asin(number)");
+        runtimeError(vm, "asin: Expect asin(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(asin(AS_NUMBER(args[0]))));
@@ -145,9 +242,9 @@ static NativeFnReturn asinNative(int argCount, Value* args) {
 
 // arccos
 // Arity 1
-static NativeFnReturn acosNative(int argCount, Value* args) {
+static NativeFnReturn acosNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("acos: Expect acos(number)");
+        runtimeError(vm, "acos: Expect acos(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(acos(AS_NUMBER(args[0]))));
@@ -155,9 +252,9 @@ static NativeFnReturn acosNative(int argCount, Value* args) {
 
 // arctan
 // Arity 1
-static NativeFnReturn atanNative(int argCount, Value* args) {
+static NativeFnReturn atanNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("atan: Expect atan(number)");
+        runtimeError(vm, "atan: Expect atan(number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(atan(AS_NUMBER(args[0]))));
@@ -165,9 +262,9 @@ static NativeFnReturn atanNative(int argCount, Value* args) {
 
 // arctan2
 // Arity 2
-static NativeFnReturn atan2Native(int argCount, Value* args) {
+static NativeFnReturn atan2Native(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0]) || !IS_NUMBER(args[1])) {
-        runtimeError("atan2: Expect atan2(number, number)");
+        runtimeError(vm, "atan2: Expect atan2(number, number)");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NUMBER_VAL(atan2(AS_NUMBER(args[0]), AS_NUMBER(args[1]))));
@@ -175,9 +272,9 @@ static NativeFnReturn atan2Native(int argCount, Value* args) {
 
 // Saw wave
 // Arity 1
-static NativeFnReturn sawNative(int argCount, Value* args) {
+static NativeFnReturn sawNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("saw: Expect saw(number)");
+        runtimeError(vm, "saw: Expect saw(number)");
         return NATIVE_FAIL();
     }
     Value result = NUMBER_VAL(1 - 2 * fmod(AS_NUMBER(args[0]), 1));
@@ -188,82 +285,70 @@ static NativeFnReturn sawNative(int argCount, Value* args) {
 
 // Rand
 // Arity 0
-static NativeFnReturn randNative(int argCount, Value* args) {
+static NativeFnReturn randNative(VM* vm, int argCount, Value* args) {
     return NATIVE_SUCCESS(NUMBER_VAL(rand()));
 }
 
+// Random values shared by every frame or index, drawn the first time one is read
+static int* drawRandoms(int count) {
+    int* randoms = (int*)malloc(sizeof(int) * count);
+    if (randoms == NULL) exit(1);
+    for (int i = 0; i < count; i++) {
+        randoms[i] = rand();
+    }
+    return randoms;
+}
+
 // Random shared by a frame
-static NativeFnReturn randfNative(int argCount, Value* args) {
+static NativeFnReturn randfNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("randf: Expect randf(number)");
+        runtimeError(vm, "randf: Expect randf(number)");
         return NATIVE_FAIL();
     }
     int index = AS_NUMBER(args[0]);
     if (index < 0 || index >= WAVETABLE_MAX_FRAMES) {
-        runtimeError("randf: Frame index out of bounds");
+        runtimeError(vm, "randf: Frame index out of bounds");
         return NATIVE_FAIL();
     }
-    return NATIVE_SUCCESS(NUMBER_VAL(vm.wavetable.randf[index]));
+    if (vm->wavetable.randf == NULL) vm->wavetable.randf = drawRandoms(WAVETABLE_MAX_FRAMES);
+    return NATIVE_SUCCESS(NUMBER_VAL(vm->wavetable.randf[index]));
 }
 
 // Random shared by an index
-static NativeFnReturn randiNative(int argCount, Value* args) {
+static NativeFnReturn randiNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0])) {
-        runtimeError("randi: Expect randf(number)");
+        runtimeError(vm, "randi: Expect randf(number)");
         return NATIVE_FAIL();
     }
     int index = AS_NUMBER(args[0]);
     if (index < 0 || index >= WAVETABLE_FRAME_LEN) {
-        runtimeError("randi: Frame out of bounds");
+        runtimeError(vm, "randi: Frame out of bounds");
         return NATIVE_FAIL();
     }
-    return NATIVE_SUCCESS(NUMBER_VAL(vm.wavetable.randi[index]));
+    if (vm->wavetable.randi == NULL) vm->wavetable.randi = drawRandoms(WAVETABLE_FRAME_LEN);
+    return NATIVE_SUCCESS(NUMBER_VAL(vm->wavetable.randi[index]));
 }
 
 // Wavetable functions //
 // Get value at MAIN_BUFFER_TIME (frame,index)
 // Arity 2
-static NativeFnReturn mainTimeNative(int argCount, Value* args) {
+static NativeFnReturn mainTimeNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0]) || !IS_NUMBER(args[1])) {
-        runtimeError("main_t: Expect main_t(number, number)");
+        runtimeError(vm, "main_t: Expect main_t(number, number)");
         return NATIVE_FAIL();
     }
-    // Get the frame and bind it to the range [0,WAVETABLE_MAX_FRAMES)
-    const int frame = ((int)AS_NUMBER(args[0])) & (WAVETABLE_MAX_FRAMES - 1);
-    // Get the index and bind it to the range [0,WAVETABLE_FRAME_LEN)
-
-    // Index is linearly interpolated
-    const double rawIndex = AS_NUMBER(args[1]);
-    const int indexLower = ((int)rawIndex) & (WAVETABLE_FRAME_LEN - 1);
-    const int indexHigher = (indexLower + 1) & (WAVETABLE_FRAME_LEN - 1);
-
-    // Linearly interpolate result
-    const double indexRatio = rawIndex - (int)rawIndex;
-    Value result = NUMBER_VAL(vm.wavetable.main_time[frame * WAVETABLE_FRAME_LEN + indexLower] * (1 - indexRatio)
-                            + vm.wavetable.main_time[frame * WAVETABLE_FRAME_LEN + indexHigher] * (indexRatio));
+    Value result = NUMBER_VAL(readTimeBuffer(getTimeBuffer(&vm->wavetable, BUFFER_MAIN), AS_NUMBER(args[0]), AS_NUMBER(args[1])));
     return NATIVE_SUCCESS(result);
 }
 
 // Get value at AUX1_BUFFER_TIME (frame,index)
 // Arity 2
-static NativeFnReturn aux1TimeNative(int argCount, Value* args) {
+static NativeFnReturn aux1TimeNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0]) || !IS_NUMBER(args[1])) {
-        runtimeError("aux1_t: Expect aux1_t(number, number)");
+        runtimeError(vm, "aux1_t: Expect aux1_t(number, number)");
         return NATIVE_FAIL();
     }
-    // Get the frame and bind it to the range [0,WAVETABLE_MAX_FRAMES)
-    const int frame = ((int)AS_NUMBER(args[0])) & (WAVETABLE_MAX_FRAMES - 1);
-    // Get the index and bind it to the range [0,WAVETABLE_FRAME_LEN)
-
-    // Index is linearly interpolated
-    const double rawIndex = AS_NUMBER(args[1]);
-    const int indexLower = ((int)rawIndex) & (WAVETABLE_FRAME_LEN - 1);
-    const int indexHigher = (indexLower + 1) & (WAVETABLE_FRAME_LEN - 1);
-
-    // Linearly interpolate result
-    const double indexRatio = rawIndex - (int)rawIndex;
-    Value result = NUMBER_VAL(vm.wavetable.aux1_time[frame * WAVETABLE_FRAME_LEN + indexLower] * (1 - indexRatio)
-                            + vm.wavetable.aux1_time[frame * WAVETABLE_FRAME_LEN + indexHigher] * (indexRatio));
+    Value result = NUMBER_VAL(readTimeBuffer(getTimeBuffer(&vm->wavetable, BUFFER_AUX1), AS_NUMBER(args[0]), AS_NUMBER(args[1])));
     return NATIVE_SUCCESS(result);
 }
 
@@ -277,26 +362,51 @@ static bool invalidBuffType(Value buffer_type) {
     return false;
 }
 
+// Array view of a buffer's time domain samples, every frame back to back
+// Arity 1
+static NativeFnReturn timeViewNative(VM* vm, int argCount, Value* args) {
+    if (!IS_NUMBER(args[0]) || invalidBuffType(args[0])) {
+        runtimeError(vm, "timeView: Expect timeView(buffer)");
+        return NATIVE_FAIL();
+    }
+    BufferType buffer = (BufferType)(int)AS_NUMBER(args[0]);
+    double* values = getTimeBuffer(&vm->wavetable, buffer);
+    return NATIVE_SUCCESS(OBJ_VAL(newBufferView(vm, values, (int)vm->wavetable.total_samples, buffer, false)));
+}
+
+// Array view of a buffer's frequency domain bins, real and imaginary parts interleaved
+// Arity 1
+static NativeFnReturn freqViewNative(VM* vm, int argCount, Value* args) {
+    if (!IS_NUMBER(args[0]) || invalidBuffType(args[0])) {
+        runtimeError(vm, "freqView: Expect freqView(buffer)");
+        return NATIVE_FAIL();
+    }
+    BufferType buffer = (BufferType)(int)AS_NUMBER(args[0]);
+    // A complex double is laid out as two doubles
+    double* values = (double*)getFreqBuffer(&vm->wavetable, buffer);
+    return NATIVE_SUCCESS(OBJ_VAL(newBufferView(vm, values, 2 * (int)vm->wavetable.total_samples, buffer, true)));
+}
+
 // Normalize based on frame local max
-static NativeFnReturn frameNormalizeNative(int argCount, Value* args) {
+static NativeFnReturn frameNormalizeNative(VM* vm, int argCount, Value* args) {
     // Type check
     if (!IS_NUMBER(args[0]) || !IS_NUMBER(args[1]) || !IS_NUMBER(args[2])) {
-        runtimeError("frameNorm: expect frameNorm(BUFFER, MIN_FRAME, MAX_FRAME)");
+        runtimeError(vm, "frameNorm: expect frameNorm(BUFFER, MIN_FRAME, MAX_FRAME)");
         return NATIVE_FAIL();
     }
     // Check buffer type
     if (invalidBuffType(args[0])) {
-        runtimeError("frameNorm: Invalid buffer type");
+        runtimeError(vm, "frameNorm: Invalid buffer type");
         return NATIVE_FAIL();
     }
     // Check bounds minFrame
     if (AS_NUMBER(args[1]) < 0 || AS_NUMBER(args[1]) > 255) {
-        runtimeError("frameNorm: minFrame must be between [0, 255]");
+        runtimeError(vm, "frameNorm: minFrame must be between [0, 255]");
         return NATIVE_FAIL();
     }
     // Check bounds maxFrame
     if (AS_NUMBER(args[2]) < 1 || AS_NUMBER(args[2]) > 256 || AS_NUMBER(args[2]) <= AS_NUMBER(args[1])) {
-        runtimeError("frameNorm: maxFrame must be between [1, 256] and larger than minFrame");
+        runtimeError(vm, "frameNorm: maxFrame must be between [1, 256] and larger than minFrame");
         return NATIVE_FAIL();
     }
 
@@ -304,27 +414,27 @@ static NativeFnReturn frameNormalizeNative(int argCount, Value* args) {
     int minFrame = (int)AS_NUMBER(args[1]);
     int maxFrame = (int)AS_NUMBER(args[2]);
 
-    normalizeByFrame(&vm.wavetable, bufferType, minFrame, maxFrame);
+    normalizeByFrame(&vm->wavetable, bufferType, minFrame, maxFrame);
 
     return NATIVE_SUCCESS(NIL_VAL);
 }
 
 // Import .wav file
 // Arity 2
-static NativeFnReturn wavImportNative(int argCount, Value* args) {
+static NativeFnReturn wavImportNative(VM* vm, int argCount, Value* args) {
     if (!IS_STRING(args[1]) || !IS_NUMBER(args[0])) {
-        runtimeError("importWav: Expect importWav(number, string)");
+        runtimeError(vm, "importWav: Expect importWav(number, string)");
         return NATIVE_FAIL();
     }
     // Check buffer type
     if (invalidBuffType(args[0])) {
-        runtimeError("importWav: Invalid buffer type");
+        runtimeError(vm, "importWav: Invalid buffer type");
         return NATIVE_FAIL();
     }
     // Import the wave
-    bool importSuccess = importWav(&vm.wavetable, (BufferType)(int)AS_NUMBER(args[0]), AS_CSTRING(args[1]));
+    bool importSuccess = importWav(&vm->wavetable, (BufferType)(int)AS_NUMBER(args[0]), AS_CSTRING(args[1]));
     if (!importSuccess) {
-        runtimeError("importWav: Failed to import .wav file");
+        runtimeError(vm, "importWav: Failed to import .wav file");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NIL_VAL);
@@ -332,31 +442,31 @@ static NativeFnReturn wavImportNative(int argCount, Value* args) {
 
 // Export wavetable to .wav file
 // Arity 4
-static NativeFnReturn wavExportNative(int argCount, Value* args) {
+static NativeFnReturn wavExportNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[3]) || !IS_NUMBER(args[2]) || !IS_STRING(args[1]) || !IS_NUMBER(args[0])) {
-        runtimeError("exportWav: Expect exportWav(number, string, number, number)");
+        runtimeError(vm, "exportWav: Expect exportWav(number, string, number, number)");
         return NATIVE_FAIL();
     }
     // Check buffer type
     if (invalidBuffType(args[0])) {
-        runtimeError("exportWav: Invalid buffer type");
+        runtimeError(vm, "exportWav: Invalid buffer type");
         return NATIVE_FAIL();
     }
     // Check sample_size
     if (AS_NUMBER(args[2]) != 8 && AS_NUMBER(args[2]) != 16 && AS_NUMBER(args[2]) != 32) {
-        runtimeError("exportWav: Expect sample_size to be 8, 16, or 32");
+        runtimeError(vm, "exportWav: Expect sample_size to be 8, 16, or 32");
         return NATIVE_FAIL();
     }
     // Check num_frames
     if (AS_NUMBER(args[3]) <= 0 || AS_NUMBER(args[3]) > WAVETABLE_MAX_FRAMES) {
-        runtimeError("exportWav: Expect num_frames to be in range [1,256]");
+        runtimeError(vm, "exportWav: Expect num_frames to be in range [1,256]");
         return NATIVE_FAIL();
     }
     // Import the wave
-    bool exportSuccess = exportWav(&vm.wavetable, (BufferType)(int)AS_NUMBER(args[0]), AS_CSTRING(args[1]), (int)AS_NUMBER(args[2]), (int)AS_NUMBER(args[3]));
+    bool exportSuccess = exportWav(&vm->wavetable, (BufferType)(int)AS_NUMBER(args[0]), AS_CSTRING(args[1]), (int)AS_NUMBER(args[2]), (int)AS_NUMBER(args[3]));
     // Check if export worked
     if (!exportSuccess) {
-        runtimeError("exportWav: Failed to export .wav file");
+        runtimeError(vm, "exportWav: Failed to export .wav file");
         return NATIVE_FAIL();
     }
     return NATIVE_SUCCESS(NIL_VAL);
@@ -364,106 +474,287 @@ static NativeFnReturn wavExportNative(int argCount, Value* args) {
 
 // Checks variable type and ranges
 // Returns true if it fails
-static bool checkEditArgs(const char* funcName, Value* args, int minIndex, int maxIndex) {
+static bool checkEditArgs(VM* vm, const char* funcName, Value* args, int minIndex, int maxIndex) {
     // Check types
     if (!IS_NUMBER(args[0]) || !IS_NUMBER(args[1]) || !IS_NUMBER(args[2])
         || !IS_NUMBER(args[3]) || !IS_NUMBER(args[4]) || !IS_STRING(args[5])) {
-        runtimeError("%s: Expect %s(buffer, minFrame, maxFrame, minIndex, maxIndex, function)", funcName, funcName);
+        runtimeError(vm, "%s: Expect %s(buffer, minFrame, maxFrame, minIndex, maxIndex, function)", funcName, funcName);
         return true;
     }
     // Check buffer type
     if (invalidBuffType(args[0])) {
-        runtimeError("%s: Invalid buffer type", funcName);
+        runtimeError(vm, "%s: Invalid buffer type", funcName);
         return true;
     }
     // Check bounds minFrame
     if (AS_NUMBER(args[1]) < 0 || AS_NUMBER(args[1]) > 255) {
-        runtimeError("%s: minFrame must be between [0, 255]", funcName);
+        runtimeError(vm, "%s: minFrame must be between [0, 255]", funcName);
         return true;
     }
     // Check bounds maxFrame
     if (AS_NUMBER(args[2]) < 1 || AS_NUMBER(args[2]) > 256 || AS_NUMBER(args[2]) <= AS_NUMBER(args[1])) {
-        runtimeError("%s: maxFrame must be between [1, 256] and larger than minFrame", funcName);
+        runtimeError(vm, "%s: maxFrame must be between [1, 256] and larger than minFrame", funcName);
         return true;
     }
     // Check bounds minIndex
     if (AS_NUMBER(args[3]) < minIndex || AS_NUMBER(args[3]) > (maxIndex - 1)) {
-        runtimeError("%s: minIndex must be between [%d, %d]", funcName, minIndex, maxIndex - 1);
+        runtimeError(vm, "%s: minIndex must be between [%d, %d]", funcName, minIndex, maxIndex - 1);
         return true;
     }
     // Check maxIndex
     if (AS_NUMBER(args[4]) < (minIndex + 1) || AS_NUMBER(args[4]) > maxIndex || AS_NUMBER(args[4]) <= AS_NUMBER(args[3])) {
-        runtimeError("%s: maxIndex must be between [%d, %d] and larger than minIndex", funcName, minIndex + 1, maxIndex);
+        runtimeError(vm, "%s: maxIndex must be between [%d, %d] and larger than minIndex", funcName, minIndex + 1, maxIndex);
         return true;
     }
     return false;
 }
 
+// How a wave function is run, fastest first
+typedef enum {
+    WAVE_VECTOR, // Vector VM, a block of indexes per instruction
+    WAVE_JIT, // Register code compiled to machine code
+    WAVE_REGISTERS, // Register VM
+    WAVE_STACK, // Stack VM, anything the register tier cannot translate
+} WaveTier;
+
+// Fewest samples worth giving a thread of their own
+#define WAVE_WORKER_SAMPLES_MIN 16384
+
+// Runs a runtime compiled wave function one frame at a time
+typedef struct {
+    VM* vm;
+    ObjFunction* function;
+    WaveTier tier;
+    RegFunction registers;
+    JitFunction jit;
+    RegVector* vectors;
+    // Frames can run on separate threads, each frame only reads its own samples of the buffer being edited
+    bool parallel;
+    // Stack VM call window
+    uint8_t* resetIp;
+    Value* frameLoc;
+    Value* indexLoc;
+} WaveRunner;
+
+// destination is the intrinsic reading the buffer being edited, or -1 if none does
+// [minIndex, maxIndex) are the indexes every frame will run
+static void beginWaveFunction(VM* vm, WaveRunner* runner, ObjFunction* function, int destination, int minIndex, int maxIndex) {
+    runner->vm = vm;
+    runner->function = function;
+    if (compileRegisters(vm, &runner->registers, function)) {
+        // Index-only values are the same in every frame
+        cacheIndexRegisters(&runner->registers, minIndex, maxIndex);
+        // The vector VM writes a block of results at once, earlier results are not readable yet
+        runner->parallel = destination < 0 || !readsOtherSamples(&runner->registers, (uint8_t)destination);
+        if (runner->parallel) {
+            runner->tier = WAVE_VECTOR;
+            runner->vectors = ALLOCATE(RegVector, runner->registers.registerCount);
+        } else if (compileJit(&runner->jit, &runner->registers)) {
+            runner->tier = WAVE_JIT;
+        } else {
+            runner->tier = WAVE_REGISTERS;
+        }
+        return;
+    }
+    runner->tier = WAVE_STACK;
+    // Runs on the VM stack
+    runner->parallel = false;
+
+    // Push function
+    push(vm, OBJ_VAL(function));
+    // Push frame arg location
+    push(vm, NUMBER_VAL(0));
+    // Push index arg location
+    push(vm, NUMBER_VAL(0));
+    // Set up call window
+    call(vm, function, 2);
+
+    // Frame and Index pointer locations
+    runner->frameLoc = vm->stackTop - 2;
+    runner->indexLoc = vm->stackTop - 1;
+    // IP counter reset point
+    runner->resetIp = function->chunk.code;
+}
+
+// Run the wave function for every index in [minIndex, maxIndex) of frame, storing each result in out[index]
+// vectors is the vector VM scratch of the calling thread
+static bool runWaveFunction(WaveRunner* runner, RegVector* vectors, int frame, int minIndex, int maxIndex, double* out) {
+    VM* vm = runner->vm;
+    switch (runner->tier) {
+        case WAVE_VECTOR:
+            runRegistersVector(&runner->registers, vectors, frame, minIndex, maxIndex, out);
+            return true;
+        case WAVE_JIT:
+            runJit(&runner->jit, &runner->registers, frame, minIndex, maxIndex, out);
+            return true;
+        case WAVE_REGISTERS:
+            runRegisters(&runner->registers, frame, minIndex, maxIndex, out);
+            return true;
+        case WAVE_STACK:
+            break;
+    }
+
+    // Edit current frame
+    runner->frameLoc->as.number = frame;
+    for (int index = minIndex; index < maxIndex; index++) {
+        // Reset frame->ip
+        vm->frames[vm->frameCount - 1].ip = runner->resetIp;
+        // Edit current index
+        runner->indexLoc->as.number = index;
+
+        // Run
+        InterpretResult result = run(vm);
+        // Check if it ran okay
+        if (result != INTERPRET_OK) {
+            return false;
+        }
+        out[index] = AS_NUMBER(vm->output);
+    }
+    return true;
+}
+
+static void endWaveFunction(WaveRunner* runner) {
+    VM* vm = runner->vm;
+    switch (runner->tier) {
+        case WAVE_VECTOR:
+            FREE_ARRAY(RegVector, runner->vectors, runner->registers.registerCount);
+            freeRegisters(&runner->registers);
+            break;
+        case WAVE_JIT:
+            freeJit(&runner->jit);
+            freeRegisters(&runner->registers);
+            break;
+        case WAVE_REGISTERS:
+            freeRegisters(&runner->registers);
+            break;
+        case WAVE_STACK: {
+            // Tear down call
+            CallFrame frame = vm->frames[vm->frameCount-- - 1];
+            vm->stackTop = frame.slots;
+            break;
+        }
+    }
+    // Back to the cache, or freed if it was never cached
+    releaseFormula(vm, runner->function);
+}
+
+// Release a runner whose run raised a runtime error
+// The error already unwound the stack VM call, so only the formula goes back
+static void abortWaveFunction(WaveRunner* runner) {
+    if (runner->tier == WAVE_STACK) {
+        releaseFormula(runner->vm, runner->function);
+        return;
+    }
+    endWaveFunction(runner);
+}
+
+// Writes the results of one frame into a freq buffer
+typedef void (*StoreFrameFn)(_Complex double* freq_buffer, int frame, int minIndex, int maxIndex, const double* results);
+
+// Frames [minFrame, maxFrame) and indexes [minIndex, maxIndex) of an edit
+typedef struct {
+    WaveRunner* runner;
+    int minFrame;
+    int maxFrame;
+    int minIndex;
+    int maxIndex;
+    // Results go straight into time_buffer if set, else each frame is stored by storeFrame
+    double* time_buffer;
+    _Complex double* freq_buffer;
+    StoreFrameFn storeFrame;
+    // Vector VM scratch of every worker
+    RegVector* vectors;
+} WaveEdit;
+
+static bool runWaveFrames(WaveEdit* edit, RegVector* vectors, int minFrame, int maxFrame) {
+    double results[WAVETABLE_FRAME_LEN];
+    for (int frame = minFrame; frame < maxFrame; frame++) {
+        // Results go straight into the buffer, so main_t and aux1_t see earlier indexes already edited
+        double* out = edit->time_buffer != NULL ? edit->time_buffer + frame * WAVETABLE_FRAME_LEN : results;
+        if (!runWaveFunction(edit->runner, vectors, frame, edit->minIndex, edit->maxIndex, out)) {
+            return false;
+        }
+        if (edit->storeFrame != NULL) {
+            edit->storeFrame(edit->freq_buffer, frame, edit->minIndex, edit->maxIndex, results);
+        }
+    }
+    return true;
+}
+
+// One contiguous share of the frames per worker
+static void runWaveWorker(void* context, int worker, int workers) {
+    WaveEdit* edit = (WaveEdit*)context;
+    int frameCount = edit->maxFrame - edit->minFrame;
+    int minFrame = edit->minFrame + frameCount * worker / workers;
+    int maxFrame = edit->minFrame + frameCount * (worker + 1) / workers;
+    RegVector* vectors = edit->vectors != NULL ? edit->vectors + (size_t)worker * edit->runner->registers.registerCount : NULL;
+    // Register tiers cannot fail
+    runWaveFrames(edit, vectors, minFrame, maxFrame);
+}
+
+// Run every frame of an edit, split across threads when it is worth it
+static bool runWaveEdit(WaveEdit* edit) {
+    WaveRunner* runner = edit->runner;
+    int frameCount = edit->maxFrame - edit->minFrame;
+    int workers = 1;
+    if (runner->parallel) {
+        long samples = (long)frameCount * (edit->maxIndex - edit->minIndex);
+        workers = parallelWorkers();
+        if (workers > frameCount) workers = frameCount;
+        if (workers > samples / WAVE_WORKER_SAMPLES_MIN) workers = (int)(samples / WAVE_WORKER_SAMPLES_MIN);
+    }
+    if (workers <= 1) {
+        return runWaveFrames(edit, runner->vectors, edit->minFrame, edit->maxFrame);
+    }
+
+    edit->vectors = NULL;
+    if (runner->tier == WAVE_VECTOR) {
+        edit->vectors = ALLOCATE(RegVector, (size_t)workers * runner->registers.registerCount);
+    }
+    runParallel(runWaveWorker, edit, workers);
+    if (edit->vectors != NULL) {
+        FREE_ARRAY(RegVector, edit->vectors, (size_t)workers * runner->registers.registerCount);
+    }
+    return true;
+}
+
 // Edit wavetable buffer, time domain
 // (buffer 0, minFrame 1, maxFrame 2, minIndex 3, maxIndex 4, function 5)
 // Arity 6
-static NativeFnReturn editWaveNative(int argCount, Value* args) {
-    if (checkEditArgs("editWav", args, 0, 2048)) {
+static NativeFnReturn editWaveNative(VM* vm, int argCount, Value* args) {
+    if (checkEditArgs(vm, "editWav", args, 0, 2048)) {
         return NATIVE_FAIL();
     }
 
     // Toggle to time mode
     BufferType buffer_type = (BufferType)(int)AS_NUMBER(args[0]);
-    setTimeMode(&vm.wavetable, buffer_type, true);
+    setTimeMode(&vm->wavetable, buffer_type, true);
+    // Intrinsic reading the buffer being edited
+    int destination = buffer_type == BUFFER_MAIN ? REG_MAIN_T : REG_AUX1_T;
 
     // Compile function
-    ObjFunction* waveFunction = runtimeCompile(AS_CSTRING(args[5]));
+    ObjFunction* waveFunction = compileFormula(vm, AS_STRING(args[5]));
     // Check if compile failed
     if (waveFunction == NULL) {
-        runtimeError("editWav: Failed wave function compiling");
+        runtimeError(vm, "editWav: Failed wave function compiling");
         return NATIVE_FAIL();
     }
 
-    // Push function
-    push(OBJ_VAL(waveFunction));
-    // Push frame arg location
-    push(NUMBER_VAL(0));
-    // Push index arg location
-    push(NUMBER_VAL(0));
-    // Set up call window
-    call(waveFunction, 2);
-
-    // Frame and Index pointer locations
-    Value* frame_loc = vm.stackTop - 2;
-    Value* index_loc = vm.stackTop - 1;
-    // IP counter reset point
-    uint8_t* reset_ip = vm.frames[vm.frameCount - 1].function->chunk.code;
-    // Run and extract from waveFunction
-    double* time_buffer = getTimeBuffer(&vm.wavetable, buffer_type);
     const int minFrame = (int)AS_NUMBER(args[1]);
     const int maxFrame = (int)AS_NUMBER(args[2]);
     const int minIndex = (int)AS_NUMBER(args[3]);
     const int maxIndex = (int)AS_NUMBER(args[4]);
-    for (int frame = minFrame; frame < maxFrame; frame++) {
-        // Edit current frame
-        frame_loc->as.number = frame;
-        for (int index = minIndex; index < maxIndex; index++) {
-            // Reset frame->ip
-            vm.frames[vm.frameCount - 1].ip = reset_ip;
-            // Edit current index
-            index_loc->as.number = index;
-
-            // Run
-            InterpretResult result = run();
-            // Check if it ran okay
-            if (result != INTERPRET_OK) {
-                return NATIVE_FAIL();
-            }
+    WaveRunner runner;
+    beginWaveFunction(vm, &runner, waveFunction, destination, minIndex, maxIndex);
 
-            // Update buffer
-            time_buffer[frame * WAVETABLE_FRAME_LEN + index] = AS_NUMBER(vm.output);
-        }
+    // Run and extract from waveFunction
+    WaveEdit edit = {&runner, minFrame, maxFrame, minIndex, maxIndex};
+    edit.time_buffer = getTimeBuffer(&vm->wavetable, buffer_type);
+    if (!runWaveEdit(&edit)) {
+        abortWaveFunction(&runner);
+        return NATIVE_FAIL();
     }
-    // Tear down call
-    CallFrame frame = vm.frames[vm.frameCount-- - 1];
-    vm.stackTop = frame.slots;
-    // Free Memory
-    freeChunk(&waveFunction->chunk);
+    endWaveFunction(&runner);
 
     return NATIVE_SUCCESS(NIL_VAL);
 }
@@ -471,306 +762,305 @@ static NativeFnReturn editWaveNative(int argCount, Value* args) {
 // Edit wavetable buffer, freq domain, DC only
 // (buffer 0, minFrame 1, maxFrame 2, function 3)
 // Arity 6
-static NativeFnReturn editDCNative(int argCount, Value* args) {
+static NativeFnReturn editDCNative(VM* vm, int argCount, Value* args) {
     if (!IS_NUMBER(args[0]) || !IS_NUMBER(args[1]) || !IS_NUMBER(args[2]) || !IS_STRING(args[3])) {
-        runtimeError("editDC: expect editDC(number, number, number, string)");
+        runtimeError(vm, "editDC: expect editDC(number, number, number, string)");
         return NATIVE_FAIL();
     }
     // Check buffer type
     if (invalidBuffType(args[0])) {
-        runtimeError("exportWav: Invalid buffer type");
+        runtimeError(vm, "exportWav: Invalid buffer type");
         return NATIVE_FAIL();
     }
     // Check bounds minFrame
     if (AS_NUMBER(args[1]) < 0 || AS_NUMBER(args[1]) > 255) {
-        runtimeError("editDC: minFrame must be between [0, 255]");
+        runtimeError(vm, "editDC: minFrame must be between [0, 255]");
         return NATIVE_FAIL();
     }
     // Check bounds maxFrame
     if (AS_NUMBER(args[2]) < 1 || AS_NUMBER(args[2]) > 256 || AS_NUMBER(args[2]) <= AS_NUMBER(args[1])) {
-        runtimeError("editDC: maxFrame must be between [1, 256] and larger than minFrame");
+        runtimeError(vm, "editDC: maxFrame must be between [1, 256] and larger than minFrame");
         return NATIVE_FAIL();
     }
 
     // Toggle to freq mode
     BufferType buffer_type = (BufferType)(int)AS_NUMBER(args[0]);
-    setTimeMode(&vm.wavetable, buffer_type, false);
+    setTimeMode(&vm->wavetable, buffer_type, false);
 
     // Compile function
-    ObjFunction* waveFunction = runtimeCompile(AS_CSTRING(args[3]));
+    ObjFunction* waveFunction = compileFormula(vm, AS_STRING(args[3]));
     // Check if compile failed
     if (waveFunction == NULL) {
-        runtimeError("editDC: Failed wave function compiling");
+        runtimeError(vm, "editDC: Failed wave function compiling");
         return NATIVE_FAIL();
     }
 
-    // Push function
-    push(OBJ_VAL(waveFunction));
-    // Push frame arg location
-    push(NUMBER_VAL(0));
-    // Push index arg location
-    push(NUMBER_VAL(0));
-    // Set up call window
-    call(waveFunction, 2);
+    WaveRunner runner;
+    beginWaveFunction(vm, &runner, waveFunction, -1, 0, 1);
 
-    // Frame and Index pointer locations
-    Value* frame_loc = vm.stackTop - 2;
-    Value* index_loc = vm.stackTop - 1;
-    // IP counter reset point
-    uint8_t* reset_ip = vm.frames[vm.frameCount - 1].function->chunk.code;
     // Run and extract from waveFunction
-    _Complex double* freq_buffer = getFreqBuffer(&vm.wavetable, buffer_type);
+    _Complex double* freq_buffer = getFreqBuffer(&vm->wavetable, buffer_type);
     const int minFrame = (int)AS_NUMBER(args[1]);
     const int maxFrame = (int)AS_NUMBER(args[2]);
     for (int frame = minFrame; frame < maxFrame; frame++) {
-        // Edit current frame
-        frame_loc->as.number = frame;
-        // Reset frame->ip
-         vm.frames[vm.frameCount - 1].ip = reset_ip;
-
-        // Run
-        InterpretResult result = run();
-        // Check if it ran okay
-        if (result != INTERPRET_OK) {
+        // Index is always 0
+        double dc;
+        if (!runWaveFunction(&runner, runner.vectors, frame, 0, 1, &dc)) {
+            abortWaveFunction(&runner);
             return NATIVE_FAIL();
         }
 
         // Update buffer
-        freq_buffer[frame * WAVETABLE_FRAME_LEN] = AS_NUMBER(vm.output) * WAVETABLE_FRAME_LEN;
+        freq_buffer[frame * WAVETABLE_FRAME_LEN] = dc * WAVETABLE_FRAME_LEN;
     }
-    // Tear down call
-    CallFrame frame = vm.frames[vm.frameCount-- - 1];
-    vm.stackTop = frame.slots;
-    // Free Memory
-    freeChunk(&waveFunction->chunk);
+    endWaveFunction(&runner);
 
     return NATIVE_SUCCESS(NIL_VAL);
 }
 
+// Store one frame of editFreq results as sine magnitudes
+static void storeFreqFrame(_Complex double* freq_buffer, int frame, int minIndex, int maxIndex, const double* results) {
+    for (int index = minIndex; index < maxIndex; index++) {
+        freq_buffer[frame * WAVETABLE_FRAME_LEN + WAVETABLE_FRAME_LEN - index] = -results[index] * WAVETABLE_FRAME_LEN * I;
+        freq_buffer[frame * WAVETABLE_FRAME_LEN + index] = results[index] * WAVETABLE_FRAME_LEN * I;
+    }
+}
+
 // Edit wavetable buffer, freq domain
 // (buffer 0, minFrame 1, maxFrame 2, minIndex 3, maxIndex 4, function 5)
 // Arity 6
-static NativeFnReturn editFreqNative(int argCount, Value* args) {
-    if (checkEditArgs("editFreq", args, 1, 1025)) {
+static NativeFnReturn editFreqNative(VM* vm, int argCount, Value* args) {
+    if (checkEditArgs(vm, "editFreq", args, 1, 1025)) {
         return NATIVE_FAIL();
     }
 
     // Toggle to freq mode
     BufferType buffer_type = (BufferType)(int)AS_NUMBER(args[0]);
-    setTimeMode(&vm.wavetable, buffer_type, false);
+    setTimeMode(&vm->wavetable, buffer_type, false);
 
     // Compile function
-    ObjFunction* waveFunction = runtimeCompile(AS_CSTRING(args[5]));
+    ObjFunction* waveFunction = compileFormula(vm, AS_STRING(args[5]));
     // Check if compile failed
     if (waveFunction == NULL) {
-        runtimeError("editFreq: Failed wave function compiling");
+        runtimeError(vm, "editFreq: Failed wave function compiling");
         return NATIVE_FAIL();
     }
 
-    // Push function
-    push(OBJ_VAL(waveFunction));
-    // Push frame arg location
-    push(NUMBER_VAL(0));
-    // Push index arg location
-    push(NUMBER_VAL(0));
-    // Set up call window
-    call(waveFunction, 2);
-
-    // Frame and Index pointer locations
-    Value* frame_loc = vm.stackTop - 2;
-    Value* index_loc = vm.stackTop - 1;
-    // IP counter reset point
-    uint8_t* reset_ip = vm.frames[vm.frameCount - 1].function->chunk.code;
-    // Run and extract from waveFunction
-    _Complex double* freq_buffer = getFreqBuffer(&vm.wavetable, buffer_type);
     const int minFrame = (int)AS_NUMBER(args[1]);
     const int maxFrame = (int)AS_NUMBER(args[2]);
     const int minIndex = (int)AS_NUMBER(args[3]);
     const int maxIndex = (int)AS_NUMBER(args[4]);
-    for (int frame = minFrame; frame < maxFrame; frame++) {
-        // Edit current frame
-        frame_loc->as.number = frame;
-        for (int index = minIndex; index < maxIndex; index++) {
-            // Reset frame->ip
-            vm.frames[vm.frameCount - 1].ip = reset_ip;
-            // Edit current index
-            index_loc->as.number = index;
-
-            // Run
-            InterpretResult result = run();
-            // Check if it ran okay
-            if (result != INTERPRET_OK) {
-                return NATIVE_FAIL();
-            }
+    WaveRunner runner;
+    beginWaveFunction(vm, &runner, waveFunction, -1, minIndex, maxIndex);
 
-            // Update buffer
-            freq_buffer[frame * WAVETABLE_FRAME_LEN + WAVETABLE_FRAME_LEN - index] = -AS_NUMBER(vm.output) * WAVETABLE_FRAME_LEN * I;
-            freq_buffer[frame * WAVETABLE_FRAME_LEN + index] = AS_NUMBER(vm.output) * WAVETABLE_FRAME_LEN * I;
-        }
+    // Run and extract from waveFunction
+    WaveEdit edit = {&runner, minFrame, maxFrame, minIndex, maxIndex};
+    edit.freq_buffer = getFreqBuffer(&vm->wavetable, buffer_type);
+    edit.storeFrame = storeFreqFrame;
+    if (!runWaveEdit(&edit)) {
+        abortWaveFunction(&runner);
+        return NATIVE_FAIL();
     }
-    // Tear down call
-    CallFrame frame = vm.frames[vm.frameCount-- - 1];
-    vm.stackTop = frame.slots;
-    // Free Memory
-    freeChunk(&waveFunction->chunk);
+    endWaveFunction(&runner);
 
     return NATIVE_SUCCESS(NIL_VAL);
 }
 
+// Store one frame of editPhase results, keeping each magnitude
+static void storePhaseFrame(_Complex double* freq_buffer, int frame, int minIndex, int maxIndex, const double* phases) {
+    for (int index = minIndex; index < maxIndex; index++) {
+        // Calculate index low and high
+        const int index_low = frame * WAVETABLE_FRAME_LEN + index;
+        const int index_high = frame * WAVETABLE_FRAME_LEN + WAVETABLE_FRAME_LEN - index;
+
+        // Calculate magnitude
+        double _Complex raw_value = freq_buffer[index_low];
+        const double magnitude = csqrt(pow(creal(raw_value), 2) + pow(cimag(raw_value), 2));
+
+        // Update buffer
+        const double phase = phases[index];
+        freq_buffer[index_low] = -sin(phase) * magnitude - cos(phase) * magnitude * I;
+        freq_buffer[index_high] = -sin(phase) * magnitude + cos(phase) * magnitude * I;
+    }
+}
+
 // Edit wavetable buffer, freq domain, Phase
 // (buffer 0, minFrame 1, maxFrame 2, minIndex 3, maxIndex 4, function 5)
 // Function values should range between [0,2*M_PI)
 // Arity 6
-static NativeFnReturn editPhaseNative(int argCount, Value* args) {
-    if (checkEditArgs("editPhase", args, 1, 1025)) {
+static NativeFnReturn editPhaseNative(VM* vm, int argCount, Value* args) {
+    if (checkEditArgs(vm, "editPhase", args, 1, 1025)) {
         return NATIVE_FAIL();
     }
 
     // Toggle to freq mode
     BufferType buffer_type = (BufferType)(int)AS_NUMBER(args[0]);
-    setTimeMode(&vm.wavetable, buffer_type, false);
+    setTimeMode(&vm->wavetable, buffer_type, false);
 
     // Compile function
-    ObjFunction* waveFunction = runtimeCompile(AS_CSTRING(args[5]));
+    ObjFunction* waveFunction = compileFormula(vm, AS_STRING(args[5]));
     // Check if compile failed
     if (waveFunction == NULL) {
-        runtimeError("editPhase: Failed wave function compiling");
+        runtimeError(vm, "editPhase: Failed wave function compiling");
         return NATIVE_FAIL();
     }
 
-    // Push function
-    push(OBJ_VAL(waveFunction));
-    // Push frame arg location
-    push(NUMBER_VAL(0));
-    // Push index arg location
-    push(NUMBER_VAL(0));
-    // Set up call window
-    call(waveFunction, 2);
-
-    // Frame and Index pointer locations
-    Value* frame_loc = vm.stackTop - 2;
-    Value* index_loc = vm.stackTop - 1;
-    // IP counter reset point
-    uint8_t* reset_ip = vm.frames[vm.frameCount - 1].function->chunk.code;
-    // Run and extract from waveFunction
-    _Complex double* freq_buffer = getFreqBuffer(&vm.wavetable, buffer_type);
     const int minFrame = (int)AS_NUMBER(args[1]);
     const int maxFrame = (int)AS_NUMBER(args[2]);
     const int minIndex = (int)AS_NUMBER(args[3]);
     const int maxIndex = (int)AS_NUMBER(args[4]);
-    for (int frame = minFrame; frame < maxFrame; frame++) {
-        // Edit current frame
-        frame_loc->as.number = frame;
-        for (int index = minIndex; index < maxIndex; index++) {
-            // Reset frame->ip
-            vm.frames[vm.frameCount - 1].ip = reset_ip;
-            // Edit current index
-            index_loc->as.number = index;
-
-            // Calculate index low and high
-            const int index_low = frame * WAVETABLE_FRAME_LEN + index;
-            const int index_high = frame * WAVETABLE_FRAME_LEN + WAVETABLE_FRAME_LEN - index;
-
-            // Calculate magnitude
-            double _Complex raw_value = freq_buffer[index_low];
-            const double magnitude = csqrt(pow(creal(raw_value), 2) + pow(cimag(raw_value), 2));
-
-            // Run
-            InterpretResult result = run();
-            // Check if it ran okay
-            if (result != INTERPRET_OK) {
-                return NATIVE_FAIL();
-            }
+    WaveRunner runner;
+    beginWaveFunction(vm, &runner, waveFunction, -1, minIndex, maxIndex);
 
-            // Update buffer
-            const double phase = AS_NUMBER(vm.output);
-            freq_buffer[index_low] = -sin(phase) * magnitude - cos(phase) * magnitude * I;
-            freq_buffer[index_high] = -sin(phase) * magnitude + cos(phase) * magnitude * I;
-        }
+    // Run and extract from waveFunction
+    WaveEdit edit = {&runner, minFrame, maxFrame, minIndex, maxIndex};
+    edit.freq_buffer = getFreqBuffer(&vm->wavetable, buffer_type);
+    edit.storeFrame = storePhaseFrame;
+    if (!runWaveEdit(&edit)) {
+        abortWaveFunction(&runner);
+        return NATIVE_FAIL();
     }
-    // Tear down call
-    CallFrame frame = vm.frames[vm.frameCount-- - 1];
-    vm.stackTop = frame.slots;
-    // Free Memory
-    freeChunk(&waveFunction->chunk);
+    endWaveFunction(&runner);
 
     return NATIVE_SUCCESS(NIL_VAL);
 }
 // End of Native Functions
 
-/*
-    Native variables
-*/
-static void makeNativeVariable(const char* name, Value value) {
-    push(OBJ_VAL(copyString(name, (int)strlen(name))));
-    push(value);
-    tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
-    pop();
-    pop();
+// Register tier op with the same result as a native, -1 if there is none
+int nativeRegisterOp(NativeFn native) {
+    if (native == sinNative) return REG_SIN;
+    if (native == cosNative) return REG_COS;
+    if (native == tanNative) return REG_TAN;
+    if (native == asinNative) return REG_ASIN;
+    if (native == acosNative) return REG_ACOS;
+    if (native == atanNative) return REG_ATAN;
+    if (native == sqrtNative) return REG_SQRT;
+    if (native == floorNative) return REG_FLOOR;
+    if (native == ceilNative) return REG_CEIL;
+    if (native == roundNative) return REG_ROUND;
+    if (native == sawNative) return REG_SAW;
+    if (native == powNative) return REG_POW;
+    if (native == atan2Native) return REG_ATAN2;
+    if (native == mainTimeNative) return REG_MAIN_T;
+    if (native == aux1TimeNative) return REG_AUX1_T;
+    return -1;
 }
 
-static void defineNativeVariables() {
+/*
+    Native registry
+*/
+// A native function every VM defines
+typedef struct {
+    const char* name;
+    int length;
+    NativeFn function;
+    int arity;
+    // Without side effects, the compiler folds its calls on constants
+    bool isPure;
+} NativeEntry;
+
+// A read only global every VM defines
+typedef struct {
+    const char* name;
+    int length;
+    double value;
+} NativeVariable;
+
+#define NATIVE(name, function, arity) {name, sizeof(name) - 1, function, arity, false}
+#define PURE_NATIVE(name, function, arity) {name, sizeof(name) - 1, function, arity, true}
+#define NATIVE_VARIABLE(name, value) {name, sizeof(name) - 1, value}
+
+static const NativeEntry nativeFunctions[] = {
+    NATIVE("clock", clockNative, 0),
+    NATIVE("len", lenNative, 1),
+    NATIVE("type", typeNative, 1),
+    NATIVE("newArray", newArrayNative, 1),
+    NATIVE("fillArray", fillArrayNative, 2),
+    NATIVE("scaleArray", scaleArrayNative, 2),
+    NATIVE("copyArray", copyArrayNative, 2),
+    NATIVE("mixArray", mixArrayNative, 3),
+    NATIVE("timeView", timeViewNative, 1),
+    NATIVE("freqView", freqViewNative, 1),
+    PURE_NATIVE("round", roundNative, 1),
+    PURE_NATIVE("floor", floorNative, 1),
+    PURE_NATIVE("ceil", ceilNative, 1),
+    PURE_NATIVE("sqrt", sqrtNative, 1),
+    PURE_NATIVE("pow", powNative, 2),
+    PURE_NATIVE("sin", sinNative, 1),
+    PURE_NATIVE("cos", cosNative, 1),
+    PURE_NATIVE("tan", tanNative, 1),
+    PURE_NATIVE("asin", asinNative, 1),
+    PURE_NATIVE("acos", acosNative, 1),
+    PURE_NATIVE("atan", atanNative, 1),
+    PURE_NATIVE("atan2", atan2Native, 2),
+    PURE_NATIVE("saw", sawNative, 1),
+    NATIVE("rand", randNative, 0),
+    /* Wavetable native functions */
+    NATIVE("main_t", mainTimeNative, 2),
+    NATIVE("aux1_t", aux1TimeNative, 2),
+    NATIVE("frameNorm", frameNormalizeNative, 3),
+    NATIVE("randf", randfNative, 1),
+    NATIVE("randi", randiNative, 1),
+    NATIVE("importWav", wavImportNative, 2),
+    NATIVE("exportWav", wavExportNative, 4),
+    NATIVE("editWav", editWaveNative, 6),
+    NATIVE("editDC", editDCNative, 4),
+    NATIVE("editFreq", editFreqNative, 6),
+    NATIVE("editPhase", editPhaseNative, 6),
+};
+
+static const NativeVariable nativeVariables[] = {
     /*
         Math concepts
     */
     // Pi
-    makeNativeVariable("M_PI", NUMBER_VAL(M_PI));
+    NATIVE_VARIABLE("M_PI", M_PI),
     /*
         Object Types
     */
-    // Boolean
-    makeNativeVariable("BOOL_T", NUMBER_VAL(VAL_BOOL));
-    // Double
-    makeNativeVariable("NUMBER_T", NUMBER_VAL(VAL_NUMBER));
-    // Nil
-    makeNativeVariable("NIL_T", NUMBER_VAL(VAL_NIL));
-    // Function
-    makeNativeVariable("FUNC_T", NUMBER_VAL(VAL_OBJ + OBJ_FUNCTION));
-    // Native
-    makeNativeVariable("NATIVE_T", NUMBER_VAL(VAL_OBJ + OBJ_NATIVE));
-    // String
-    makeNativeVariable("STR_T", NUMBER_VAL(VAL_OBJ + OBJ_STRING));
-
+    NATIVE_VARIABLE("BOOL_T", VAL_BOOL),
+    NATIVE_VARIABLE("NUMBER_T", VAL_NUMBER),
+    NATIVE_VARIABLE("NIL_T", VAL_NIL),
+    NATIVE_VARIABLE("FUNC_T", VAL_OBJ + OBJ_FUNCTION),
+    NATIVE_VARIABLE("NATIVE_T", VAL_OBJ + OBJ_NATIVE),
+    NATIVE_VARIABLE("STR_T", VAL_OBJ + OBJ_STRING),
+    NATIVE_VARIABLE("ARRAY_T", VAL_OBJ + OBJ_ARRAY),
     /* 
         Random
     */
-    // RAND_MAX
-    makeNativeVariable("RAND_MAX", NUMBER_VAL(RAND_MAX));
-
+    NATIVE_VARIABLE("RAND_MAX", RAND_MAX),
     /* 
         Wavetable buffer enum
     */
-    // Main
-    makeNativeVariable("MAIN_B", NUMBER_VAL(BUFFER_MAIN));
-    // Aux1
-    makeNativeVariable("AUX1_B", NUMBER_VAL(BUFFER_AUX1));
-
+    NATIVE_VARIABLE("MAIN_B", BUFFER_MAIN),
+    NATIVE_VARIABLE("AUX1_B", BUFFER_AUX1),
     /*
         Wavetable constants
     */
     // Max frames
-    makeNativeVariable("FRAME_MAX", NUMBER_VAL(WAVETABLE_MAX_FRAMES - 1));
+    NATIVE_VARIABLE("FRAME_MAX", WAVETABLE_MAX_FRAMES - 1),
     // Last frame
-    makeNativeVariable("FRAME_LAST", NUMBER_VAL(WAVETABLE_MAX_FRAMES));
+    NATIVE_VARIABLE("FRAME_LAST", WAVETABLE_MAX_FRAMES),
     // Max indeces
-    makeNativeVariable("FRAME_LEN", NUMBER_VAL(WAVETABLE_FRAME_LEN));
-    // Export qualities
-    // High
-    makeNativeVariable("HIGH_Q", NUMBER_VAL(32));
-    // Medium
-    makeNativeVariable("MED_Q", NUMBER_VAL(16));
-    // Low / Experimental
-    makeNativeVariable("LOW_Q", NUMBER_VAL(8));
-}
-// End of native variables
-
-static void resetStack() {
-    vm.stackTop = vm.stack;
-    vm.frameCount = 0;
+    NATIVE_VARIABLE("FRAME_LEN", WAVETABLE_FRAME_LEN),
+    // Export qualities: high, medium, low / experimental
+    NATIVE_VARIABLE("HIGH_Q", 32),
+    NATIVE_VARIABLE("MED_Q", 16),
+    NATIVE_VARIABLE("LOW_Q", 8),
+};
+
+#undef NATIVE
+#undef PURE_NATIVE
+#undef NATIVE_VARIABLE
+// End of native registry
+
+static void resetStack(VM* vm) {
+    vm->stackTop = vm->stack;
+    vm->frameCount = 0;
 }
 
 // Raise a runtime
-static void runtimeError(const char* format, ...) {
+static void runtimeError(VM* vm, const char* format, ...) {
     va_list args;
     va_start(args, format);
     vfprintf(stderr, format, args);
@@ -778,8 +1068,8 @@ static void runtimeError(const char* format, ...) {
     fputs("\n", stderr);
 
     // Stack trace error reporting
-    for (int i = vm.frameCount - 1; i >= 0; i--) {
-        CallFrame* frame = &vm.frames[i];
+    for (int i = vm->frameCount - 1; i >= 0; i--) {
+        CallFrame* frame = &vm->frames[i];
         ObjFunction* function = frame->function;
         size_t instruction = frame->ip - function->chunk.code - 1;
         // Print line
@@ -792,150 +1082,158 @@ static void runtimeError(const char* format, ...) {
         }
     }
 
-    resetStack();
+    resetStack(vm);
 }
 
-/*
-    Define a native function
-*/
-static void defineNative(const char* name, NativeFn function, int arity) {
-    push(OBJ_VAL(copyString(name, (int)strlen(name))));
-    push(OBJ_VAL(newNative(function, arity)));
-    tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
-    pop();
-    pop();
-}
-
-void initVM() {
-    resetStack();
-    vm.objects = NULL;
-    initTable(&vm.globals);
-    initTable(&vm.strings);
-
-    /* Init Native Functions */
-    defineNative("clock", clockNative, 0);
-    defineNative("len", lenNative, 1);
-    defineNative("type", typeNative, 1);
-    defineNative("round", roundNative, 1);
-    defineNative("floor", floorNative, 1);
-    defineNative("ceil", ceilNative, 1);
-    defineNative("sqrt", sqrtNative, 1);
-    defineNative("pow", powNative, 2);
-    defineNative("sin", sinNative, 1);
-    defineNative("cos", cosNative, 1);
-    defineNative("tan", tanNative, 1);
-    defineNative("asin", asinNative, 1);
-    defineNative("acos", acosNative, 1);
-    defineNative("atan", atanNative, 1);
-    defineNative("atan2", atan2Native, 2);
-    defineNative("saw", sawNative, 1);
-    defineNative("rand", randNative, 0);
-    /* Init Native Variables */
-    defineNativeVariables();
+// Define a read only global under an interned name
+static void defineNativeGlobal(VM* vm, const char* name, int length, Value value) {
+    push(vm, value);
+    ObjString* string = copyString(vm, name, length);
+    string->isNative = true;
+    tableSet(&vm->globals, string, vm->stackTop[-1]);
+    pop(vm);
+}
+
+// Define everything in the native registry
+// The tables are sized for it first, so none is rebuilt while it is filled
+static void defineNatives(VM* vm) {
+    int functionCount = sizeof(nativeFunctions) / sizeof(nativeFunctions[0]);
+    int variableCount = sizeof(nativeVariables) / sizeof(nativeVariables[0]);
+    tableReserve(&vm->globals, functionCount + variableCount);
+    tableReserve(&vm->strings, functionCount + variableCount);
+
+    for (int entry = 0; entry < functionCount; entry++) {
+        const NativeEntry* native = &nativeFunctions[entry];
+        ObjNative* function = newNative(vm, native->function, native->arity);
+        function->isPure = native->isPure;
+        defineNativeGlobal(vm, native->name, native->length, OBJ_VAL(function));
+    }
+    for (int entry = 0; entry < variableCount; entry++) {
+        defineNativeGlobal(vm, nativeVariables[entry].name, nativeVariables[entry].length, NUMBER_VAL(nativeVariables[entry].value));
+    }
+}
+
+// Empty wavetable every script starts from
+// Buffers are allocated on first touch, randf and randi values are drawn on first use
+static void initStartupWavetable(VM* vm) {
+    initWavetable(&vm->wavetable, "untitled", 256, 44100, 16, 1, NULL, NULL);
+}
+
+void initVM(VM* vm) {
+#ifdef DEBUG_PROFILE_STARTUP
+    clock_t start = clock();
+#endif
+    resetStack(vm);
+    vm->objects = NULL;
+    vm->output = NIL_VAL;
+    vm->bytesAllocated = 0;
+    vm->nextGC = GC_HEAP_INITIAL;
+    vm->heapGrowFactor = GC_HEAP_GROW_FACTOR;
+    vm->grayCount = 0;
+    vm->grayCapacity = 0;
+    vm->grayStack = NULL;
+    vm->compiler = NULL;
+    initTable(&vm->globals);
+    initTable(&vm->strings);
+    memset(vm->formulas, 0, sizeof(vm->formulas));
+    vm->formulaClock = 0;
+    vm->scriptPath = NULL;
+    vm->modules = NULL;
+    vm->moduleCount = 0;
+    vm->moduleCapacity = 0;
+
+    defineNatives(vm);
 
     // Init rand
     srand(time(NULL));
     rand();
 
-    /* Init wavetable */
-    // Get frame rand values
-    int* randf = (int*)malloc(sizeof(int) * WAVETABLE_MAX_FRAMES);
-    for (int frame = 0; frame < WAVETABLE_MAX_FRAMES; frame++) {
-        randf[frame] = rand();
-    }
-    // Get index rand values
-    int* randi = (int*)malloc(sizeof(int) * WAVETABLE_FRAME_LEN);
-    for (int index = 0; index < WAVETABLE_FRAME_LEN; index++) {
-        randi[index] = rand();
-    }
-    initWavetable(&vm.wavetable, "untitled", 256, 44100, 16, 1, randf, randi);
-    /* Wavetable native functions */
-    defineNative("main_t", mainTimeNative, 2);
-    defineNative("aux1_t", aux1TimeNative, 2);
-    defineNative("frameNorm", frameNormalizeNative, 3);
-    defineNative("randf", randfNative, 1);
-    defineNative("randi", randiNative, 1);
-    defineNative("importWav", wavImportNative, 2);
-    defineNative("exportWav", wavExportNative, 4);
-    defineNative("editWav", editWaveNative, 6);
-    defineNative("editDC", editDCNative, 4);
-    defineNative("editFreq", editFreqNative, 6);
-    defineNative("editPhase", editPhaseNative, 6);
-}
-
-void freeVM() {
-    freeTable(&vm.globals);
-    freeTable(&vm.strings);
-    freeWavetable(&vm.wavetable);
-    freeObjects();
+    initStartupWavetable(vm);
+
+#ifdef DEBUG_PROFILE_STARTUP
+    double micros = (double)(clock() - start) * 1000000 / CLOCKS_PER_SEC;
+    fprintf(stderr, "Startup took %.1f us of a %d us budget\n", micros, STARTUP_BUDGET_US);
+#endif
+}
+
+void freeVM(VM* vm) {
+#ifdef DEBUG_PROFILE_OPCODES
+    printProfile();
+#endif
+    freeFormulas(vm);
+    FREE_ARRAY(Module, vm->modules, vm->moduleCapacity);
+    freeTable(&vm->globals);
+    freeTable(&vm->strings);
+    freeWavetable(&vm->wavetable);
+    freeObjects(vm);
 }
 
 // Push new value onto the stack
-void push(Value value) {
-    *vm.stackTop = value;
-    vm.stackTop++;
+void push(VM* vm, Value value) {
+    *vm->stackTop = value;
+    vm->stackTop++;
 }
 
 // Pop value off the stack
-Value pop() {
-    vm.stackTop--;
-    return *vm.stackTop;
+Value pop(VM* vm) {
+    vm->stackTop--;
+    return *vm->stackTop;
 }
 
 // Look at value 'distance' from the top of the stack
-static Value peek(int distance) {
-    return vm.stackTop[-1 - distance];
+static Value peek(VM* vm, int distance) {
+    return vm->stackTop[-1 - distance];
 }
 
 // Call a function
-static bool call(ObjFunction* function, int argCount) {
+static bool call(VM* vm, ObjFunction* function, int argCount) {
     // Check arg counts
     if (argCount != function->arity) {
-        runtimeError("Expected %d arguments but got %d", function->arity, argCount);
+        runtimeError(vm, "Expected %d arguments but got %d", function->arity, argCount);
         return false;
     }
 
     // Check stack depth
-    if (vm.frameCount == FRAMES_MAX) {
-        runtimeError("Stack overflow");
+    if (vm->frameCount == FRAMES_MAX) {
+        runtimeError(vm, "Stack overflow");
         return false;
     }
 
-    CallFrame* frame = &vm.frames[vm.frameCount++];
+    CallFrame* frame = &vm->frames[vm->frameCount++];
     frame->function = function;
     frame->ip = function->chunk.code;
-    frame->slots = vm.stackTop - argCount - 1;
+    frame->slots = vm->stackTop - argCount - 1;
     return true;
 }
 
 // Check function call
-static bool callValue(Value callee, int argCount) {
+static bool callValue(VM* vm, Value callee, int argCount) {
     if (IS_OBJ(callee)) {
         switch (OBJ_TYPE(callee)) {
             case OBJ_FUNCTION:
-                return call(AS_FUNCTION(callee), argCount);
+                return call(vm, AS_FUNCTION(callee), argCount);
             case OBJ_NATIVE: {
                 NativeFn native = AS_NATIVE(callee)->function;
                 int arity = AS_NATIVE(callee)->arity;
                 // Check arity
                 if (argCount != arity) {
-                    runtimeError("Expected %d arguments but got %d", arity, argCount);
+                    runtimeError(vm, "Expected %d arguments but got %d", arity, argCount);
                     return false;
                 }
                 // Run function
-                NativeFnReturn result = native(argCount, vm.stackTop - argCount);
+                NativeFnReturn result = native(vm, argCount, vm->stackTop - argCount);
                 if (result.failed) {
                     return false;
                 }
-                vm.stackTop -= argCount + 1;
-                push(result.value);
+                vm->stackTop -= argCount + 1;
+                push(vm, result.value);
                 return true;
             }
             default:
                 break; /// Non-callable object
         }
     }
-    runtimeError("Can only call functions and classes");
+    runtimeError(vm, "Can only call functions and classes");
     return false;
 }
 
@@ -946,9 +1244,9 @@ static bool isFalse(Value value) {
 }
 
 // Concatenate two strings
-static void concatenate() {
-    ObjString* b = AS_STRING(pop());
-    ObjString* a = AS_STRING(pop());
+static void concatenate(VM* vm) {
+    ObjString* b = AS_STRING(pop(vm));
+    ObjString* a = AS_STRING(pop(vm));
 
     int length = a->length + b->length;
     char* chars = ALLOCATE(char, length + 1);
@@ -956,16 +1254,16 @@ static void concatenate() {
     memcpy(chars + a->length, b->chars, b->length);
     chars[length] = '\0';
 
-    ObjString* result = takeString(chars, length);
-    push(OBJ_VAL(result));
+    ObjString* result = takeTransientString(vm, chars, length);
+    push(vm, OBJ_VAL(result));
 }
 
 // Multiply a string
-static void multiplyStringA(int times) {
-    ObjString* a = AS_STRING(pop());
+static void multiplyStringA(VM* vm, int times) {
+    ObjString* a = AS_STRING(pop(vm));
 
     if (times == 1) {
-        push(OBJ_VAL(a));
+        push(vm, OBJ_VAL(a));
     } else {
         int length = a->length * (times > 0 ? times : 0);
         char* chars = ALLOCATE(char, length + 1);
@@ -973,18 +1271,18 @@ static void multiplyStringA(int times) {
             memcpy(chars + offset, a->chars, a->length);
         chars[length] = '\0';
 
-        ObjString* result = takeString(chars, length);
-        push(OBJ_VAL(result));
+        ObjString* result = takeTransientString(vm, chars, length);
+        push(vm, OBJ_VAL(result));
     }
 }
 
 // Multiply b string
-static void multiplyStringB(int times) {
-    ObjString* b = AS_STRING(pop());
-    vm.stackTop--;
+static void multiplyStringB(VM* vm, int times) {
+    ObjString* b = AS_STRING(pop(vm));
+    vm->stackTop--;
 
     if (times == 1) {
-        push(OBJ_VAL(b));
+        push(vm, OBJ_VAL(b));
     } else {
         int length = b->length * times;
         char* chars = ALLOCATE(char, length + 1);
@@ -992,41 +1290,124 @@ static void multiplyStringB(int times) {
             memcpy(chars + offset, b->chars, b->length);
         chars[length] = '\0';
 
-        ObjString* result = takeString(chars, length);
-        push(OBJ_VAL(result));
+        ObjString* result = takeTransientString(vm, chars, length);
+        push(vm, OBJ_VAL(result));
     }
 }
 
-// Add turns the top value on the stack into a string
-static void stringify() {
-    Value b = vm.stackTop[-1];
+// Longest %g of a number
+#define NUMBER_STRING_MAX 24
+
+// Join the top count values into one string, numbers, bools and nil are written out
+// Everything is copied once into a single allocation
+static bool buildString(VM* vm, int count) {
+    Value* segments = vm->stackTop - count;
+    char numbers[UINT8_MAX][NUMBER_STRING_MAX + 1];
+    const char* chars[UINT8_MAX];
+    int lengths[UINT8_MAX];
+
+    int length = 0;
+    for (int segment = 0; segment < count; segment++) {
+        Value value = segments[segment];
+        if (IS_STRING(value)) {
+            chars[segment] = AS_CSTRING(value);
+            lengths[segment] = AS_STRING(value)->length;
+        } else if (IS_NUMBER(value)) {
+            chars[segment] = numbers[segment];
+            lengths[segment] = snprintf(numbers[segment], NUMBER_STRING_MAX, "%g", AS_NUMBER(value));
+        } else if (IS_BOOL(value)) {
+            chars[segment] = isFalse(value) ? "false" : "true";
+            lengths[segment] = (int)strlen(chars[segment]);
+        } else if (IS_NIL(value)) {
+            chars[segment] = "nil";
+            lengths[segment] = 3;
+        } else if (IS_ARRAY(value)) {
+            runtimeError(vm, "Cannot interpolate arrays");
+            return false;
+        } else {
+            runtimeError(vm, "Cannot interpolate functions");
+            return false;
+        }
+        length += lengths[segment];
+    }
 
-    // Convert b into 
-    if (IS_NUMBER(b)) {
-        #define VALUE_B_LENGTH 25
-        // Turn double into string
-        char* buffer = ALLOCATE(char, VALUE_B_LENGTH);
-        int len = snprintf(buffer, VALUE_B_LENGTH - 1, "%g", AS_NUMBER(b));
-        buffer[len] = '\0';
+    char* result = ALLOCATE(char, length + 1);
+    char* end = result;
+    for (int segment = 0; segment < count; segment++) {
+        memcpy(end, chars[segment], lengths[segment]);
+        end += lengths[segment];
+    }
+    *end = '\0';
+
+    ObjString* string = takeTransientString(vm, result, length);
+    vm->stackTop = segments;
+    push(vm, OBJ_VAL(string));
+    return true;
+}
 
-        // Extract string
-        vm.stackTop[-1] = OBJ_VAL(takeString(buffer, len));
-        #undef VALUE_B_LENGTH
+#undef NUMBER_STRING_MAX
 
-    } else if (IS_BOOL(b)) {
-        // Get proper bool string
-        if (isFalse(b))
-            vm.stackTop[-1] = OBJ_VAL(copyString("false", 5));
-        else
-            vm.stackTop[-1] = OBJ_VAL(copyString("true", 4));
-    } else if (IS_NIL(b)) {
-        // Turn int "nil"
-        vm.stackTop[-1] = OBJ_VAL(copyString("nil", 3));
+// Element of array at index, wrapping negative indexes around
+// Returns NULL after reporting an error if the index is not a number or out of bounds
+static double* arrayElement(VM* vm, ObjArray* array, Value index) {
+    if (!IS_NUMBER(index)) {
+        runtimeError(vm, "Index must be a number");
+        return NULL;
     }
+    syncBufferView(vm, array);
+    int element = (int)AS_NUMBER(index);
+    if (element < 0) {
+        element += array->length;
+    }
+    if (element < 0 || element >= array->length) {
+        runtimeError(vm, "Index out of bounds");
+        return NULL;
+    }
+    return &array->values[element];
+}
+
+// Slice an array with the same bounds as a substring
+// Contiguous slices are views of the array, strided slices are copied
+// The array must stay on the stack, allocating the slice can collect garbage
+static ObjArray* sliceArray(VM* vm, ObjArray* array, int start, int end, int interval) {
+    int count = 0;
+    // Do not start slice out of bounds
+    if (0 <= start && start < array->length) {
+        if (interval > 0) {
+            // Bind end to length
+            if (end > array->length) {
+                end = array->length;
+            }
+            if (end > start) {
+                count = (end - start + interval - 1) / interval;
+            }
+        } else {
+            // Bind end to -1
+            if (end < -1) {
+                end = -1;
+            }
+            if (start > end) {
+                count = (start - end - interval - 1) / -interval;
+            }
+        }
+    }
+
+    if (count == 0) {
+        return newArrayView(vm, array, 0, 0);
+    }
+    if (interval == 1) {
+        return newArrayView(vm, array, start, count);
+    }
+    ObjArray* slice = newArray(vm, count);
+    syncBufferView(vm, array);
+    for (int index = 0; index < count; index++) {
+        slice->values[index] = array->values[start + index * interval];
+    }
+    return slice;
 }
 
 // Push a substring of an object onto the stack
-static void pushIndexRange(char* str, int len, int start, int end, int interval) {
+static void pushIndexRange(VM* vm, char* str, int len, int start, int end, int interval) {
     // Allocate buffer
     char* buffer = ALLOCATE(char, len + 1);
 
@@ -1057,16 +1438,183 @@ static void pushIndexRange(char* str, int len, int start, int end, int interval)
     }
 
     buffer[count] = '\0';
-    push(OBJ_VAL(takeString(buffer, count)));
+    push(vm, OBJ_VAL(takeTransientString(vm, buffer, count)));
 }
 
 // Define a global variable
-static void defGlobal(ObjString* name) {
-    tableSet(&vm.globals, name, peek(0));
-    pop();
+static bool defGlobal(VM* vm, ObjString* name) {
+    if (name->isNative) {
+        runtimeError(vm, "Cannot redefine native '%s'", name->chars);
+        return false;
+    }
+    tableSet(&vm->globals, name, peek(vm, 0));
+    pop(vm);
+    return true;
+}
+
+#ifdef _WIN32
+#define MODULE_PATH_MAX _MAX_PATH
+#else
+#define MODULE_PATH_MAX PATH_MAX
+#endif
+
+// Read a whole module source, NULL if it cannot be read
+static char* readModule(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    size_t fileSize = ftell(file);
+    rewind(file);
+
+    char* buffer = (char*)malloc(fileSize + 1);
+    if (buffer == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+    buffer[bytesRead] = '\0';
+    fclose(file);
+    return buffer;
+}
+
+// Find the module compiled from path, compiling it the first time
+// Uses the bytecode file next to the module like a script does
+// Module cached under a canonical path, NULL if there is none yet
+static Module* cachedModule(VM* vm, ObjString* path) {
+    for (int module = 0; module < vm->moduleCount; module++) {
+        // Paths are interned
+        if (vm->modules[module].path == path) return &vm->modules[module];
+    }
+    return NULL;
 }
 
-static InterpretResult run() {
+static Module* addModule(VM* vm, ObjString* path, ObjFunction* function) {
+    if (vm->moduleCount == vm->moduleCapacity) {
+        int oldCapacity = vm->moduleCapacity;
+        vm->moduleCapacity = GROW_CAPACITY(oldCapacity);
+        vm->modules = GROW_ARRAY(Module, vm->modules, oldCapacity, vm->moduleCapacity);
+    }
+    Module* module = &vm->modules[vm->moduleCount++];
+    module->path = path;
+    module->function = function;
+    module->isLoaded = false;
+    return module;
+}
+
+// Absolute path of a file without links, "." or "..", so every way of naming it finds the same module
+// Returns the path interned, or NULL if the file does not exist
+static ObjString* canonicalPath(VM* vm, const char* path) {
+    char canonical[MODULE_PATH_MAX];
+#ifdef _WIN32
+    if (_fullpath(canonical, path, MODULE_PATH_MAX) == NULL) return NULL;
+#else
+    if (realpath(path, canonical) == NULL) return NULL;
+#endif
+    return copyString(vm, canonical, (int)strlen(canonical));
+}
+
+static Module* findModule(VM* vm, ObjString* path) {
+    Module* cached = cachedModule(vm, path);
+    if (cached != NULL) return cached;
+
+    char* source = readModule(path->chars);
+    if (source == NULL) {
+        runtimeError(vm, "Could not open module \"%s\"", path->chars);
+        return NULL;
+    }
+    char* cachePath = bytecodePath(path->chars);
+    ObjFunction* function = loadBytecode(vm, cachePath, source);
+    if (function == NULL) {
+        function = compile(vm, source);
+        if (function != NULL) saveBytecode(function, cachePath, source);
+    }
+    FREE_ARRAY(char, cachePath, strlen(cachePath) + 1);
+    free(source);
+    if (function == NULL) {
+        runtimeError(vm, "Could not compile module \"%s\"", path->chars);
+        return NULL;
+    }
+    return addModule(vm, path, function);
+}
+
+// Path of a module relative to the file importing it
+// Imports only happen at top level, so the importer is the script or a module
+static ObjString* resolveModulePath(VM* vm, ObjString* path) {
+    const char* importer = vm->scriptPath;
+    ObjFunction* function = vm->frames[vm->frameCount - 1].function;
+    for (int module = 0; module < vm->moduleCount; module++) {
+        if (vm->modules[module].function == function) importer = vm->modules[module].path->chars;
+    }
+
+    bool isAbsolute = path->chars[0] == '/' || path->chars[0] == '\\' || (path->length > 1 && path->chars[1] == ':');
+    int directory = 0;
+    if (importer != NULL && !isAbsolute) {
+        for (int i = 0; importer[i] != '\0'; i++) {
+            if (importer[i] == '/' || importer[i] == '\\') directory = i + 1;
+        }
+    }
+    if (directory == 0) return path;
+
+    int length = directory + path->length;
+    char* chars = ALLOCATE(char, length + 1);
+    memcpy(chars, importer, directory);
+    memcpy(chars + directory, path->chars, path->length);
+    chars[length] = '\0';
+    ObjString* resolved = copyString(vm, chars, length);
+    FREE_ARRAY(char, chars, length + 1);
+    return resolved;
+}
+
+// Call a module's top level unless it already ran into the current globals
+// Pushes its nil result right away if it did
+static bool importModule(VM* vm, ObjString* path) {
+    ObjString* resolved = resolveModulePath(vm, path);
+    ObjString* canonical = canonicalPath(vm, resolved->chars);
+    if (canonical == NULL) {
+        runtimeError(vm, "Could not open module \"%s\"", resolved->chars);
+        return false;
+    }
+    // Kept alive while the module compiles
+    push(vm, OBJ_VAL(canonical));
+    Module* module = findModule(vm, canonical);
+    if (module == NULL) return false;
+    pop(vm);
+    if (module->isLoaded) {
+        push(vm, NIL_VAL);
+        return true;
+    }
+
+    // Set before running, so modules importing each other run once
+    module->isLoaded = true;
+    push(vm, OBJ_VAL(module->function));
+    return call(vm, module->function, 0);
+}
+
+// Cache the script being run as a module that already ran
+// A module importing the script back then finds it loaded instead of running it a second time
+static void addScriptModule(VM* vm, ObjFunction* function) {
+    if (vm->scriptPath == NULL) return;
+    ObjString* path = canonicalPath(vm, vm->scriptPath);
+    if (path == NULL) return;
+
+    Module* module = cachedModule(vm, path);
+    if (module == NULL) module = addModule(vm, path, function);
+    module->function = function;
+    module->isLoaded = true;
+}
+
+void resetGlobals(VM* vm) {
+    tableRemoveNonNatives(&vm->globals);
+    // Buffers and random tables of the last script are dropped too
+    freeWavetable(&vm->wavetable);
+    initStartupWavetable(vm);
+    for (int module = 0; module < vm->moduleCount; module++) {
+        vm->modules[module].isLoaded = false;
+    }
+}
+
+static InterpretResult run(VM* vm) {
 #define READ_BYTE() (*frame->ip++)
 #define READ_SHORT() (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
 #define READ_LONG() (frame->ip += 3, ((frame->ip[-3]) << 16 | (frame->ip[-2] << 8) | frame->ip[-1]))
@@ -1076,39 +1624,83 @@ static InterpretResult run() {
 #define READ_STRING_LONG() AS_STRING(READ_CONSTANT_LONG())
 #define BINARY_OP(valueType, op) \
     do { \
-        if (!(IS_NUMBER(peek(0)) || IS_BOOL(peek(0))) || !(IS_NUMBER(peek(1)) || IS_BOOL(peek(1)))) { \
-            runtimeError("Operands must be numbers or bools"); \
+        if (!(IS_NUMBER(peek(vm, 0)) || IS_BOOL(peek(vm, 0))) || !(IS_NUMBER(peek(vm, 1)) || IS_BOOL(peek(vm, 1)))) { \
+            runtimeError(vm, "Operands must be numbers or bools"); \
             return INTERPRET_RUNTIME_ERROR; \
         } \
-        int option = IS_NUMBER(peek(0)) << 1 | IS_NUMBER(peek(1)); \
+        int option = IS_NUMBER(peek(vm, 0)) << 1 | IS_NUMBER(peek(vm, 1)); \
         switch(option) { \
             case 0: \
-                vm.stackTop -= 2; \
-                push(BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm.stackTop[0]) op AS_BOOL(vm.stackTop[1]))))); \
+                vm->stackTop -= 2; \
+                push(vm, BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm->stackTop[0]) op AS_BOOL(vm->stackTop[1]))))); \
                 break; \
             case 1: \
-                vm.stackTop -= 2; \
-                push(valueType(AS_NUMBER(vm.stackTop[0]) op AS_BOOL(vm.stackTop[1]))); \
+                vm->stackTop -= 2; \
+                push(vm, valueType(AS_NUMBER(vm->stackTop[0]) op AS_BOOL(vm->stackTop[1]))); \
                 break; \
             case 2: \
-                vm.stackTop -= 2; \
-                push(valueType(AS_BOOL(vm.stackTop[0]) op AS_NUMBER(vm.stackTop[1]))); \
+                vm->stackTop -= 2; \
+                push(vm, valueType(AS_BOOL(vm->stackTop[0]) op AS_NUMBER(vm->stackTop[1]))); \
                 break; \
             case 3: \
-                vm.stackTop -= 2; \
-                push(valueType(AS_NUMBER(vm.stackTop[0]) op AS_NUMBER(vm.stackTop[1]))); \
+                vm->stackTop -= 2; \
+                push(vm, valueType(AS_NUMBER(vm->stackTop[0]) op AS_NUMBER(vm->stackTop[1]))); \
                 break; \
         } \
     } while (false);
+// Number fast path for superinstructions, falls back to the generic op otherwise
+#define FUSED_OP(operand, op, genericLabel) \
+    do { \
+        Value b = operand; \
+        if (IS_NUMBER(b) && IS_NUMBER(vm->stackTop[-1])) { \
+            vm->stackTop[-1].as.number = AS_NUMBER(vm->stackTop[-1]) op AS_NUMBER(b); \
+        } else { \
+            push(vm, b); \
+            goto genericLabel; \
+        } \
+    } while (false)
+// Compare and jump if false, otherwise pop the result and fall through
+#define COMPARE_JUMP(op) \
+    do { \
+        uint16_t loc = READ_SHORT(); \
+        BINARY_OP(BOOL_VAL, op); \
+        if (isFalse(peek(vm, 0))) frame->ip += loc; \
+        else pop(vm); \
+    } while (false)
+// Step a local by a number constant in place
+// Only numbers and bools can be stepped, anything else raises the generic op's error
+#define STEP_LOCAL(op, genericLabel) \
+    do { \
+        Value* local = &frame->slots[READ_BYTE()]; \
+        Value step = READ_CONSTANT(); \
+        if (IS_NUMBER(*local)) { \
+            local->as.number = AS_NUMBER(*local) op AS_NUMBER(step); \
+        } else if (IS_BOOL(*local)) { \
+            *local = NUMBER_VAL(AS_BOOL(*local) op AS_NUMBER(step)); \
+        } else { \
+            push(vm, *local); \
+            push(vm, step); \
+            goto genericLabel; \
+        } \
+    } while (false)
+// Read a global for a superinstruction
+#define READ_GLOBAL(value) \
+    do { \
+        ObjString* name = READ_STRING(); \
+        if (!tableGet(&vm->globals, name, &value)) { \
+            runtimeError(vm, "Undefined variable '%s'", name->chars); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+    } while (false)
 
     // Set up program counter and frame
-    CallFrame* frame = &vm.frames[vm.frameCount - 1];
+    CallFrame* frame = &vm->frames[vm->frameCount - 1];
 
     // Debug run tracing
     for (;;) {
     #ifdef DEBUG_TRACE_EXECUTION
         printf("          ");
-            for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
+            for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
                 printf("[ ");
                 printValue(*slot);
                 printf(" ]");
@@ -1116,21 +1708,24 @@ static InterpretResult run() {
         printf("\n");
         disassembleInstruction(&frame->function->chunk, (int)(frame->ip - frame->function->chunk.code));
     #endif
+    #ifdef DEBUG_PROFILE_OPCODES
+        profileInstruction(*frame->ip);
+    #endif
 
         uint8_t instruction;
         // Interpret current instruction and increment
         switch (instruction = READ_BYTE()) {
             // Equalities
             case OP_EQUAL: {
-                Value b = pop();
-                Value a = pop();
-                push(BOOL_VAL(valuesEqual(a, b)));
+                Value b = pop(vm);
+                Value a = pop(vm);
+                push(vm, BOOL_VAL(valuesEqual(a, b)));
                 break;
             }
             case OP_NOT_EQUAL: {
-                Value b = pop();
-                Value a = pop();
-                push(BOOL_VAL(!valuesEqual(a, b)));
+                Value b = pop(vm);
+                Value a = pop(vm);
+                push(vm, BOOL_VAL(!valuesEqual(a, b)));
                 break;
             }
 
@@ -1141,27 +1736,27 @@ static InterpretResult run() {
             case OP_LESS_EQUAL:     BINARY_OP(BOOL_VAL, <=); break;
 
             // Binary Arithmatic Operations
-            case OP_ADD: {
+            case OP_ADD: opAdd: {
                     int option = FOUR_TYPE_ID();
                     switch(option) {
                         case 5:
-                            vm.stackTop -= 2;
-                            push(BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm.stackTop[0]) + AS_BOOL(vm.stackTop[1])))));
+                            vm->stackTop -= 2;
+                            push(vm, BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm->stackTop[0]) + AS_BOOL(vm->stackTop[1])))));
                             break;
                         case 6:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_NUMBER(vm.stackTop[0]) + AS_BOOL(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_NUMBER(vm->stackTop[0]) + AS_BOOL(vm->stackTop[1])));
                             break;
                         case 9:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_BOOL(vm.stackTop[0]) + AS_NUMBER(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_BOOL(vm->stackTop[0]) + AS_NUMBER(vm->stackTop[1])));
                             break;
                         case 10:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_NUMBER(vm.stackTop[0]) + AS_NUMBER(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_NUMBER(vm->stackTop[0]) + AS_NUMBER(vm->stackTop[1])));
                             break;
                         case 15:
-                            concatenate();
+                            concatenate(vm);
                             break;
                         /* Errors */
                         case 0:
@@ -1171,36 +1766,36 @@ static InterpretResult run() {
                         case 4:
                         case 8:
                         case 12:
-                            runtimeError("Cannot add nil or functions");
+                            runtimeError(vm, "Cannot add nil or functions");
                             return INTERPRET_RUNTIME_ERROR;
                         case 7:
                         case 11:
                         case 13:
                         case 14:
-                            runtimeError("Can only concat two strings");
+                            runtimeError(vm, "Can only concat two strings");
                             return INTERPRET_RUNTIME_ERROR;
                     }
                 }
                 break;
             // Subtraction
-            case OP_SUBTRACT: {
+            case OP_SUBTRACT: opSubtract: {
                     int option = FOUR_TYPE_ID();
                     switch(option) {
                         case 5:
-                            vm.stackTop -= 2;
-                            push(BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm.stackTop[0]) - AS_BOOL(vm.stackTop[1])))));
+                            vm->stackTop -= 2;
+                            push(vm, BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm->stackTop[0]) - AS_BOOL(vm->stackTop[1])))));
                             break;
                         case 6:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_NUMBER(vm.stackTop[0]) - AS_BOOL(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_NUMBER(vm->stackTop[0]) - AS_BOOL(vm->stackTop[1])));
                             break;
                         case 9:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_BOOL(vm.stackTop[0]) - AS_NUMBER(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_BOOL(vm->stackTop[0]) - AS_NUMBER(vm->stackTop[1])));
                             break;
                         case 10:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_NUMBER(vm.stackTop[0]) - AS_NUMBER(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_NUMBER(vm->stackTop[0]) - AS_NUMBER(vm->stackTop[1])));
                             break;
                         /* Errors */
                         case 0:
@@ -1210,54 +1805,54 @@ static InterpretResult run() {
                         case 4:
                         case 8:
                         case 12:
-                            runtimeError("Cannot subtract nil or functions");
+                            runtimeError(vm, "Cannot subtract nil or functions");
                             return INTERPRET_RUNTIME_ERROR;
                         case 7:
                         case 11:
                         case 13:
                         case 14:
                         case 15:
-                            runtimeError("Cannot subtract strings");
+                            runtimeError(vm, "Cannot subtract strings");
                             return INTERPRET_RUNTIME_ERROR;
                     }
                 }
                 break;
             // Multiplication
-            case OP_MULTIPLY: {
+            case OP_MULTIPLY: opMultiply: {
                     int option = FOUR_TYPE_ID();
                     switch(option) {
                         // Basic number and bool combos
                         case 5:
-                            vm.stackTop -= 2;
-                            push(BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm.stackTop[0]) * AS_BOOL(vm.stackTop[1])))));
+                            vm->stackTop -= 2;
+                            push(vm, BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm->stackTop[0]) * AS_BOOL(vm->stackTop[1])))));
                             break;
                         case 6:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_NUMBER(vm.stackTop[0]) * AS_BOOL(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_NUMBER(vm->stackTop[0]) * AS_BOOL(vm->stackTop[1])));
                             break;
                         case 9:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_BOOL(vm.stackTop[0]) * AS_NUMBER(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_BOOL(vm->stackTop[0]) * AS_NUMBER(vm->stackTop[1])));
                             break;
                         case 10:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_NUMBER(vm.stackTop[0]) * AS_NUMBER(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_NUMBER(vm->stackTop[0]) * AS_NUMBER(vm->stackTop[1])));
                             break;
                         case 7:
-                            multiplyStringA(AS_BOOL(pop()));
+                            multiplyStringA(vm, AS_BOOL(pop(vm)));
                             break;
                         case 11:
-                            multiplyStringA((int)AS_NUMBER(pop()));
+                            multiplyStringA(vm, (int)AS_NUMBER(pop(vm)));
                             break;
                         case 13:
-                            multiplyStringB(AS_BOOL(vm.stackTop[-2]));
+                            multiplyStringB(vm, AS_BOOL(vm->stackTop[-2]));
                             break;
                         case 14:
-                            multiplyStringB((int)AS_NUMBER(vm.stackTop[-2]));
+                            multiplyStringB(vm, (int)AS_NUMBER(vm->stackTop[-2]));
                             break;
                         /* Errors */
                         case 15: // Str * str
-                            runtimeError("Can only multiply string by a number or bool");
+                            runtimeError(vm, "Can only multiply string by a number or bool");
                             return INTERPRET_RUNTIME_ERROR;
                         // Nil combos
                         case 0:
@@ -1267,31 +1862,31 @@ static InterpretResult run() {
                         case 4:
                         case 8:
                         case 12:
-                            runtimeError("Cannot multiply by nil or functions");
+                            runtimeError(vm, "Cannot multiply by nil or functions");
                             return INTERPRET_RUNTIME_ERROR;
                     }
                 }
                 break;
             // Division
-            case OP_DIVIDE: {
+            case OP_DIVIDE: opDivide: {
                     int option = FOUR_TYPE_ID();
                     switch(option) {
                         case 5:
-                            vm.stackTop -= 2;
+                            vm->stackTop -= 2;
                             // FIX DIVISION BY FALSE
-                            push(BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm.stackTop[0]) / 1))));
+                            push(vm, BOOL_VAL(!isFalse(BOOL_VAL(AS_BOOL(vm->stackTop[0]) / 1))));
                             break;
                         case 6:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_NUMBER(vm.stackTop[0]) / AS_BOOL(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_NUMBER(vm->stackTop[0]) / AS_BOOL(vm->stackTop[1])));
                             break;
                         case 9:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_BOOL(vm.stackTop[0]) / AS_NUMBER(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_BOOL(vm->stackTop[0]) / AS_NUMBER(vm->stackTop[1])));
                             break;
                         case 10:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(AS_NUMBER(vm.stackTop[0]) / AS_NUMBER(vm.stackTop[1])));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(AS_NUMBER(vm->stackTop[0]) / AS_NUMBER(vm->stackTop[1])));
                             break;
                         /* Errors */
                         case 0:
@@ -1301,14 +1896,14 @@ static InterpretResult run() {
                         case 4:
                         case 8:
                         case 12:
-                            runtimeError("Cannot divide by nil or functions");
+                            runtimeError(vm, "Cannot divide by nil or functions");
                             return INTERPRET_RUNTIME_ERROR;
                         case 7:
                         case 11:
                         case 13:
                         case 14:
                         case 15:
-                            runtimeError("Cannot divide strings");
+                            runtimeError(vm, "Cannot divide strings");
                             return INTERPRET_RUNTIME_ERROR;
                     }
                 }
@@ -1318,20 +1913,20 @@ static InterpretResult run() {
                     int option = FOUR_TYPE_ID();
                     switch(option) {
                         case 5:
-                            vm.stackTop -= 2;
-                            push(BOOL_VAL(0));
+                            vm->stackTop -= 2;
+                            push(vm, BOOL_VAL(0));
                             break;
                         case 6:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(fmod(AS_NUMBER(vm.stackTop[0]), AS_BOOL(vm.stackTop[1]))));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(fmod(AS_NUMBER(vm->stackTop[0]), AS_BOOL(vm->stackTop[1]))));
                             break;
                         case 9:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(fmod(AS_BOOL(vm.stackTop[0]), AS_NUMBER(vm.stackTop[1]))));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(fmod(AS_BOOL(vm->stackTop[0]), AS_NUMBER(vm->stackTop[1]))));
                             break;
                         case 10:
-                            vm.stackTop -= 2;
-                            push(NUMBER_VAL(fmod(AS_NUMBER(vm.stackTop[0]), AS_NUMBER(vm.stackTop[1]))));
+                            vm->stackTop -= 2;
+                            push(vm, NUMBER_VAL(fmod(AS_NUMBER(vm->stackTop[0]), AS_NUMBER(vm->stackTop[1]))));
                             break;
                         /* Errors */
                         case 0:
@@ -1341,184 +1936,272 @@ static InterpretResult run() {
                         case 4:
                         case 8:
                         case 12:
-                            runtimeError("Cannot mod by or functions");
+                            runtimeError(vm, "Cannot mod by or functions");
                             return INTERPRET_RUNTIME_ERROR;
                         case 7:
                         case 11:
                         case 13:
                         case 14:
                         case 15:
-                            runtimeError("Cannot mod strings");
+                            runtimeError(vm, "Cannot mod strings");
                             return INTERPRET_RUNTIME_ERROR;
                     }
                 }
                 break;
             
+            // Superinstructions
+            case OP_ADD_CONSTANT:       FUSED_OP(READ_CONSTANT(), +, opAdd); break;
+            case OP_SUBTRACT_CONSTANT:  FUSED_OP(READ_CONSTANT(), -, opSubtract); break;
+            case OP_MULTIPLY_CONSTANT:  FUSED_OP(READ_CONSTANT(), *, opMultiply); break;
+            case OP_DIVIDE_CONSTANT:    FUSED_OP(READ_CONSTANT(), /, opDivide); break;
+            case OP_ADD_LOCAL:          FUSED_OP(frame->slots[READ_BYTE()], +, opAdd); break;
+            case OP_SUBTRACT_LOCAL:     FUSED_OP(frame->slots[READ_BYTE()], -, opSubtract); break;
+            case OP_MULTIPLY_LOCAL:     FUSED_OP(frame->slots[READ_BYTE()], *, opMultiply); break;
+            case OP_DIVIDE_LOCAL:       FUSED_OP(frame->slots[READ_BYTE()], /, opDivide); break;
+            case OP_ADD_GLOBAL: {
+                Value value;
+                READ_GLOBAL(value);
+                FUSED_OP(value, +, opAdd);
+                break;
+            }
+            case OP_SUBTRACT_GLOBAL: {
+                Value value;
+                READ_GLOBAL(value);
+                FUSED_OP(value, -, opSubtract);
+                break;
+            }
+            case OP_MULTIPLY_GLOBAL: {
+                Value value;
+                READ_GLOBAL(value);
+                FUSED_OP(value, *, opMultiply);
+                break;
+            }
+            case OP_DIVIDE_GLOBAL: {
+                Value value;
+                READ_GLOBAL(value);
+                FUSED_OP(value, /, opDivide);
+                break;
+            }
+            case OP_GREATER_JUMP:       COMPARE_JUMP(>); break;
+            case OP_GREATER_EQUAL_JUMP: COMPARE_JUMP(>=); break;
+            case OP_LESS_JUMP:          COMPARE_JUMP(<); break;
+            case OP_LESS_EQUAL_JUMP:    COMPARE_JUMP(<=); break;
+            case OP_INCREMENT_LOCAL:    STEP_LOCAL(+, opAdd); break;
+            case OP_DECREMENT_LOCAL:    STEP_LOCAL(-, opSubtract); break;
+
+            // Counted loop, the step and limit are numbers
+            case OP_FOR_LOCAL: {
+                Value* local = &frame->slots[READ_BYTE()];
+                Value step = READ_CONSTANT();
+                double limit = AS_NUMBER(READ_CONSTANT());
+                uint8_t arithmetic = READ_BYTE();
+                uint8_t comparison = READ_BYTE();
+                uint16_t loc = READ_SHORT();
+                if (!IS_NUMBER(*local) && !IS_BOOL(*local)) {
+                    push(vm, *local);
+                    push(vm, step);
+                    if (arithmetic == OP_ADD) goto opAdd;
+                    goto opSubtract;
+                }
+                double value = IS_NUMBER(*local) ? AS_NUMBER(*local) : AS_BOOL(*local);
+                value = arithmetic == OP_ADD ? value + AS_NUMBER(step) : value - AS_NUMBER(step);
+                *local = NUMBER_VAL(value);
+                bool isLooping;
+                switch (comparison) {
+                    case OP_LESS:           isLooping = value < limit; break;
+                    case OP_LESS_EQUAL:     isLooping = value <= limit; break;
+                    case OP_GREATER:        isLooping = value > limit; break;
+                    default:                isLooping = value >= limit; break;
+                }
+                if (isLooping) frame->ip -= loc;
+                break;
+            }
+
             // Str Interpolation
-            case OP_INTERPOLATE_STR: {
-                // If both strings concatenate
-                if (!IS_STRING(vm.stackTop[-1])) 
-                    stringify();
-                concatenate();
+            case OP_BUILD_STRING: {
+                if (!buildString(vm, READ_BYTE())) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
                 break;
             }
 
             // Not Value
             case OP_NOT:
-                push(BOOL_VAL(isFalse(pop())));
+                push(vm, BOOL_VAL(isFalse(pop(vm))));
                 break;
             // Negate Value
             case OP_NEGATE:
-                if (!IS_NUMBER(peek(0))) {
-                    runtimeError("Operand must be a number");
+                if (!IS_NUMBER(peek(vm, 0))) {
+                    runtimeError(vm, "Operand must be a number");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                (vm.stackTop-1)->as.number = -AS_NUMBER(*(vm.stackTop-1));
+                (vm->stackTop-1)->as.number = -AS_NUMBER(*(vm->stackTop-1));
                 break;
 
             // Constant
             case OP_CONSTANT: {
                 Value constant = READ_CONSTANT();
-                push(constant);
+                push(vm, constant);
                 break;
             }
             // Constant long
             case OP_CONSTANT_LONG: {
                 Value constant = READ_CONSTANT_LONG();
-                push(constant);
+                push(vm, constant);
                 break;
             }
 
             // User literals
-            case OP_NIL: push(NIL_VAL); break;
-            case OP_TRUE: push(BOOL_VAL(1)); break;
-            case OP_FALSE: push(BOOL_VAL(0)); break;
+            case OP_NIL: push(vm, NIL_VAL); break;
+            case OP_TRUE: push(vm, BOOL_VAL(1)); break;
+            case OP_FALSE: push(vm, BOOL_VAL(0)); break;
 
             // Variables //
             // Globals
             case OP_GET_GLOBAL: {
                 ObjString* name = READ_STRING();
                 Value value;
-                if (!tableGet(&vm.globals, name, &value)) {
-                    runtimeError("Undefined variable '%s'", name->chars);
+                if (!tableGet(&vm->globals, name, &value)) {
+                    runtimeError(vm, "Undefined variable '%s'", name->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(value);
+                push(vm, value);
                 break;
             }
             case OP_GET_GLOBAL_LONG: {
                 ObjString* name = READ_STRING_LONG();
                 Value value;
-                if (!tableGet(&vm.globals, name, &value)) {
-                    runtimeError("Undefined variable '%s'", name->chars);
+                if (!tableGet(&vm->globals, name, &value)) {
+                    runtimeError(vm, "Undefined variable '%s'", name->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(value);
+                push(vm, value);
                 break;
             }
             case OP_GET_GLOBAL_STACK: {
-                if (!IS_STRING(peek(0))) {
-                    runtimeError("Can only use strings to access global variables");
+                if (!IS_STRING(peek(vm, 0))) {
+                    runtimeError(vm, "Can only use strings to access global variables");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                ObjString* name = AS_STRING(pop());
+                // Every global name is interned, a name with no interned equal is undefined
+                ObjString* name = findInternedString(vm, AS_STRING(pop(vm)));
                 Value value;
-                if (!tableGet(&vm.globals, name, &value)) {
-                    push(NIL_VAL);
+                if (name == NULL || !tableGet(&vm->globals, name, &value)) {
+                    push(vm, NIL_VAL);
                 } else {
-                    push(value);
+                    push(vm, value);
                 }
                 break;
             }
             case OP_GET_GLOBAL_STACK_POPLESS: {
-                if (!IS_STRING(peek(0))) {
-                    runtimeError("Can only use strings to access global variables");
+                if (!IS_STRING(peek(vm, 0))) {
+                    runtimeError(vm, "Can only use strings to access global variables");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                ObjString* name = AS_STRING(peek(0));
+                ObjString* name = findInternedString(vm, AS_STRING(peek(vm, 0)));
                 Value value;
-                if (!tableGet(&vm.globals, name, &value)) {
-                    push(NIL_VAL);
+                if (name == NULL || !tableGet(&vm->globals, name, &value)) {
+                    push(vm, NIL_VAL);
                 } else {
-                    push(value);
+                    push(vm, value);
                 }
                 break;
             }
             case OP_SET_GLOBAL: {
                 ObjString* name = READ_STRING();
-                if  (tableSet(&vm.globals, name, peek(0))) {
-                    tableDelete(&vm.globals, name);
-                    runtimeError("Undefined variable '%s'", name->chars);
+                if  (tableSet(&vm->globals, name, peek(vm, 0))) {
+                    tableDelete(&vm->globals, name);
+                    runtimeError(vm, "Undefined variable '%s'", name->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
             }
             case OP_SET_GLOBAL_LONG: {
                 ObjString* name = READ_STRING_LONG();
-                if  (tableSet(&vm.globals, name, peek(0))) {
-                    tableDelete(&vm.globals, name);
-                    runtimeError("Undefined variable '%s'", name->chars);
+                if  (tableSet(&vm->globals, name, peek(vm, 0))) {
+                    tableDelete(&vm->globals, name);
+                    runtimeError(vm, "Undefined variable '%s'", name->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
             }
             case OP_SET_GLOBAL_STACK: {
-                if (!IS_STRING(peek(1))) {
-                    runtimeError("Can only use strings to set global variables");
+                if (!IS_STRING(peek(vm, 1))) {
+                    runtimeError(vm, "Can only use strings to set global variables");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                ObjString* name = AS_STRING(peek(1));
-                if  (tableSet(&vm.globals, name, peek(0))) {
-                    tableDelete(&vm.globals, name);
-                    runtimeError("Undefined variable '%s'", name->chars);
+                ObjString* name = findInternedString(vm, AS_STRING(peek(vm, 1)));
+                if (name == NULL) {
+                    runtimeError(vm, "Undefined variable '%s'", AS_CSTRING(peek(vm, 1)));
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                pop();
+                if (name->isNative) {
+                    runtimeError(vm, "Cannot assign to native '%s'", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if  (tableSet(&vm->globals, name, peek(vm, 0))) {
+                    tableDelete(&vm->globals, name);
+                    runtimeError(vm, "Undefined variable '%s'", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                pop(vm);
                 break;
             }
-            case OP_DEFINE_GLOBAL: defGlobal(READ_STRING()); break;
-            case OP_DEFINE_GLOBAL_LONG: defGlobal(READ_STRING_LONG()); break;
+            case OP_DEFINE_GLOBAL:
+                if (!defGlobal(vm, READ_STRING())) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_DEFINE_GLOBAL_LONG:
+                if (!defGlobal(vm, READ_STRING_LONG())) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_IMPORT:
+                if (!importModule(vm, READ_STRING())) return INTERPRET_RUNTIME_ERROR;
+                frame = &vm->frames[vm->frameCount - 1];
+                break;
+            case OP_IMPORT_LONG:
+                if (!importModule(vm, READ_STRING_LONG())) return INTERPRET_RUNTIME_ERROR;
+                frame = &vm->frames[vm->frameCount - 1];
+                break;
             case OP_DEFINE_GLOBAL_STACK: {
-                if (!IS_STRING(peek(1))) {
-                    runtimeError("Can only use strings to define global variables");
+                if (!IS_STRING(peek(vm, 1))) {
+                    runtimeError(vm, "Can only use strings to define global variables");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                defGlobal(AS_STRING(peek(1)));
-                pop();
+                if (!defGlobal(vm, internString(vm, AS_STRING(peek(vm, 1))))) return INTERPRET_RUNTIME_ERROR;
+                pop(vm);
                 break;
             }
 
             // Locals
             case OP_GET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                push(frame->slots[slot]);
+                push(vm, frame->slots[slot]);
                 break;
             }
             case OP_GET_LOCAL_LONG: {
                 uint32_t slot = READ_LONG();
-                push(frame->slots[slot]);
+                push(vm, frame->slots[slot]);
                 break;
             }
             case OP_SET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                frame->slots[slot] = peek(0);
+                frame->slots[slot] = peek(vm, 0);
                 break;
             }
             case OP_SET_LOCAL_LONG: {
                 uint32_t slot = READ_LONG();
-                frame->slots[slot] = peek(0);
+                frame->slots[slot] = peek(vm, 0);
                 break;
             }
 
             
             // Pop onces
-            case OP_POP: pop(); break;
+            case OP_POP: pop(vm); break;
             // Pop n times
-            case OP_POPN: vm.stackTop -= READ_LONG(); break;
+            case OP_POPN: vm->stackTop -= READ_LONG(); break;
 
             //// Statements ////
             case OP_PRINT: {
-                printValue(pop());
+                printValue(pop(vm));
                 printf("\n");
                 break;
             }
@@ -1526,12 +2209,12 @@ static InterpretResult run() {
             //// Control Flow ////
             case OP_JUMP_IF_FALSE: {
                 uint16_t loc = READ_SHORT();
-                if (isFalse(peek(0))) frame->ip += loc;
+                if (isFalse(peek(vm, 0))) frame->ip += loc;
                 break;
             }
             case OP_JUMP_IF_TRUE: {
                 uint16_t loc = READ_SHORT();
-                if (!isFalse(peek(0))) frame->ip += loc;
+                if (!isFalse(peek(vm, 0))) frame->ip += loc;
                 break;
             }
             case OP_JUMP: {
@@ -1540,7 +2223,7 @@ static InterpretResult run() {
             }
             case OP_JUMP_NPOP: {
                 int jump = READ_SHORT();
-                vm.stackTop -= READ_LONG();
+                vm->stackTop -= READ_LONG();
                 frame->ip += jump;
                 break;
             }
@@ -1550,20 +2233,20 @@ static InterpretResult run() {
             }
             case OP_LOOP_IF_TRUE: {
                 uint16_t loc = READ_SHORT();
-                if (!isFalse(peek(0))) frame->ip -= loc;
+                if (!isFalse(peek(vm, 0))) frame->ip -= loc;
                 // Pop condition check value from the stack
-                pop();
+                pop(vm);
                 break;
             }
 
             // Function Stuff //
             case OP_CALL: {
                 int argCount = READ_BYTE();
-                if (!callValue(peek(argCount), argCount)) {
+                if (!callValue(vm, peek(vm, argCount), argCount)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 // Change frame
-                frame = &vm.frames[vm.frameCount - 1];
+                frame = &vm->frames[vm->frameCount - 1];
                 break;
             }
 
@@ -1571,49 +2254,85 @@ static InterpretResult run() {
 
             // str, index
             case OP_INDEX: {
+                if (IS_ARRAY(peek(vm, 1))) {
+                    double* element = arrayElement(vm, AS_ARRAY(peek(vm, 1)), peek(vm, 0));
+                    if (element == NULL) return INTERPRET_RUNTIME_ERROR;
+                    vm->stackTop -= 2;
+                    push(vm, NUMBER_VAL(*element));
+                    break;
+                }
                 // Type check
-                if (!IS_STRING(peek(1))) {
-                    runtimeError("Can only index strings");
+                if (!IS_STRING(peek(vm, 1))) {
+                    runtimeError(vm, "Can only index strings and arrays");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                if (!IS_NUMBER(peek(0))) {
-                    runtimeError("Index must be a number");
+                if (!IS_NUMBER(peek(vm, 0))) {
+                    runtimeError(vm, "Index must be a number");
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 
-                int index = (int) AS_NUMBER(peek(0));
-                char* str = AS_CSTRING(peek(1));
-                int len = AS_STRING(peek(1))->length;
+                int index = (int) AS_NUMBER(peek(vm, 0));
+                char* str = AS_CSTRING(peek(vm, 1));
+                int len = AS_STRING(peek(vm, 1))->length;
                 // Pop arguments
-                vm.stackTop -= 2;
+                vm->stackTop -= 2;
                 // Wrap around
                 if (index < 0) {
                     index += len;
                 }
                 // Bounds check
                 if (index < 0 || index >= len) {
-                    runtimeError("Index out of bounds");
+                    runtimeError(vm, "Index out of bounds");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(OBJ_VAL(copyString(str + index, 1)));
+                push(vm, OBJ_VAL(copyTransientString(vm, str + index, 1)));
+                break;
+            }
+
+            // array, index
+            case OP_INDEX_POPLESS: {
+                if (!IS_ARRAY(peek(vm, 1))) {
+                    runtimeError(vm, "Can only assign to indexes of arrays");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                double* element = arrayElement(vm, AS_ARRAY(peek(vm, 1)), peek(vm, 0));
+                if (element == NULL) return INTERPRET_RUNTIME_ERROR;
+                push(vm, NUMBER_VAL(*element));
+                break;
+            }
+            // array, index, value
+            case OP_SET_INDEX: {
+                if (!IS_ARRAY(peek(vm, 2))) {
+                    runtimeError(vm, "Can only assign to indexes of arrays");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (!IS_NUMBER(peek(vm, 0))) {
+                    runtimeError(vm, "Arrays can only hold numbers");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                double* element = arrayElement(vm, AS_ARRAY(peek(vm, 2)), peek(vm, 1));
+                if (element == NULL) return INTERPRET_RUNTIME_ERROR;
+                *element = AS_NUMBER(peek(vm, 0));
+                // Assignment leaves the value
+                vm->stackTop[-3] = vm->stackTop[-1];
+                vm->stackTop -= 2;
                 break;
             }
 
             // str, start, end
             case OP_INDEX_RANGE: {
                 // Type check
-                if (!IS_STRING(peek(2))) {
-                    runtimeError("Can only index strings");
+                if (!IS_STRING(peek(vm, 2)) && !IS_ARRAY(peek(vm, 2))) {
+                    runtimeError(vm, "Can only index strings and arrays");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                if (!IS_NUMBER(peek(1)) && !IS_NIL(peek(1)) || !IS_NUMBER(peek(0)) && !IS_NIL(peek(0))) {
-                    runtimeError("Index ranges must be nil or a number");
+                if (!IS_NUMBER(peek(vm, 1)) && !IS_NIL(peek(vm, 1)) || !IS_NUMBER(peek(vm, 0)) && !IS_NIL(peek(vm, 0))) {
+                    runtimeError(vm, "Index ranges must be nil or a number");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                char* str = AS_CSTRING(peek(2));
-                int len = AS_STRING(peek(2))->length;
-                int startIndex = IS_NUMBER(peek(1))?AS_NUMBER(peek(1)):0;
-                int endIndex = IS_NUMBER(peek(0))?AS_NUMBER(peek(0)):len;
+                int len = IS_ARRAY(peek(vm, 2)) ? AS_ARRAY(peek(vm, 2))->length : AS_STRING(peek(vm, 2))->length;
+                int startIndex = IS_NUMBER(peek(vm, 1))?AS_NUMBER(peek(vm, 1)):0;
+                int endIndex = IS_NUMBER(peek(vm, 0))?AS_NUMBER(peek(vm, 0)):len;
                 int interval = 1;
                 // Wrap indexes
                 if (startIndex < 0) {
@@ -1622,32 +2341,38 @@ static InterpretResult run() {
                 if (endIndex < 0) {
                     endIndex += len;
                 }
+                if (IS_ARRAY(peek(vm, 2))) {
+                    ObjArray* slice = sliceArray(vm, AS_ARRAY(peek(vm, 2)), startIndex, endIndex, interval);
+                    vm->stackTop -= 3;
+                    push(vm, OBJ_VAL(slice));
+                    break;
+                }
+                char* str = AS_CSTRING(peek(vm, 2));
                 // Pop values
-                vm.stackTop -= 3;
+                vm->stackTop -= 3;
                 // Get substr
-                pushIndexRange(str, len, startIndex, endIndex, interval);
+                pushIndexRange(vm, str, len, startIndex, endIndex, interval);
                 break;
             }
 
             // Str, start, end, interval
             case OP_INDEX_RANGE_INTERVAL: {
                 // Type check
-                if (!IS_STRING(peek(3))) {
-                    runtimeError("Can only index strings");
+                if (!IS_STRING(peek(vm, 3)) && !IS_ARRAY(peek(vm, 3))) {
+                    runtimeError(vm, "Can only index strings and arrays");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                if (!IS_NUMBER(peek(2)) && !IS_NIL(peek(2)) || !IS_NUMBER(peek(1)) && !IS_NIL(peek(1)) || !IS_NUMBER(peek(0)) && !IS_NIL(peek(0))) {
-                    runtimeError("Index ranges and interval must be nil or a number");
+                if (!IS_NUMBER(peek(vm, 2)) && !IS_NIL(peek(vm, 2)) || !IS_NUMBER(peek(vm, 1)) && !IS_NIL(peek(vm, 1)) || !IS_NUMBER(peek(vm, 0)) && !IS_NIL(peek(vm, 0))) {
+                    runtimeError(vm, "Index ranges and interval must be nil or a number");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                char* str = AS_CSTRING(peek(3));
-                int len = AS_STRING(peek(3))->length;
+                int len = IS_ARRAY(peek(vm, 3)) ? AS_ARRAY(peek(vm, 3))->length : AS_STRING(peek(vm, 3))->length;
                 // Determine interval and defaults
-                int interval = IS_NUMBER(peek(0)) ? (int)AS_NUMBER(peek(0)) : 1;
+                int interval = IS_NUMBER(peek(vm, 0)) ? (int)AS_NUMBER(peek(vm, 0)) : 1;
                 int startIndex, endIndex;
                 // Get startIndex
-                if (IS_NUMBER(peek(2))) {
-                    startIndex = (int)AS_NUMBER(peek(2));
+                if (IS_NUMBER(peek(vm, 2))) {
+                    startIndex = (int)AS_NUMBER(peek(vm, 2));
                     if (startIndex < 0) {
                         startIndex += len;
                     }
@@ -1655,8 +2380,8 @@ static InterpretResult run() {
                     startIndex = interval > 0 ? 0 : len - 1;;
                 }
                 // Get endIndex
-                if (IS_NUMBER(peek(1))) {
-                    endIndex = (int)AS_NUMBER(peek(1));
+                if (IS_NUMBER(peek(vm, 1))) {
+                    endIndex = (int)AS_NUMBER(peek(vm, 1));
                     if (endIndex < 0) {
                         endIndex += len;
                     }
@@ -1664,45 +2389,52 @@ static InterpretResult run() {
                     endIndex = interval > 0 ? len : -1;
                 }
 
-                // Pop values
-                vm.stackTop -= 4;
                 // Check interval
                 if (interval == 0) {
-                    runtimeError("Interval cannot be '0'");
+                    runtimeError(vm, "Interval cannot be '0'");
                     return INTERPRET_RUNTIME_ERROR;
                 }
+                if (IS_ARRAY(peek(vm, 3))) {
+                    ObjArray* slice = sliceArray(vm, AS_ARRAY(peek(vm, 3)), startIndex, endIndex, interval);
+                    vm->stackTop -= 4;
+                    push(vm, OBJ_VAL(slice));
+                    break;
+                }
+                char* str = AS_CSTRING(peek(vm, 3));
+                // Pop values
+                vm->stackTop -= 4;
                 // Get substr
-                pushIndexRange(str, len, startIndex, endIndex, interval);
+                pushIndexRange(vm, str, len, startIndex, endIndex, interval);
                 break;
             }
 
             // Ascend outside the VM //
             case OP_EXTRACT: {
                 // Rip the top value on the stack out
-                vm.output = pop();
+                vm->output = pop(vm);
                 // Exit interpreter
                 return INTERPRET_OK;
             }
             
             // Returns value from func
             case OP_RETURN: {
-                Value result = pop();
-                vm.frameCount--;
+                Value result = pop(vm);
+                vm->frameCount--;
                 // Check if in final frame
-                if (vm.frameCount == 0) {
-                    pop();
+                if (vm->frameCount == 0) {
+                    pop(vm);
                     // Exit interpreter
                     return INTERPRET_OK;
                 }
 
-                vm.stackTop = frame->slots;
-                push(result);
-                frame = &vm.frames[vm.frameCount - 1];
+                vm->stackTop = frame->slots;
+                push(vm, result);
+                frame = &vm->frames[vm->frameCount - 1];
                 break;
             }
 
             default: {
-                runtimeError("Unrecognized bytecode");
+                runtimeError(vm, "Unrecognized bytecode");
                 return INTERPRET_RUNTIME_ERROR;
             }
         }
@@ -1715,24 +2447,37 @@ static InterpretResult run() {
 #undef READ_STRING_LONG
 #undef READ_STRING
 #undef BINARY_OP
+#undef FUSED_OP
+#undef COMPARE_JUMP
+#undef STEP_LOCAL
+#undef READ_GLOBAL
 }
 
 // Interpret a chunk
-InterpretResult interpret(const char* source) {
+InterpretResult interpret(VM* vm, const char* source) {
     // Reset Stack
-    resetStack();
+    resetStack(vm);
     // Compile source
-    ObjFunction* function = compile(source);
+    ObjFunction* function = compile(vm, source);
     if (function == NULL) return INTERPRET_COMPILE_ERROR;
 
+    return interpretFunction(vm, function);
+}
+
+InterpretResult interpretFunction(VM* vm, ObjFunction* function) {
+    // Reset Stack
+    resetStack(vm);
+
     // Push script frame onto stack
-    push(OBJ_VAL(function));
-    call(function, 0);
+    push(vm, OBJ_VAL(function));
+    addScriptModule(vm, function);
+    call(vm, function, 0);
 
     // Run
-    InterpretResult result = run();
+    InterpretResult result = run(vm);
 
     return result;
 }
 
-#undef FOUR_TYPE_ID
\ No newline at end of file
+#undef FOUR_TYPE_ID
+#undef MODULE_PATH_MAX
\ No newline at end of file
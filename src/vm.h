@@ -11,6 +11,8 @@
 #define FRAMES_MAX 256
 // Stack size is 16kb
 #define STACK_MAX 16384
+// Runtime compiled formulas kept for reuse
+#define FORMULA_CACHE_MAX 64
 
 
 typedef struct {
@@ -19,7 +21,34 @@ typedef struct {
     Value* slots;
 } CallFrame;
 
+// A runtime compiled formula kept for reuse
 typedef struct {
+    // Formula the function's constants currently hold
+    ObjString* source;
+    // Formula with every number literal replaced by '#'
+    ObjString* key;
+    ObjFunction* function;
+    // Holds the function's code, lines, constants and literals
+    Arena arena;
+    // Constant slot each number literal of the source is loaded from, in order
+    uint32_t* literals;
+    // Every literal still has its own slot, none was folded away, so new literals can be patched in
+    bool isTemplate;
+    // Being run, cannot be patched or evicted
+    bool inUse;
+    uint64_t lastUsed;
+} CachedFormula;
+
+// A module compiled once per process
+typedef struct {
+    ObjString* path;
+    ObjFunction* function;
+    // Top level already ran into the current globals
+    bool isLoaded;
+} Module;
+
+// Everything one interpreter owns, independent VMs can run side by side
+struct VM {
     CallFrame frames[FRAMES_MAX];
     int frameCount;
 
@@ -29,10 +58,33 @@ typedef struct {
     Table strings;
     Obj* objects;
 
+    // Garbage collection
+    size_t bytesAllocated;
+    size_t nextGC;
+    // Tunable, nextGC is this many times the bytes the last collection kept
+    size_t heapGrowFactor;
+    int grayCount;
+    int grayCapacity;
+    Obj** grayStack;
+    // Innermost compiler running, its functions are roots
+    struct Compiler* compiler;
+
+    // Runtime compiled formulas, least recently used is evicted
+    CachedFormula formulas[FORMULA_CACHE_MAX];
+    uint64_t formulaClock;
+
+    // Path of the script being run, modules it imports are found next to it
+    // NULL finds them in the working directory
+    const char* scriptPath;
+    // Imported modules, kept until the VM is freed
+    Module* modules;
+    int moduleCount;
+    int moduleCapacity;
+
     // Wavetable stuff
     Wavetable wavetable;
     Value output;
-} VM;
+};
 
 typedef enum {
     INTERPRET_OK,
@@ -40,13 +92,18 @@ typedef enum {
     INTERPRET_RUNTIME_ERROR
 } InterpretResult;
 
-extern VM vm;
-
-void initVM();
-void freeVM();
-InterpretResult interpret(const char* source);
+void initVM(VM* vm);
+void freeVM(VM* vm);
+InterpretResult interpret(VM* vm, const char* source);
+// Run a script that is already compiled
+InterpretResult interpretFunction(VM* vm, ObjFunction* function);
+// Forget every global a script defined and its wavetable, natives stay
+// Imported modules run their top level again on their next import, without compiling again
+void resetGlobals(VM* vm);
+// Register tier op with the same result as a native, -1 if there is none
+int nativeRegisterOp(NativeFn native);
 // Stack funcs
-void push(Value value);
-Value pop();
+void push(VM* vm, Value value);
+Value pop(VM* vm);
 
 #endif
\ No newline at end of file